@@ -0,0 +1,497 @@
+/**
+ * @file link_event_loop.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef LINK_EVENT_LOOP_HPP
+#define LINK_EVENT_LOOP_HPP
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <utility>
+#include <algorithm>
+#include <thread>
+
+#include "cross_sockets.hpp"
+
+namespace ASE
+{
+
+    template<typename T = void>
+    class Task;
+
+    /**
+     * @brief Promise part shared by all the tasks: the awaiting coroutine is resumed when the task ends
+     * 
+     */
+    struct TaskPromiseBase
+    {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr exception;
+
+        struct FinalAwaiter
+        {
+            bool await_ready() noexcept
+            {
+                return false;
+            }
+
+            template<typename Promise>
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+            {
+                std::coroutine_handle<> continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept
+            {
+
+            }
+        };
+
+        std::suspend_always initial_suspend() noexcept
+        {
+            return {};
+        }
+
+        FinalAwaiter final_suspend() noexcept
+        {
+            return {};
+        }
+
+        void unhandled_exception()
+        {
+            exception = std::current_exception();
+        }
+    };
+
+    template<typename T>
+    struct TaskPromise : TaskPromiseBase
+    {
+        std::optional<T> value;
+
+        Task<T> get_return_object();
+
+        void return_value(T output)
+        {
+            value = std::move(output);
+        }
+
+        T result()
+        {
+            if(exception)
+            {
+                std::rethrow_exception(exception);
+            }
+            return std::move(*value);
+        }
+    };
+
+    template<>
+    struct TaskPromise<void> : TaskPromiseBase
+    {
+        Task<void> get_return_object();
+
+        void return_void()
+        {
+
+        }
+
+        void result()
+        {
+            if(exception)
+            {
+                std::rethrow_exception(exception);
+            }
+        }
+    };
+
+
+    /**
+     * @brief Lazy coroutine: it starts when awaited (or given to LinkEventLoop::spawn), its exception
+     * is thrown again to the coroutine awaiting it
+     * 
+     * @tparam T type of co_return
+     */
+    template<typename T>
+    class Task
+    {
+        public:
+            using promise_type = TaskPromise<T>;
+
+        private:
+            std::coroutine_handle<promise_type> handle_;
+
+        public:
+            explicit Task(std::coroutine_handle<promise_type> handle = nullptr): handle_(handle)
+            {
+
+            }
+
+            Task(Task &&other) noexcept: handle_(std::exchange(other.handle_, nullptr))
+            {
+
+            }
+
+            Task &operator=(Task &&other) noexcept
+            {
+                if(this != &other)
+                {
+                    if(handle_)
+                    {
+                        handle_.destroy();
+                    }
+                    handle_ = std::exchange(other.handle_, nullptr);
+                }
+                return *this;
+            }
+
+            Task(const Task&) = delete;
+            Task &operator=(const Task&) = delete;
+
+            ~Task()
+            {
+                if(handle_)
+                {
+                    handle_.destroy();
+                }
+            }
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            bool isDone() const
+            {
+                return !handle_ || handle_.done();
+            }
+
+            /**
+             * @brief Get the result of a task done, throw its exception if it ended with one
+             * 
+             */
+            T getResult()
+            {
+                return handle_.promise().result();
+            }
+
+            /**
+             * @brief Start the task or resume it, for the event loop
+             * 
+             */
+            void resume()
+            {
+                handle_.resume();
+            }
+
+
+            // ~~~~~~~~~~ AWAITABLE ~~~~~~~~~~
+
+            bool await_ready() const noexcept
+            {
+                return isDone();
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+            {
+                handle_.promise().continuation = awaiting;
+                return handle_;
+            }
+
+            T await_resume()
+            {
+                return handle_.promise().result();
+            }
+    };
+
+    template<typename T>
+    inline Task<T> TaskPromise<T>::get_return_object()
+    {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object()
+    {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+
+
+    /**
+     * @brief Single threaded event loop of the coroutine API of ServerLink: the coroutines waiting for a
+     * non-blocking socket or a delay are resumed by runOnce, which polls all the sockets at once.
+     * Call runOnce(0) at each frame of the game to serve the links without blocking it, or run to
+     * only serve them. Not thread safe, everything runs in the thread calling it
+     * 
+     */
+    class LinkEventLoop
+    {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+        private:
+            struct SocketWaiter
+            {
+                SOCKET socket;
+                short events;
+                std::coroutine_handle<> handle;
+            };
+
+            std::vector<SocketWaiter> socket_waiters_;
+            std::multimap<Clock::time_point, std::coroutine_handle<>> timers_;
+            std::vector<Task<void>> tasks_;     // spawned, owned until done
+            bool stopped_;
+
+            std::vector<struct pollfd> poll_fds_;
+            std::vector<std::coroutine_handle<>> ready_;
+
+            /**
+             * @brief Wait for events on a socket
+             * 
+             */
+            struct SocketAwaiter
+            {
+                LinkEventLoop &loop;
+                SOCKET socket;
+                short events;
+
+                bool await_ready() const noexcept
+                {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<> handle)
+                {
+                    loop.socket_waiters_.push_back({socket, events, handle});
+                }
+
+                void await_resume() const noexcept
+                {
+
+                }
+            };
+
+            /**
+             * @brief Wait for a time of the loop clock
+             * 
+             */
+            struct TimerAwaiter
+            {
+                LinkEventLoop &loop;
+                Clock::time_point deadline;
+
+                bool await_ready() const noexcept
+                {
+                    return Clock::now() >= deadline;
+                }
+
+                void await_suspend(std::coroutine_handle<> handle)
+                {
+                    loop.timers_.emplace(deadline, handle);
+                }
+
+                void await_resume() const noexcept
+                {
+
+                }
+            };
+
+            static int pollAll(struct pollfd *fds, std::size_t count, int timeout_milli)
+            {
+                #ifdef WIN32
+                return WSAPoll(fds, ULONG(count), timeout_milli);
+
+                #elif defined(__linux__)
+                return poll(fds, nfds_t(count), timeout_milli);
+                #endif
+            }
+
+            /**
+             * @brief Drop the tasks done, throw the exception of the first one which ended with one
+             * 
+             */
+            void collectTasks()
+            {
+                for(std::size_t i = 0; i < tasks_.size();)
+                {
+                    if(!tasks_[i].isDone())
+                    {
+                        i++;
+                        continue;
+                    }
+
+                    Task<void> done = std::move(tasks_[i]);
+                    tasks_[i] = std::move(tasks_.back());
+                    tasks_.pop_back();
+
+                    done.getResult();
+                }
+            }
+
+        public:
+            LinkEventLoop(): stopped_(false)
+            {
+
+            }
+
+            LinkEventLoop(const LinkEventLoop&) = delete;
+            LinkEventLoop &operator=(const LinkEventLoop&) = delete;
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            /**
+             * @brief Get the number of spawned tasks not done yet
+             * 
+             * @return std::size_t
+             */
+            std::size_t getTaskCount() const
+            {
+                return tasks_.size();
+            }
+
+            /**
+             * @brief Tell if coroutines wait for a socket or a delay
+             * 
+             */
+            bool hasWaiters() const
+            {
+                return !socket_waiters_.empty() || !timers_.empty();
+            }
+
+
+            // ~~~~~~~~~~ AWAITABLES ~~~~~~~~~~
+
+            /**
+             * @brief co_await it to wait until the socket can be read (or is closed)
+             * 
+             */
+            SocketAwaiter readable(SOCKET socket)
+            {
+                return SocketAwaiter{*this, socket, POLLIN};
+            }
+
+            /**
+             * @brief co_await it to wait until the socket can be written (or is connected)
+             * 
+             */
+            SocketAwaiter writable(SOCKET socket)
+            {
+                return SocketAwaiter{*this, socket, POLLOUT};
+            }
+
+            /**
+             * @brief co_await it to let the other coroutines run during a delay
+             * 
+             */
+            TimerAwaiter sleepFor(Clock::duration duration)
+            {
+                return TimerAwaiter{*this, Clock::now() + duration};
+            }
+
+
+            /**
+             * @brief Start a task, kept by the loop until done
+             * 
+             * @param task
+             */
+            void spawn(Task<void> task)
+            {
+                tasks_.push_back(std::move(task));
+                tasks_.back().resume();
+                collectTasks();
+            }
+
+            /**
+             * @brief Wait for the sockets and delays at most timeout_milli, then resume the coroutines ready.
+             * Throws the exception of a spawned task ended with one
+             * 
+             * @param timeout_milli 0 to never block, -1 to wait without limit
+             * @return true if coroutines still wait
+             */
+            bool runOnce(int timeout_milli = 0)
+            {
+                if(!timers_.empty())
+                {
+                    int until_timer = int(std::chrono::ceil<std::chrono::milliseconds>(timers_.begin()->first - Clock::now()).count());
+                    until_timer = std::max(until_timer, 0);
+                    timeout_milli = timeout_milli < 0 ? until_timer : std::min(timeout_milli, until_timer);
+                }
+
+                poll_fds_.clear();
+                for(const SocketWaiter &waiter : socket_waiters_)
+                {
+                    poll_fds_.push_back({waiter.socket, waiter.events, 0});
+                }
+
+                if(!poll_fds_.empty())
+                {
+                    pollAll(poll_fds_.data(), poll_fds_.size(), timeout_milli);
+                }
+                else if(timeout_milli != 0 && !timers_.empty())
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(timeout_milli));
+                }
+
+                // taken out before resuming, the coroutines resumed may wait again
+                ready_.clear();
+                std::size_t kept = 0;
+                for(std::size_t i = 0; i < socket_waiters_.size(); i++)
+                {
+                    if(i < poll_fds_.size() && poll_fds_[i].revents != 0)
+                    {
+                        ready_.push_back(socket_waiters_[i].handle);
+                    }
+                    else
+                    {
+                        socket_waiters_[kept++] = socket_waiters_[i];
+                    }
+                }
+                socket_waiters_.resize(kept);
+
+                Clock::time_point now = Clock::now();
+                while(!timers_.empty() && timers_.begin()->first <= now)
+                {
+                    ready_.push_back(timers_.begin()->second);
+                    timers_.erase(timers_.begin());
+                }
+
+                std::vector<std::coroutine_handle<>> resuming;
+                resuming.swap(ready_);
+                for(std::coroutine_handle<> handle : resuming)
+                {
+                    handle.resume();
+                }
+                resuming.clear();
+                ready_.swap(resuming);
+
+                collectTasks();
+                return hasWaiters();
+            }
+
+            /**
+             * @brief Run until all the spawned tasks are done or stop is called
+             * 
+             */
+            void run()
+            {
+                stopped_ = false;
+                while(!stopped_ && !tasks_.empty() && hasWaiters())
+                {
+                    runOnce(-1);
+                }
+            }
+
+            /**
+             * @brief Make run return after the current iteration, for a coroutine of the loop
+             * 
+             */
+            void stop()
+            {
+                stopped_ = true;
+            }
+    };
+
+}
+
+#endif
@@ -11,11 +11,39 @@
 #include <iostream>
 #include <cstring>
 #include <functional>
+#include <thread>
+#include <atomic>
+#include <mutex>
 
 #include "cross_sockets.hpp"
 #include "connection_expections.hpp"
 #include "frame.hpp"
+#include "frame_receiver.hpp"
+#include "compression.hpp"
+#include "capabilities.hpp"
+#include "snapshot.hpp"
+#include "connection_limits.hpp"
+#include "fragmentation.hpp"
+#include "unreliable_datagram.hpp"
+#include "reliable_endpoint.hpp"
+#include "shared_ring.hpp"
 #include "player_list.hpp"
+#include "link_event_loop.hpp"
+#include "spsc_queue.hpp"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+// frames received by the network thread and not taken by tryRecv yet, the thread waits when full
+#define LINK_INBOUND_QUEUE_SIZE 256
+// messages given to addDataToSend and not sent by the network thread yet, addDataToSend waits when full
+#define LINK_OUTBOUND_QUEUE_SIZE 4096
+// with server push and without eventfd to wake it, longest wait of the network thread for a frame before sending the queued messages
+#define LINK_PUSH_POLL_MILLI 1
+// with server push, an empty frame is sent by the network thread after this silence, so that the server keeps the link
+#define LINK_PUSH_KEEPALIVE_MILLI 1000
 
 namespace ASE
 {
@@ -24,53 +52,99 @@ template <typename PlayerDataStructure>
 class ServerLink;
 
 
-template<typename PlayerDataStructure>
-SOCKET connectToServer(std::string server_address, int port, void *connect_data, size_t connect_data_size, PlayerList<PlayerDataStructure> &player_list_ref, int &my_id)
+/**
+ * @brief Tell if the connect frame carries a CAPABILITIES message
+ * 
+ */
+inline bool offersCapabilities(CompressionContext *compression, WireVersion *wire_version, ConnectionLimits *server_limits, uint64_t *unreliable_token, bool *shared_memory, bool *server_push)
 {
-    
-    SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
-    if(sock == INVALID_SOCKET)
+    bool offer_compression = compression != nullptr && compression->isEnabled();
+    return offer_compression || wire_version != nullptr || server_limits != nullptr || unreliable_token != nullptr || shared_memory != nullptr || server_push != nullptr;
+}
+
+/**
+ * @brief Build the connect frame of the handshake, and reset the outputs filled by the answer
+ * 
+ * @return Frame 
+ */
+inline Frame makeConnectFrame(void *connect_data, size_t connect_data_size, CompressionContext *compression, WireVersion *wire_version, 
+                              const ConnectionLimits &my_limits, ConnectionLimits *server_limits, uint64_t *unreliable_token, bool *shared_memory, bool *server_push)
+{
+    Frame hello;
+    if(connect_data_size == 0)
     {
-        throw ServerConnectionException(strerror(errno));
+        hello.addMessage(Message(CONNECT,nullptr,0));
+    }
+    else
+    {
+        hello.addMessage(Message(CONNECTWINFO, connect_data, connect_data_size));
     }
 
-    #ifdef WIN32
-    DWORD timeout = timeout_limit * 1000;
-    setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
-    
-    #elif defined(__linux__)
-        int yes = 1;
-        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(int));
-    #endif
-
-
-    SOCKADDR_IN sin = { 0, 0, 0, 0 };
+    // offer compression and the v2 framing, the context stays enabled only if the server accepts it
+    bool offer_compression = compression != nullptr && compression->isEnabled();
+    if(offersCapabilities(compression, wire_version, server_limits, unreliable_token, shared_memory, server_push))
+    {
+        ConnectionCapabilities offered = offer_compression ? compression->getCapabilities() : ConnectionCapabilities();
+        if(wire_version != nullptr)
+        {
+            offered.flags |= CAPABILITY_WIRE_V2;
+        }
+        if(unreliable_token != nullptr)
+        {
+            offered.flags |= CAPABILITY_UNRELIABLE;
+        }
+        if(shared_memory != nullptr)
+        {
+            offered.flags |= CAPABILITY_SHARED_MEMORY;
+        }
+        if(server_push != nullptr)
+        {
+            offered.flags |= CAPABILITY_SERVER_PUSH;
+        }
+        offered.setLimits(my_limits);
+        hello.add(CAPABILITIES, offered);
+    }
 
+    if(server_limits != nullptr)
+    {
+        *server_limits = ConnectionLimits();
+    }
 
-    sin.sin_addr.s_addr = inet_addr(server_address.c_str());
-    sin.sin_port = htons(port);
-    sin.sin_family = AF_INET;
+    if(wire_version != nullptr)
+    {
+        *wire_version = WIRE_V1;
+    }
 
-    if(connect(sock,(SOCKADDR *) &sin, sizeof(SOCKADDR)) == SOCKET_ERROR)
+    if(unreliable_token != nullptr)
     {
-        throw ServerConnectionException(strerror(errno));
-    }   
+        *unreliable_token = 0;
+    }
 
-    Frame hello;
-    if(connect_data_size == 0)
+    if(shared_memory != nullptr)
     {
-        hello.addMessage(Message(CONNECT,nullptr,0));
+        *shared_memory = false;
     }
-    else
+
+    if(server_push != nullptr)
     {
-        hello.addMessage(Message(CONNECTWINFO, connect_data, connect_data_size));
+        *server_push = false;
     }
 
+    return hello;
+}
 
-    hello.sendFrame(sock);      // not catched
+/**
+ * @brief Read the answer of the server to the connect frame: players, id and the capabilities accepted.
+ * Throw if the server refused
+ * 
+ */
+template<typename PlayerDataStructure>
+void readConnectAnswer(Frame &server_answer, PlayerList<PlayerDataStructure> &player_list_ref, int &my_id, CompressionContext *compression, WireVersion *wire_version, 
+                       ConnectionLimits *server_limits, uint64_t *unreliable_token, bool *shared_memory, bool *server_push)
+{
+    bool offer_compression = compression != nullptr && compression->isEnabled();
+    bool offer_capabilities = offersCapabilities(compression, wire_version, server_limits, unreliable_token, shared_memory, server_push);
 
-    
-    Frame server_answer = recvFrame(sock);
     std::cout << "recv from server " << server_answer.getLength() << " messages with "<< int(server_answer.getMessages()[0].getHat()) << " and " << int(server_answer.getMessages()[1].getHat()) << "\n";
     switch (server_answer.getMessages()[0].getHat())
     {
@@ -90,33 +164,161 @@ SOCKET connectToServer(std::string server_address, int port, void *connect_data,
         break;
     }
     
-    /**
-     * ! Maybe dangerous 
-     */
-    int *server_initial_infos = (int *)(server_answer.getMessages()[0].getRawData());       // attetion big/little endian
-
-    for(int i = 0; i < server_answer.getMessages()[0].getSizeOfData()/4; i++)               // a rendre plus propre
+    const Message &client_id_list = server_answer.getMessages()[0];
+    for(std::size_t i = 0; i < client_id_list.count<int32_t>(); i++)
     {
-        player_list_ref.addPlayer(server_initial_infos[i]);
+        player_list_ref.addPlayer(client_id_list.as<int32_t>(i));
     }
 
     if(server_answer.getMessages()[1].getHat() != YOURID)
     {
         throw RemoteConnectionException("bad codata sended");
     }
-    my_id = *(int *)(server_answer.getMessages()[1].getRawData());
+    my_id = server_answer.getMessages()[1].as<int32_t>();
 
     if(server_answer.getMessages()[2].getHat() != CODATA)
     {
         throw RemoteConnectionException("bad codata sended");
     }
     
+    if(offer_capabilities)
+    {
+        ConnectionCapabilities accepted;
+        if(server_answer.getLength() > 3 && server_answer.getMessages()[3].getHat() == CAPABILITIES)
+        {
+            accepted = decodeCapabilities(server_answer.getMessages()[3].getData());
+
+            if(server_limits != nullptr)
+            {
+                *server_limits = accepted.getLimits();
+            }
+        }
+
+        if(offer_compression)
+        {
+            if(accepted.flags & CAPABILITY_COMPRESSION)
+            {
+                // the server tells if it has the same dictionary
+                if(accepted.dictionary_id == 0)
+                {
+                    compression->enable(nullptr, compression->getThreshold());
+                }
+            }
+            else
+            {
+                compression->disable();
+            }
+        }
+
+        if(wire_version != nullptr && (accepted.flags & CAPABILITY_WIRE_V2))
+        {
+            *wire_version = WIRE_V2;
+        }
+
+        if(unreliable_token != nullptr && (accepted.flags & CAPABILITY_UNRELIABLE))
+        {
+            *unreliable_token = accepted.unreliable_token;
+        }
+
+        // the server then waits for the shared memory on the socket
+        if(shared_memory != nullptr && (accepted.flags & CAPABILITY_SHARED_MEMORY))
+        {
+            *shared_memory = true;
+        }
+
+        // the server then sends its frames on its own schedule
+        if(server_push != nullptr && (accepted.flags & CAPABILITY_SERVER_PUSH))
+        {
+            *server_push = true;
+        }
+    }
+
     // lambda codata
+}
+
+/**
+ * @brief Do the handshake on a socket already connected to a server: connect frame, then its answer
+ * 
+ * @return SOCKET the socket given
+ */
+template<typename PlayerDataStructure>
+SOCKET connectToServer(SOCKET sock, void *connect_data, size_t connect_data_size, PlayerList<PlayerDataStructure> &player_list_ref, int &my_id, CompressionContext *compression = nullptr, WireVersion *wire_version = nullptr, 
+                       const ConnectionLimits &my_limits = ConnectionLimits(), ConnectionLimits *server_limits = nullptr, uint64_t *unreliable_token = nullptr, bool *shared_memory = nullptr,
+                       bool *server_push = nullptr)
+{
+    Frame hello = makeConnectFrame(connect_data, connect_data_size, compression, wire_version, my_limits, server_limits, unreliable_token, shared_memory, server_push);
+    hello.sendFrame(sock);      // not catched
+
+    Frame server_answer = recvFrame(sock, WIRE_V1, my_limits);
+    readConnectAnswer(server_answer, player_list_ref, my_id, compression, wire_version, server_limits, unreliable_token, shared_memory, server_push);
     
     return sock;
 
 }
 
+#if defined(__linux__)
+/**
+ * @brief Handshake through the local link of a server of this process (Server::connectLocal), as connectToServer 
+ * does on a socket. The link already is a shared memory one, the unreliable channel has no address
+ * 
+ */
+template<typename PlayerDataStructure>
+void connectToServer(SharedMemoryLink &local_link, void *connect_data, size_t connect_data_size, PlayerList<PlayerDataStructure> &player_list_ref, int &my_id, CompressionContext *compression = nullptr, 
+                     WireVersion *wire_version = nullptr, const ConnectionLimits &my_limits = ConnectionLimits(), ConnectionLimits *server_limits = nullptr, bool *server_push = nullptr)
+{
+    Frame hello = makeConnectFrame(connect_data, connect_data_size, compression, wire_version, my_limits, server_limits, nullptr, nullptr, server_push);
+    local_link.sendFrame(hello);
+
+    // the answer is a v1 frame without compression, nothing else is sent before the next frame of the client
+    FrameReceiver receiver;
+    receiver.setLimits(my_limits);
+
+    FrameView answer_view;
+    while(!local_link.recvFrameView(receiver, answer_view))
+    {
+    }
+
+    Frame server_answer = answer_view.toFrame();
+    readConnectAnswer(server_answer, player_list_ref, my_id, compression, wire_version, server_limits, nullptr, nullptr, server_push);
+}
+#endif
+
+template<typename PlayerDataStructure>
+SOCKET connectToServer(std::string server_address, int port, void *connect_data, size_t connect_data_size, PlayerList<PlayerDataStructure> &player_list_ref, int &my_id, CompressionContext *compression = nullptr, WireVersion *wire_version = nullptr, 
+                       const ConnectionLimits &my_limits = ConnectionLimits(), ConnectionLimits *server_limits = nullptr, uint64_t *unreliable_token = nullptr, bool *server_push = nullptr)
+{
+    
+    SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
+    if(sock == INVALID_SOCKET)
+    {
+        throw ServerConnectionException(strerror(errno));
+    }
+
+    #ifdef WIN32
+    DWORD timeout = timeout_limit * 1000;
+    setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+    
+    #elif defined(__linux__)
+        int yes = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(int));
+    #endif
+
+
+    SOCKADDR_IN sin = { 0, 0, 0, 0 };
+
+
+    sin.sin_addr.s_addr = inet_addr(server_address.c_str());
+    sin.sin_port = htons(port);
+    sin.sin_family = AF_INET;
+
+    if(connect(sock,(SOCKADDR *) &sin, sizeof(SOCKADDR)) == SOCKET_ERROR)
+    {
+        throw ServerConnectionException(strerror(errno));
+    }   
+
+    return connectToServer(sock, connect_data, connect_data_size, player_list_ref, my_id, compression, wire_version, my_limits, server_limits, unreliable_token, nullptr, server_push);
+}
+
 void closeConnection(SOCKET sock)
 {
     closesocket(sock);
@@ -128,119 +330,1360 @@ void closeConnection(SOCKET sock)
    
 // }
 
+/**
+ * @brief Frame received by the network thread of a ServerLink
+ * 
+ */
+struct ReceivedFrame
+{
+    FrameView view;
+    Frame reassembled;      // messages completed by the FRAGMENT ones of the frame
+
+    // newest state rebuilt with the SNAPSHOT messages of the frame, empty and 0 if it had none
+    std::vector<uint8_t> snapshot;
+    uint32_t snapshot_id = 0;
+};
+
 template <typename PlayerDataStructure>
 class ServerLink
 {
 private:
     SOCKET link_socket;
+    FrameReceiver receiver_;
     PlayerList<PlayerDataStructure> all_players;
     Frame to_send;
     int my_id_;
+    CompressionContext compression_;
+    WireVersion wire_version_;
+    SnapshotDecoder snapshots_;
 
-public:
-    std::function<void(ServerLink &server_link)> onDisconnectLambda;
-    std::function<void(ServerLink &server_link)> onKickLambda;
+    ConnectionLimits limits_;           // accepted from the server
+    ConnectionLimits server_limits_;    // accepted by the server
+    FragmentSender fragments_;
+    FragmentReassembler reassembler_;
+    Frame reassembled_;                 // messages completed by the last frame received
 
+    // unreliable side channel, a UDP socket connected to the port of the server
+    bool unreliable_requested_;
+    uint64_t unreliable_token_;         // 0 if the server did not accept it
+    SOCKET unreliable_socket_;
+    uint32_t unreliable_sequence_;
+    UnreliableReceiver unreliable_receiver_;
+    std::vector<uint8_t> unreliable_buffer_;
+    ReliableEndpoint reliable_;
+    LossSimulator loss_;
+    FrameView pending_unreliable_;      // newest frame read while looking for reliable messages
+    bool has_pending_unreliable_;
 
-public:
-    ServerLink(/* args */)
-    {
+    #if defined(__linux__)
+    SharedMemoryLink shared_link_;      // frames go through it instead of link_socket if open
+    #endif
 
-    }
+    // coroutine API, link_socket is non-blocking
+    LinkEventLoop *loop_;               // nullptr if not connected with connectLinkAsync
+    std::vector<uint8_t> async_output_; // frame being written, capacity reused
 
-    PlayerList<PlayerDataStructure> &getPlayerListRef()
-    {
-        return all_players;
-    }
+    // server push: the server sends its frames on its own schedule, to_send is cleared once sent
+    bool push_requested_;
+    bool server_push_;
+
+    // network thread mode, the game thread only uses the queues
+    std::thread network_thread_;
+    std::atomic<bool> network_running_;
+    std::atomic<bool> network_closed_;  // the server ended the connection, or an error
+    SpscQueue<ReceivedFrame> inbound_;  // network thread to game thread
+    SpscQueue<Message> outbound_;       // game thread to network thread
+    #if defined(__linux__)
+    int wake_fd_;                       // eventfd waking the network thread waiting for a pushed frame, -1 if none
+    std::atomic<bool> network_waiting_; // the network thread waits on wake_fd_, addDataToSend wakes it
+    #endif
+    std::mutex players_mutex_;          // all_players, changed by the network thread
 
     /**
-     * @brief Get an iterator to player selected by id
+     * @brief Make the network thread stop, waking it if it waits for the server
      * 
-     * @param id 
-     * @return Player Iterator
      */
-    auto getPlayerItById(int id)
+    void interruptNetworkThread()
     {
-        return all_players.getPlayerItById(id);
-    }
+        if(!network_thread_.joinable())
+        {
+            return;
+        }
 
-    int getMyId()
-    {
-        return my_id_;
+        // the rings are only closed: the network thread may still be reading them, they are unmapped once it is joined
+        network_running_ = false;
+        if(!network_closed_)
+        {
+            shutdownSharedMemory();
+            shutdown(link_socket, SHUT_RDWR);
+        }
     }
 
-    void connectLink(std::string server_address, int port, void *connect_data, size_t connect_data_size)
+    /**
+     * @brief Loop of the network thread: sends the messages of outbound_ in the lock-step frame,
+     * waits for the answer and pushes it in inbound_, its connection messages applied
+     * 
+     */
+    void networkRoutine()
     {
+        auto last_sent = std::chrono::steady_clock::now();
+        uint32_t last_snapshot_id = snapshots_.getLatestId();
+        try
+        {
+            while(network_running_)
+            {
+                // no more messages than the server accepts in a frame, the others wait for the next one
+                Message message;
+                std::size_t room = std::size_t(server_limits_.max_frame_messages) - std::min(fragments_.getDeferredCount(), std::size_t(server_limits_.max_frame_messages));
+                while(std::size_t(to_send.getLength()) < room && outbound_.tryPop(message))
+                {
+                    to_send.addMessage(std::move(message));
+                }
 
-        link_socket = connectToServer(server_address, port, connect_data, connect_data_size, all_players, my_id_);
-    }
+                FrameView buffered;
+                bool parsed = false;
 
-    Frame recvData()
-    {
-        to_send.clear();
+                if(!server_push_)
+                {
+                    sendData();
+                }
+                else
+                {
+                    // only frames with messages (or fragments, or the keepalive), and the frames of the server come when they come
+                    auto now = std::chrono::steady_clock::now();
+                    auto keepalive = last_sent + std::chrono::milliseconds(LINK_PUSH_KEEPALIVE_MILLI);
+                    if(to_send.getLength() > 0 || fragments_.getPendingCount() > 0 || now >= keepalive)
+                    {
+                        sendData();
+                        last_sent = now;
+                        keepalive = now + std::chrono::milliseconds(LINK_PUSH_KEEPALIVE_MILLI);
+                    }
 
+                    // a frame read with the previous one is not signaled by the socket
+                    parsed = receiver_.tryParseFrameView(buffered);
+                    if(!parsed && !waitPushedFrame(keepalive))
+                    {
+                        continue;
+                    }
+                }
 
-        Frame received = recvFrame(link_socket);
+                ReceivedFrame received;
+                received.view = parsed ? analyseFrame(std::move(buffered)) : recvDataView();
+                received.reassembled = std::move(reassembled_);
+                reassembled_.clear();
 
-        for(Message &message : received.getMessages())
-        {
-            int id;
-            switch (message.getHat())
-            {
-            case OCONNECT:
-                id = *((int *)(message.getRawData()));
-                if(id != my_id_)
+                // the decoder is only used by this thread, the game thread gets a copy of the new state
+                if(snapshots_.getLatestId() != last_snapshot_id)
                 {
-                    std::cout << "New player !\n";
-                    all_players.addPlayer(id);
+                    last_snapshot_id = snapshots_.getLatestId();
+                    std::span<const uint8_t> state = snapshots_.getLatestState();
+                    received.snapshot.assign(state.begin(), state.end());
+                    received.snapshot_id = last_snapshot_id;
                 }
-                break;
-            
-            case ODISCONNECT:
-                id = *((int *)(message.getRawData()));
-                std::cout << "Player disconnected\n";
-                all_players.removePlayer(id);
-                break;
 
-            case KICK:
-                onKickLambda(std::ref(*this));
-                closesocket(link_socket);
-                throw RemoteConnectionException("kicked");
-                break;
-
-            case DISCONNECT:
-                onDisconnectLambda(std::ref(*this));
-                closesocket(link_socket);
-                throw RemoteConnectionException("disconnection");
-                break;
-            default:
-                break;
+                while(!inbound_.tryPush(std::move(received)) && network_running_)
+                {
+                    std::this_thread::yield();
+                }
             }
         }
+        catch(const std::exception& e)
+        {
+            #if DEBUG
+            std::cout << "network thread stopped: " << e.what() << "\n";
+            #endif
+        }
 
-    return received;
+        network_closed_ = true;
     }
 
-
-    void addDataToSend(void *data, size_t data_size)
+    /**
+     * @brief With server push, wait in the network thread until the socket is readable, messages are given
+     * to addDataToSend or the keepalive is due, without waiting while fragments are left to send
+     * 
+     * @param keepalive
+     * @return true if the socket is readable
+     */
+    bool waitPushedFrame(std::chrono::steady_clock::time_point keepalive)
     {
-        to_send.addMessage(Message(DATA, data, data_size));
+        struct pollfd fds[2] = {{link_socket, POLLIN, 0}, {INVALID_SOCKET, POLLIN, 0}};
+        int timeout = LINK_PUSH_POLL_MILLI;
+        int count = 1;
+
+        #if defined(__linux__)
+        if(wake_fd_ >= 0)
+        {
+            fds[1].fd = wake_fd_;
+            count = 2;
+
+            // seen by addDataToSend before it checks network_waiting_, or it sees the flag and wakes the poll
+            network_waiting_ = true;
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            auto remaining = std::chrono::ceil<std::chrono::milliseconds>(keepalive - std::chrono::steady_clock::now());
+            bool more = outbound_.getSize() > 0 || fragments_.getPendingCount() > 0 || !network_running_;
+            timeout = more ? 0 : int(std::max<std::chrono::milliseconds::rep>(remaining.count(), 0));
+        }
+        #endif
+
+        int ready = poll(fds, count, timeout);
+
+        #if defined(__linux__)
+        if(wake_fd_ >= 0)
+        {
+            network_waiting_ = false;
+            if(fds[1].revents != 0)
+            {
+                uint64_t value;
+                ssize_t ignored = read(wake_fd_, &value, sizeof(value));
+                (void)ignored;
+            }
+        }
+        #endif
+
+        return ready > 0 && fds[0].revents != 0;
     }
 
-    void sendData()
+    /**
+     * @brief Wake the network thread waiting for a pushed frame, see waitPushedFrame
+     * 
+     */
+    void wakeNetworkThread()
     {
-        to_send.sendFrame(link_socket);
+        #if defined(__linux__)
+        if(wake_fd_ >= 0)
+        {
+            uint64_t one = 1;
+            ssize_t ignored = write(wake_fd_, &one, sizeof(one));
+            (void)ignored;
+        }
+        #endif
     }
 
-    void sendData(void *data, size_t data_size)
+    /**
+     * @brief Send to_send through the shared memory rings if open, else the socket
+     * 
+     */
+    void sendToSend()
     {
-        to_send.addMessage(Message(DATA, data, data_size));
-        to_send.sendFrame(link_socket);
+        #if defined(__linux__)
+        if(shared_link_.isOpen())
+        {
+            shared_link_.sendFrame(to_send, &compression_, wire_version_);
+        }
+        else
+        #endif
+        {
+            to_send.sendFrame(link_socket, &compression_, wire_version_);
+        }
+
+        // in lock-step the frame is cleared by the next receive
+        if(server_push_)
+        {
+            to_send.clear();
+        }
     }
 
-    void closeConnection()
+    /**
+     * @brief Wait for a frame from the shared memory rings if open, else the socket
+     * 
+     */
+    FrameView recvFromServer()
     {
-        closesocket(link_socket);
+        #if defined(__linux__)
+        if(shared_link_.isOpen())
+        {
+            FrameView received;
+            while(!shared_link_.recvFrameView(receiver_, received))
+            {
+                // no timeout, like the socket
+            }
+            return received;
+        }
+        #endif
+
+        return receiver_.recvFrameView();
+    }
+
+    /**
+     * @brief Write async_output_ on the non-blocking socket, waiting in the loop while its buffer is full
+     * 
+     */
+    Task<void> writeAsync()
+    {
+        std::size_t sent = 0;
+        while(sent < async_output_.size())
+        {
+            ssize_t size = ::send(link_socket, (const char*)async_output_.data() + sent, async_output_.size() - sent, MSG_NOSIGNAL);
+            if(size > 0)
+            {
+                sent += std::size_t(size);
+                continue;
+            }
+
+            if(size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if(size < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            {
+                co_await loop_->writable(link_socket);
+                continue;
+            }
+
+            throw RemoteConnectionException("Error during frame sending");
+        }
+    }
+
+    /**
+     * @brief Wait in the loop until the receiver holds a complete frame
+     * 
+     */
+    Task<void> fillUntilFrameAsync(FrameView &output)
+    {
+        while(!receiver_.tryParseFrameView(output))
+        {
+            if(receiver_.fill() == 0)
+            {
+                co_await loop_->readable(link_socket);
+            }
+        }
+    }
+
+    void checkAsync() const
+    {
+        if(loop_ == nullptr)
+        {
+            throw ServerConnectionException("not connected with connectLinkAsync");
+        }
+    }
+
+    /**
+     * @brief Close the shared memory rings without unmapping them, waking a thread waiting on them <ThreadSafe>
+     * 
+     */
+    void shutdownSharedMemory()
+    {
+        #if defined(__linux__)
+        shared_link_.shutdown();
+        #endif
+    }
+
+    /**
+     * @brief Close the shared memory rings if open and unmap them, the server sees it at once.
+     * The network thread must be stopped
+     * 
+     */
+    void closeSharedMemory()
+    {
+        #if defined(__linux__)
+        shared_link_.close();
+        #endif
+    }
+
+    /**
+     * @brief Close the socket, the shared memory rings and the unreliable channel
+     * 
+     */
+    void closeLink()
+    {
+        closeSharedMemory();
+        closesocket(link_socket);
+        closeUnreliable();
+    }
+
+    /**
+     * @brief Open the UDP socket once the server gave the token, and send it an empty datagram so that 
+     * it knows where to send its datagrams
+     * 
+     */
+    void openUnreliable(const std::string &server_address, int port)
+    {
+        SOCKET sock = socket(AF_INET, SOCK_DGRAM, 0);
+        if(sock == INVALID_SOCKET)
+        {
+            throw ServerConnectionException(strerror(errno));
+        }
+
+        SOCKADDR_IN sin = { 0, 0, 0, 0 };
+        sin.sin_addr.s_addr = inet_addr(server_address.c_str());
+        sin.sin_port = htons(port);
+        sin.sin_family = AF_INET;
+
+        // datagrams only accepted from the server
+        if(connect(sock, (SOCKADDR *) &sin, sizeof(SOCKADDR)) == SOCKET_ERROR)
+        {
+            closesocket(sock);
+            throw ServerConnectionException(strerror(errno));
+        }
+
+        #ifdef WIN32
+        u_long non_blocking = 1;
+        ioctlsocket(sock, FIONBIO, &non_blocking);
+
+        #elif defined(__linux__)
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+        #endif
+
+        unreliable_socket_ = sock;
+        unreliable_sequence_ = 0;
+        unreliable_receiver_ = UnreliableReceiver(wire_version_, datagramLimits(limits_));
+        reliable_ = ReliableEndpoint(server_limits_);
+        has_pending_unreliable_ = false;
+
+        Frame hello;
+        sendUnreliable(hello);
+    }
+
+    /**
+     * @brief Send a frame in a datagram
+     * 
+     * @return true if sent (or dropped by the loss simulation), false if the socket buffer is full
+     */
+    bool sendDatagram(Frame &frame)
+    {
+        UnreliableHeader header;
+        header.token = unreliable_token_;
+        header.sequence = ++unreliable_sequence_;
+        encodeUnreliableDatagram(header, frame, wire_version_, unreliable_buffer_);
+
+        if(loss_.drop())
+        {
+            return true;
+        }
+
+        return send(unreliable_socket_, (const char*)unreliable_buffer_.data(), int(unreliable_buffer_.size()), MSG_NOSIGNAL) > 0;
+    }
+
+    /**
+     * @brief Read a datagram without waiting, its reliable messages are given to the reliable endpoint
+     * 
+     * @param output frame carried
+     * @param newest set to true if newer than all the datagrams read before
+     * @return true if a datagram was read, false if none is waiting
+     */
+    bool readDatagram(FrameView &output, bool &newest)
+    {
+        unreliable_buffer_.resize(UNRELIABLE_MAX_DATAGRAM_SIZE);
+        for(;;)
+        {
+            int size = int(recv(unreliable_socket_, (char*)unreliable_buffer_.data(), int(unreliable_buffer_.size()), 0));
+            if(size <= 0)
+            {
+                return false;
+            }
+
+            std::span<const uint8_t> datagram(unreliable_buffer_.data(), std::size_t(size));
+            UnreliableHeader header;
+            if(!decodeUnreliableHeader(datagram, header) || header.token != unreliable_token_ || !unreliable_receiver_.receive(header, datagram, output, newest))
+            {
+                continue;
+            }
+
+            ReliableEndpoint::Clock::time_point now = ReliableEndpoint::Clock::now();
+            for(const MessageView &message : output)
+            {
+                reliable_.receive(message, now);
+            }
+            return true;
+        }
+    }
+
+    /**
+     * @brief Send what the reliable channels must send: ack, retransmissions, messages the window allows
+     * 
+     */
+    void sendReliableFrames()
+    {
+        Frame frame;
+        ReliableEndpoint::Clock::time_point now = ReliableEndpoint::Clock::now();
+        while(reliable_.fillFrame(frame, now, wire_version_))
+        {
+            sendDatagram(frame);
+            frame.clear();
+        }
+    }
+
+    /**
+     * @brief Close the UDP socket if open
+     * 
+     */
+    void closeUnreliable()
+    {
+        if(unreliable_socket_ != INVALID_SOCKET)
+        {
+            closesocket(unreliable_socket_);
+            unreliable_socket_ = INVALID_SOCKET;
+        }
+    }
+
+public:
+    std::function<void(ServerLink &server_link)> onDisconnectLambda;
+    std::function<void(ServerLink &server_link)> onKickLambda;
+
+
+public:
+    ServerLink(/* args */): wire_version_(WIRE_V1), unreliable_requested_(false), unreliable_token_(0), unreliable_socket_(INVALID_SOCKET), unreliable_sequence_(0),
+                            has_pending_unreliable_(false), loop_(nullptr), push_requested_(false), server_push_(false), network_running_(false), network_closed_(false),
+                            inbound_(LINK_INBOUND_QUEUE_SIZE), outbound_(LINK_OUTBOUND_QUEUE_SIZE)
+    {
+        #if defined(__linux__)
+        wake_fd_ = -1;
+        network_waiting_ = false;
+        #endif
+    }
+
+    ~ServerLink()
+    {
+        interruptNetworkThread();
+        stopNetworkThread();
+    }
+
+    PlayerList<PlayerDataStructure> &getPlayerListRef()
+    {
+        return all_players;
+    }
+
+    /**
+     * @brief Get the access to the player list, locked against the network thread <ThreadSafe>
+     * 
+     * @param access_lambda lambda in where you can access the list
+     */
+    void getPlayerListAccess(std::function<void(PlayerList<PlayerDataStructure>&)> access_lambda)
+    {
+        std::lock_guard<std::mutex> lock(players_mutex_);
+        access_lambda(all_players);
+    }
+
+    /**
+     * @brief Get an iterator to player selected by id
+     * 
+     * @param id 
+     * @return Player Iterator
+     */
+    auto getPlayerItById(int id)
+    {
+        return all_players.getPlayerItById(id);
+    }
+
+    int getMyId()
+    {
+        return my_id_;
+    }
+
+    /**
+     * @brief Ask the server for compression at the next connectLink, 
+     * check isCompressionEnabled after to know if the server accepted
+     * 
+     * @param dictionary dictionary the server should also have, nullptr for none
+     * @param threshold frames smaller than this number of bytes are sent raw
+     */
+    void enableCompression(std::shared_ptr<const CompressionDictionary> dictionary = nullptr, std::size_t threshold = 128)
+    {
+        compression_.enable(std::move(dictionary), threshold);
+    }
+
+    bool isCompressionEnabled() const
+    {
+        return compression_.isEnabled();
+    }
+
+    /**
+     * @brief Get the compression counters of the link
+     * 
+     * @return const CompressionStats& 
+     */
+    const CompressionStats &getCompressionStats() const
+    {
+        return compression_.getStats();
+    }
+
+    /**
+     * @brief Set the sizes accepted from the server, advertised at the next connectLink
+     * 
+     * @param limits 
+     */
+    void setLimits(const ConnectionLimits &limits)
+    {
+        limits_ = limits;
+        receiver_.setLimits(limits);
+        reassembler_.setMaxSize(limits.max_reassembly_size);
+    }
+
+    const ConnectionLimits &getLimits() const
+    {
+        return limits_;
+    }
+
+    /**
+     * @brief Get the sizes accepted by the server, bigger messages are fragmented
+     * 
+     * @return const ConnectionLimits& 
+     */
+    const ConnectionLimits &getServerLimits() const
+    {
+        return server_limits_;
+    }
+
+    /**
+     * @brief Get the number of bytes of fragmented messages not sent yet
+     * 
+     * @return std::size_t 
+     */
+    std::size_t getPendingFragmentsSize() const
+    {
+        return fragments_.getPendingSize();
+    }
+
+    /**
+     * @brief Get the messages reassembled from fragments by the last recvDataView, they are not in the view
+     * 
+     * @return const Frame& 
+     */
+    const Frame &getReassembledFrame() const
+    {
+        return reassembled_;
+    }
+
+    /**
+     * @brief Get the wire version negotiated with the server at connectLink
+     * 
+     * @return WireVersion 
+     */
+    WireVersion getWireVersion() const
+    {
+        return wire_version_;
+    }
+
+    /**
+     * @brief Get the newest state received with snapshots
+     * 
+     * @return std::span<const uint8_t> empty if no snapshot received, valid until the next recvData.
+     * Not while the network thread runs, its frames carry the states (see ReceivedFrame)
+     */
+    std::span<const uint8_t> getLatestSnapshot() const
+    {
+        return snapshots_.getLatestState();
+    }
+
+    /**
+     * @brief Get the id of the newest snapshot received, 0 if none. Not while the network thread runs
+     * 
+     */
+    uint32_t getLatestSnapshotId() const
+    {
+        return snapshots_.getLatestId();
+    }
+
+    /**
+     * @brief Ask the server for the unreliable channel at the next connectLink,
+     * check isUnreliableEnabled after to know if the server accepted
+     * 
+     */
+    void enableUnreliable()
+    {
+        unreliable_requested_ = true;
+    }
+
+    bool isUnreliableEnabled() const
+    {
+        return unreliable_socket_ != INVALID_SOCKET;
+    }
+
+    /**
+     * @brief Get the number of datagrams dropped because older than the newest one received, or malformed
+     * 
+     * @return std::size_t 
+     */
+    std::size_t getUnreliableDroppedCount() const
+    {
+        return unreliable_receiver_.getDroppedCount();
+    }
+
+    /**
+     * @brief Get the counters of the reliable channels
+     * 
+     * @return ReliableStats 
+     */
+    ReliableStats getReliableStats() const
+    {
+        return reliable_.getStats();
+    }
+
+    /**
+     * @brief Drop a share of the datagrams sent, to test the reliable channels
+     * 
+     * @param loss_rate between 0 (none, the default) and 1
+     */
+    void setUnreliableLossRate(double loss_rate)
+    {
+        loss_.setLossRate(loss_rate);
+    }
+
+    void connectLink(std::string server_address, int port, void *connect_data, size_t connect_data_size)
+    {
+        closeUnreliable();
+        closeSharedMemory();
+        loop_ = nullptr;
+        server_push_ = false;
+
+        link_socket = connectToServer(server_address, port, connect_data, connect_data_size, all_players, my_id_, &compression_, &wire_version_, limits_, &server_limits_,
+                                      unreliable_requested_ ? &unreliable_token_ : nullptr, push_requested_ ? &server_push_ : nullptr);
+        receiver_.setSocket(link_socket);
+        receiver_.setCompressionContext(&compression_);
+        receiver_.setWireVersion(wire_version_);
+        fragments_.clear();
+        reassembler_.clear();
+
+        if(unreliable_requested_ && unreliable_token_ != 0)
+        {
+            openUnreliable(server_address, port);
+        }
+    }
+
+    #if defined(__linux__)
+    /**
+     * @brief Connect to a server of this process through the link of Server::connectLocal, e.g. for a bot: 
+     * the frames go through its in-process rings. The unreliable channel is not asked for (Linux only)
+     * 
+     * @param local_link client end, kept by the link
+     * @param connect_data 
+     * @param connect_data_size 
+     */
+    void connectLink(SharedMemoryLink local_link, void *connect_data, size_t connect_data_size)
+    {
+        closeUnreliable();
+        closeSharedMemory();
+        loop_ = nullptr;
+        server_push_ = false;
+
+        shared_link_ = std::move(local_link);
+        link_socket = INVALID_SOCKET;
+        connectToServer(shared_link_, connect_data, connect_data_size, all_players, my_id_, &compression_, &wire_version_, limits_, &server_limits_,
+                        push_requested_ ? &server_push_ : nullptr);
+
+        receiver_.setSocket(INVALID_SOCKET);
+        receiver_.setCompressionContext(&compression_);
+        receiver_.setWireVersion(wire_version_);
+        fragments_.clear();
+        reassembler_.clear();
+    }
+    #endif
+
+    /**
+     * @brief Connect to a server of the same host through its Unix socket (Server::local_socket_path), 
+     * the frames then go through shared memory rings if the server accepts them, else through the socket.
+     * The unreliable channel is not asked for (Linux only)
+     * 
+     * @param socket_path 
+     * @param connect_data 
+     * @param connect_data_size 
+     */
+    void connectLinkShared(const std::string &socket_path, void *connect_data, size_t connect_data_size)
+    {
+        closeUnreliable();
+        closeSharedMemory();
+        loop_ = nullptr;
+        server_push_ = false;
+
+        #ifdef WIN32
+        throw ServerConnectionException("shared memory not supported");
+
+        #elif defined(__linux__)
+        SOCKET sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(sock == INVALID_SOCKET)
+        {
+            throw ServerConnectionException(strerror(errno));
+        }
+
+        struct sockaddr_un sun = {};
+        sun.sun_family = AF_UNIX;
+        strncpy(sun.sun_path, socket_path.c_str(), sizeof(sun.sun_path) - 1);
+
+        if(connect(sock, (SOCKADDR *) &sun, sizeof(sun)) == SOCKET_ERROR)
+        {
+            closesocket(sock);
+            throw ServerConnectionException(strerror(errno));
+        }
+
+        bool shared_memory = false;
+        link_socket = connectToServer(sock, connect_data, connect_data_size, all_players, my_id_, &compression_, &wire_version_, limits_, &server_limits_, nullptr, &shared_memory,
+                                      push_requested_ ? &server_push_ : nullptr);
+
+        if(shared_memory)
+        {
+            shared_link_.create(link_socket);
+        }
+
+        // with the rings the receiver only parses what they carry
+        receiver_.setSocket(shared_memory ? INVALID_SOCKET : link_socket);
+        receiver_.setCompressionContext(&compression_);
+        receiver_.setWireVersion(wire_version_);
+        fragments_.clear();
+        reassembler_.clear();
+        #endif
+    }
+
+    /**
+     * @brief Coroutine version of connectLink: the socket is non-blocking and every wait (connection, handshake)
+     * lets the other coroutines of the loop run. The link then uses the ...Async methods only,
+     * one send and one receive at a time. connect_data must live until the task is done
+     * 
+     * @param loop resumes the coroutines of the link, must outlive it
+     * @param server_address 
+     * @param port 
+     * @param connect_data 
+     * @param connect_data_size 
+     * @return Task<void> to co_await
+     */
+    Task<void> connectLinkAsync(LinkEventLoop &loop, std::string server_address, int port, void *connect_data, size_t connect_data_size)
+    {
+        closeUnreliable();
+        closeSharedMemory();
+        loop_ = nullptr;
+        server_push_ = false;
+
+        SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
+        if(sock == INVALID_SOCKET)
+        {
+            throw ServerConnectionException(strerror(errno));
+        }
+
+        #ifdef WIN32
+        u_long non_blocking = 1;
+        ioctlsocket(sock, FIONBIO, &non_blocking);
+
+        #elif defined(__linux__)
+        int yes = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(int));
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+        #endif
+
+        SOCKADDR_IN sin = { 0, 0, 0, 0 };
+        sin.sin_addr.s_addr = inet_addr(server_address.c_str());
+        sin.sin_port = htons(port);
+        sin.sin_family = AF_INET;
+
+        if(connect(sock, (SOCKADDR *) &sin, sizeof(SOCKADDR)) == SOCKET_ERROR && errno != EINPROGRESS && errno != EWOULDBLOCK)
+        {
+            closesocket(sock);
+            throw ServerConnectionException(strerror(errno));
+        }
+
+        link_socket = sock;
+        loop_ = &loop;
+        co_await loop.writable(sock);
+
+        int error = 0;
+        socklen_t error_size = sizeof(error);
+        getsockopt(sock, SOL_SOCKET, SO_ERROR, (char*)&error, &error_size);
+        if(error != 0)
+        {
+            closesocket(sock);
+            loop_ = nullptr;
+            throw ServerConnectionException(strerror(error));
+        }
+
+        uint64_t *unreliable_token = unreliable_requested_ ? &unreliable_token_ : nullptr;
+        bool *server_push = push_requested_ ? &server_push_ : nullptr;
+        Frame hello = makeConnectFrame(connect_data, connect_data_size, &compression_, &wire_version_, limits_, &server_limits_, unreliable_token, nullptr, server_push);
+        async_output_.clear();
+        hello.serializeFrame(async_output_);
+        co_await writeAsync();
+
+        // the answer is read as v1 without compression, as connectToServer does
+        receiver_.setSocket(link_socket);
+        receiver_.setCompressionContext(nullptr);
+        receiver_.setWireVersion(WIRE_V1);
+
+        FrameView answer_view;
+        co_await fillUntilFrameAsync(answer_view);
+        Frame server_answer = answer_view.toFrame();
+        readConnectAnswer(server_answer, all_players, my_id_, &compression_, &wire_version_, &server_limits_, unreliable_token, nullptr, server_push);
+
+        receiver_.setCompressionContext(&compression_);
+        receiver_.setWireVersion(wire_version_);
+        fragments_.clear();
+        reassembler_.clear();
+
+        if(unreliable_requested_ && unreliable_token_ != 0)
+        {
+            openUnreliable(server_address, port);
+        }
+    }
+
+    /**
+     * @brief Tell if the link uses the coroutine API, see connectLinkAsync
+     * 
+     */
+    bool isAsync() const
+    {
+        return loop_ != nullptr;
+    }
+
+    /**
+     * @brief Ask the server, at the next connection, to send its frames on its own schedule: each tick, or as soon as
+     * it has messages for the link, instead of answering each frame sent. recvDataView then waits for the next frame
+     * without sending one, and sendData is only needed for the link's own messages (at least one frame within
+     * the server's timeout). Check isServerPushEnabled after to know if the server accepted
+     * 
+     */
+    void enableServerPush()
+    {
+        push_requested_ = true;
+    }
+
+    bool isServerPushEnabled() const
+    {
+        return server_push_;
+    }
+
+    /**
+     * @brief Tell if the frames go through shared memory rings, see connectLinkShared
+     * 
+     */
+    bool isSharedMemoryEnabled() const
+    {
+        #if defined(__linux__)
+        return shared_link_.isOpen();
+        #else
+        return false;
+        #endif
+    }
+
+    /**
+     * @brief Apply a connection message (OCONNECT, ODISCONNECT, KICK...) received from the server
+     * 
+     * @param message 
+     */
+    void analyseMessage(const MessageView &message)
+    {
+        int id;
+        switch (message.getHat())
+        {
+        case OCONNECT:
+            id = message.as<int32_t>();
+            if(id != my_id_)
+            {
+                std::cout << "New player !\n";
+                std::lock_guard<std::mutex> lock(players_mutex_);
+                all_players.addPlayer(id);
+            }
+            break;
+        
+        case ODISCONNECT:
+            id = message.as<int32_t>();
+            std::cout << "Player disconnected\n";
+            {
+                std::lock_guard<std::mutex> lock(players_mutex_);
+                all_players.removePlayer(id);
+            }
+            break;
+
+        case SNAPSHOT:
+            {
+                // acknowledged in the next frame sent
+                uint32_t snapshot_id = snapshots_.decode(message);
+                if(snapshot_id != 0)
+                {
+                    to_send.add(SNAPACK, snapshot_id);
+                }
+            }
+            break;
+
+        case FRAGMENT:
+            if(reassembler_.push(message))
+            {
+                MessageView completed = reassembler_.getCompleted();
+                reassembled_.addMessage(completed.toMessage());
+                analyseMessage(completed);
+            }
+            break;
+
+        case KICK:
+            onKickLambda(std::ref(*this));
+            closeLink();
+            throw RemoteConnectionException("kicked");
+            break;
+
+        case DISCONNECT:
+            onDisconnectLambda(std::ref(*this));
+            closeLink();
+            throw RemoteConnectionException("disconnection");
+            break;
+        default:
+            break;
+        }
+    }
+
+    /**
+     * @brief Wait a frame from the server and apply its connection messages (OCONNECT, ODISCONNECT, KICK...) 
+     * without copying it, the view stays valid as long as it is kept.
+     * Messages completed by FRAGMENT ones are in getReassembledFrame
+     * 
+     * @return FrameView 
+     */
+    FrameView recvDataView()
+    {
+        // in lock-step the frame sent before is done with, with server push it may hold messages not sent yet
+        if(!server_push_)
+        {
+            to_send.clear();
+        }
+        reassembled_.clear();
+
+        return analyseFrame(recvFromServer());
+    }
+
+    /**
+     * @brief Apply the connection messages of a frame received
+     * 
+     * @param received
+     * @return FrameView the frame
+     */
+    FrameView analyseFrame(FrameView received)
+    {
+        for(const MessageView &message : received)
+        {
+            analyseMessage(message);
+        }
+
+        return received;
+    }
+
+    /**
+     * @brief Same as recvDataView but returns an owning copy of the frame, reassembled messages appended
+     * 
+     * @return Frame 
+     */
+    Frame recvData()
+    {
+        Frame output = recvDataView().toFrame();
+
+        for(const Message &message : reassembled_.getMessagesConstRef())
+        {
+            output.addMessage(message);
+        }
+
+        return output;
+    }
+
+
+    /**
+     * @brief Add a DATA message to the next frame sent, with the network thread it is queued for it
+     * (waiting while LINK_OUTBOUND_QUEUE_SIZE messages are queued)
+     * 
+     */
+    void addDataToSend(void *data, size_t data_size)
+    {
+        if(network_running_)
+        {
+            Message message(DATA, data, data_size);
+            while(!outbound_.tryPush(std::move(message)) && !network_closed_)
+            {
+                std::this_thread::yield();
+            }
+
+            #if defined(__linux__)
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if(network_waiting_)
+            {
+                wakeNetworkThread();
+            }
+            #endif
+            return;
+        }
+
+        to_send.addMessage(Message(DATA, data, data_size));
+    }
+
+    /**
+     * @brief Start a thread doing the lock-step exchange with the server: the messages of addDataToSend are sent
+     * by it, the frames received are taken with tryRecv and the connection messages applied (the
+     * lambdas of KICK and DISCONNECT run in it). With server push it only sends the frames holding messages
+     * (or a keepalive). The game thread then never waits for the network, it only uses addDataToSend,
+     * tryRecv and getPlayerListAccess until stopNetworkThread
+     * 
+     */
+    void startNetworkThread()
+    {
+        if(network_running_)
+        {
+            return;
+        }
+
+        #if defined(__linux__)
+        if(server_push_ && wake_fd_ < 0)
+        {
+            wake_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        }
+        #endif
+
+        network_closed_ = false;
+        network_running_ = true;
+        network_thread_ = std::thread(&ServerLink::networkRoutine, this);
+    }
+
+    /**
+     * @brief Stop the network thread after its current exchange with the server, the frames
+     * received stay in the queue
+     * 
+     */
+    void stopNetworkThread()
+    {
+        network_running_ = false;
+        if(network_thread_.joinable())
+        {
+            wakeNetworkThread();
+            network_thread_.join();
+        }
+
+        #if defined(__linux__)
+        if(wake_fd_ >= 0)
+        {
+            close(wake_fd_);
+            wake_fd_ = -1;
+        }
+        #endif
+    }
+
+    /**
+     * @brief Tell if the network thread stopped because the connection ended, see startNetworkThread
+     * 
+     */
+    bool isNetworkClosed() const
+    {
+        return network_closed_;
+    }
+
+    /**
+     * @brief Take the next frame received by the network thread without waiting
+     * 
+     * @param output view on the frame, stays valid as long as it is kept
+     * @return true if a frame was taken, false if none is waiting
+     */
+    bool tryRecv(FrameView &output)
+    {
+        ReceivedFrame received;
+        if(!inbound_.tryPop(received))
+        {
+            return false;
+        }
+
+        output = std::move(received.view);
+        return true;
+    }
+
+    /**
+     * @brief Same as tryRecv, with the messages completed by the FRAGMENT ones of the frame
+     * 
+     */
+    bool tryRecv(ReceivedFrame &output)
+    {
+        return inbound_.tryPop(output);
+    }
+
+    void sendData()
+    {
+        fragments_.fragmentFrame(to_send, server_limits_);
+        sendToSend();
+    }
+
+    void sendData(void *data, size_t data_size)
+    {
+        to_send.addMessage(Message(DATA, data, data_size));
+        fragments_.fragmentFrame(to_send, server_limits_);
+        sendToSend();
+    }
+
+    /**
+     * @brief Coroutine version of sendData: waits in the loop instead of blocking while the socket buffer is full
+     * 
+     * @return Task<void> to co_await
+     */
+    Task<void> sendDataAsync()
+    {
+        checkAsync();
+        fragments_.fragmentFrame(to_send, server_limits_);
+        async_output_.clear();
+        to_send.serializeFrame(async_output_, &compression_, wire_version_);
+        if(server_push_)
+        {
+            to_send.clear();
+        }
+        co_await writeAsync();
+    }
+
+    /**
+     * @brief Coroutine version of sendData with one more DATA message, the data is copied before any wait
+     * 
+     * @return Task<void> to co_await
+     */
+    Task<void> sendDataAsync(void *data, size_t data_size)
+    {
+        to_send.addMessage(Message(DATA, data, data_size));
+        co_await sendDataAsync();
+    }
+
+    /**
+     * @brief Coroutine version of recvDataView: waits in the loop for the frame of the server, 
+     * its connection messages are applied the same way (KICK and DISCONNECT throw from co_await)
+     * 
+     * @return Task<FrameView> to co_await
+     */
+    Task<FrameView> recvDataViewAsync()
+    {
+        checkAsync();
+        if(!server_push_)
+        {
+            to_send.clear();
+        }
+        reassembled_.clear();
+
+        FrameView received;
+        co_await fillUntilFrameAsync(received);
+
+        for(const MessageView &message : received)
+        {
+            analyseMessage(message);
+        }
+
+        co_return received;
+    }
+
+    /**
+     * @brief Send a frame on the unreliable channel, out of the lock-step: it may be lost, and is dropped by 
+     * the server if a newer one arrived before. Control messages are ignored by the server, they stay on TCP.
+     * Throw std::length_error if it does not fit in a datagram
+     * 
+     * @param frame 
+     * @return true if sent, false if the channel is not enabled or the socket buffer is full
+     */
+    bool sendUnreliable(Frame &frame)
+    {
+        if(unreliable_socket_ == INVALID_SOCKET)
+        {
+            return false;
+        }
+
+        return sendDatagram(frame);
+    }
+
+    bool sendUnreliable(void *data, size_t data_size)
+    {
+        Frame frame;
+        frame.addMessage(Message(DATA, data, data_size));
+        return sendUnreliable(frame);
+    }
+
+    /**
+     * @brief Take the next datagram received on the unreliable channel without waiting,
+     * the ones older than a datagram already taken are skipped
+     * 
+     * @param output view on the frame carried (its DATA messages), stays valid as long as it is kept
+     * @return true if a frame was taken, false if none is waiting
+     */
+    bool recvUnreliableView(FrameView &output)
+    {
+        if(unreliable_socket_ == INVALID_SOCKET)
+        {
+            return false;
+        }
+
+        if(has_pending_unreliable_)
+        {
+            output = std::move(pending_unreliable_);
+            pending_unreliable_.clear();
+            has_pending_unreliable_ = false;
+            return true;
+        }
+
+        bool newest = false;
+        while(readDatagram(output, newest))
+        {
+            if(newest)
+            {
+                return true;
+            }
+        }
+        output.clear();
+        return false;
+    }
+
+    /**
+     * @brief Send data on the reliable channels of the UDP side channel: retransmitted until acknowledged,
+     * a lost message only holds back the next ordered ones. Throw std::length_error if bigger than RELIABLE_MAX_PAYLOAD_SIZE
+     * 
+     * @param data 
+     * @param data_size 
+     * @param channel ordered or not
+     * @return true if queued, false if the channel is not enabled
+     */
+    bool sendReliable(const void *data, size_t data_size, ReliableChannel channel = CHANNEL_RELIABLE_ORDERED)
+    {
+        if(unreliable_socket_ == INVALID_SOCKET)
+        {
+            return false;
+        }
+
+        reliable_.send(Message(DATA, data, data_size), channel);
+        sendReliableFrames();
+        return true;
+    }
+
+    /**
+     * @brief Read the waiting datagrams and send what the reliable channels must send (acks, retransmissions), 
+     * to call at each tick while the reliable channels are used. Only the newest unreliable frame read 
+     * is kept for recvUnreliableView
+     * 
+     */
+    void updateReliable()
+    {
+        if(unreliable_socket_ == INVALID_SOCKET)
+        {
+            return;
+        }
+
+        FrameView frame;
+        bool newest = false;
+        while(readDatagram(frame, newest))
+        {
+            if(newest)
+            {
+                pending_unreliable_ = frame;
+                has_pending_unreliable_ = true;
+            }
+        }
+
+        sendReliableFrames();
+    }
+
+    /**
+     * @brief Take the next message delivered by the reliable channels, calls updateReliable if none is waiting
+     * 
+     * @param output 
+     * @return true if a message was taken
+     */
+    bool recvReliable(Message &output)
+    {
+        if(reliable_.popDelivered(output))
+        {
+            return true;
+        }
+
+        updateReliable();
+        return reliable_.popDelivered(output);
+    }
+
+    void closeConnection()
+    {
+        if(network_thread_.joinable())
+        {
+            interruptNetworkThread();
+            stopNetworkThread();
+        }
+
+        closeLink();
     }
 };
 
@@ -41,7 +41,7 @@ int main()
         try
         {
 
-            ASE::Frame received = serveur.recvData();
+            ASE::FrameView received = serveur.recvDataView();
 
         }    
         catch(RemoteConnectionException& e)
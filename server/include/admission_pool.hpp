@@ -0,0 +1,165 @@
+/**
+ * @file admission_pool.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef ADMISSION_POOL_HPP
+#define ADMISSION_POOL_HPP
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+#include <algorithm>
+#include <exception>
+#include <iostream>
+
+namespace ASE
+{
+
+    /**
+     * @brief Fixed set of threads ending the handshakes of the clients whose connect frame arrived
+     * (connection control, roster, initial frame), so a slow check or a slow client only holds one of them
+     * while the welcome threads keep accepting
+     * 
+     */
+    class AdmissionPool
+    {
+        private:
+            std::vector<std::thread> threads_;
+
+            std::queue<std::function<void()>> jobs_;
+            std::mutex jobs_mutex_;
+            std::condition_variable jobs_cond_;
+            bool running_;
+
+            std::atomic<std::size_t> pending_count_;    // jobs queued or running
+
+            /**
+             * @brief Routine of a pool thread, the queued jobs are all done before it stops
+             * 
+             */
+            void run()
+            {
+                for(;;)
+                {
+                    std::function<void()> job;
+                    {
+                        std::unique_lock<std::mutex> lock(jobs_mutex_);
+                        jobs_cond_.wait(lock, [&](){ return !running_ || !jobs_.empty(); });
+
+                        if(jobs_.empty())
+                        {
+                            return;
+                        }
+
+                        job = std::move(jobs_.front());
+                        jobs_.pop();
+                    }
+
+                    // a failed handshake only ends its own job
+                    try
+                    {
+                        job();
+                    }
+                    catch(const std::exception& e)
+                    {
+                        std::cerr << "error during admission: " << e.what() << "\n";
+                    }
+                    pending_count_--;
+                }
+            }
+
+        public:
+            AdmissionPool(): running_(false), pending_count_(0)
+            {
+
+            }
+
+            ~AdmissionPool()
+            {
+                stop();
+            }
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            /**
+             * @brief Get the number of jobs queued or running <Thread Safe>
+             * 
+             * @return std::size_t
+             */
+            inline std::size_t getPendingCount() const
+            {
+                return pending_count_;
+            }
+
+            /**
+             * @brief Get the number of threads
+             * 
+             * @return std::size_t
+             */
+            inline std::size_t getThreadCount() const
+            {
+                return threads_.size();
+            }
+
+
+            /**
+             * @brief Launch the threads
+             * 
+             * @param nb_threads at least one
+             */
+            void start(int nb_threads)
+            {
+                {
+                    std::lock_guard<std::mutex> lock(jobs_mutex_);
+                    running_ = true;
+                }
+
+                for(int i = 0; i < std::max(nb_threads, 1); i++)
+                {
+                    threads_.emplace_back(&AdmissionPool::run, this);
+                }
+            }
+
+            /**
+             * @brief Do the queued jobs then join the threads
+             * 
+             */
+            void stop()
+            {
+                {
+                    std::lock_guard<std::mutex> lock(jobs_mutex_);
+                    running_ = false;
+                }
+                jobs_cond_.notify_all();
+
+                for(std::thread &thread : threads_)
+                {
+                    thread.join();
+                }
+                threads_.clear();
+            }
+
+            /**
+             * @brief Queue a job <Thread Safe>
+             * 
+             * @param job
+             */
+            void submit(std::function<void()> job)
+            {
+                pending_count_++;
+                {
+                    std::lock_guard<std::mutex> lock(jobs_mutex_);
+                    jobs_.push(std::move(job));
+                }
+                jobs_cond_.notify_one();
+            }
+    };
+
+}
+
+#endif
@@ -6,7 +6,6 @@
 #ifndef CLIENT_HPP
 #define CLIENT_HPP
 
-#include <queue>
 #include <string>
 #include <memory>
 #include <functional>
@@ -17,6 +16,16 @@
 
 #include "cross_sockets.hpp"
 #include "internal_message.hpp"
+#include "compression.hpp"
+#include "snapshot.hpp"
+#include "connection_limits.hpp"
+#include "shared_ring.hpp"
+#include "send_queue.hpp"
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
 
 namespace ASE
 {
@@ -33,9 +42,10 @@ namespace ASE
         SOCKET socket_;
         SOCKADDR addr_;
 
-        // Pile des messages internes
-        std::queue<InternalMessage> internal_messages_queue_;
+        // Pile des messages internes, bounded by the send queue limits of the server
+        SendQueue internal_messages_queue_;
         std::mutex internal_messages_queue_mutex_;
+        bool socket_closed_ = false;    // guarded by internal_messages_queue_mutex_, the socket is not shut down once closed
 
         // Data of client, that can be used by dev
         ClientDataStructure data_;
@@ -43,6 +53,20 @@ namespace ASE
 
         std::string name_;
 
+        // negotiated during the handshake, used only by the client thread afterwards
+        CompressionContext compression_;
+        WireVersion wire_version_ = WIRE_V1;
+        ConnectionLimits peer_limits_;      // receiving limits of the client
+
+        // snapshots sent to this client, used only by the client thread
+        SnapshotEncoder snapshot_encoder_;
+
+        #if defined(__linux__)
+        std::unique_ptr<SharedMemoryLink> shared_link_;    // frames go through it instead of the socket if set
+        #endif
+
+        int push_fd_ = -1;      // eventfd waking the engine to push a frame, -1 if served in lock-step
+
 
     public:
 
@@ -77,12 +101,24 @@ namespace ASE
          * 
          * @param client_socket client's socket
          * @param out_id created client's id
+         * @param send_queue_limits caps of its internal message queue
          */
-        Client(SOCKET client_socket, int &out_id): thread_id_(0), socket_(client_socket)
+        Client(SOCKET client_socket, int &out_id, const SendQueueLimits &send_queue_limits = SendQueueLimits()): thread_id_(0), socket_(client_socket)
         {
             id_ = cpt_id++;
             name_ = "basic_user_" + std::to_string(id_);
             out_id = id_;
+            internal_messages_queue_.setLimits(send_queue_limits);
+        }
+
+        ~Client()
+        {
+            #if defined(__linux__)
+            if(push_fd_ >= 0)
+            {
+                close(push_fd_);
+            }
+            #endif
         }
 
         /**
@@ -125,6 +161,137 @@ namespace ASE
             return socket_;
         }
 
+        /**
+         * @brief Close the socket, when the client is disconnected <Thread Safe>
+         * 
+         */
+        void closeSocket()
+        {
+            std::lock_guard<std::mutex> lock(internal_messages_queue_mutex_);
+            socket_closed_ = true;
+            closesocket(socket_);
+        }
+
+        /**
+         * @brief Get the compression context of the connection, its stats can be read from any thread
+         * 
+         * @return CompressionContext& 
+         */
+        CompressionContext &getCompressionContext()
+        {
+            return compression_;
+        }
+
+        /**
+         * @brief Get the wire version negotiated with the client
+         * 
+         * @return WireVersion 
+         */
+        WireVersion getWireVersion() const
+        {
+            return wire_version_;
+        }
+
+        /**
+         * @brief Set the wire version negotiated with the client, before its thread starts
+         * 
+         * @param version 
+         */
+        void setWireVersion(WireVersion version)
+        {
+            wire_version_ = version;
+        }
+
+        /**
+         * @brief Get the receiving limits of the client, advertised during the handshake
+         * 
+         * @return const ConnectionLimits& 
+         */
+        const ConnectionLimits &getPeerLimits() const
+        {
+            return peer_limits_;
+        }
+
+        /**
+         * @brief Set the receiving limits of the client, before its thread starts
+         * 
+         * @param limits 
+         */
+        void setPeerLimits(const ConnectionLimits &limits)
+        {
+            peer_limits_ = limits;
+        }
+
+        /**
+         * @brief Get the snapshot history of the connection, to use only from the client thread
+         * 
+         * @return SnapshotEncoder& 
+         */
+        SnapshotEncoder &getSnapshotEncoder()
+        {
+            return snapshot_encoder_;
+        }
+
+        #if defined(__linux__)
+        /**
+         * @brief Get the shared memory link negotiated during the handshake
+         * 
+         * @return SharedMemoryLink* nullptr if the frames go through the socket
+         */
+        SharedMemoryLink *getSharedMemoryLink()
+        {
+            return shared_link_.get();
+        }
+
+        void setSharedMemoryLink(std::unique_ptr<SharedMemoryLink> link)
+        {
+            shared_link_ = std::move(link);
+        }
+        #endif
+
+        /**
+         * @brief Serve the client by push, during the handshake: its engine sends a frame at each 
+         * notifyPush instead of answering the client's frames (Linux only)
+         * 
+         * @return true if enabled
+         */
+        bool enablePush()
+        {
+            #if defined(__linux__)
+            if(push_fd_ < 0)
+            {
+                push_fd_ = eventfd(0, EFD_CLOEXEC);     // blocking, read by io_uring too
+            }
+            #endif
+            return push_fd_ >= 0;
+        }
+
+        /**
+         * @brief Get the eventfd the engine waits on for the push notifications
+         * 
+         * @return int -1 if the client is served in lock-step
+         */
+        int getPushFd() const
+        {
+            return push_fd_;
+        }
+
+        /**
+         * @brief Make the engine push a frame to the client now, nothing in lock-step <Thread Safe>
+         * 
+         */
+        void notifyPush()
+        {
+            #if defined(__linux__)
+            if(push_fd_ >= 0)
+            {
+                uint64_t one = 1;
+                ssize_t ignored = write(push_fd_, &one, sizeof(one));
+                (void)ignored;
+            }
+            #endif
+        }
+
         /**
          * @brief Reading access to the client's user data <Thread Safe>
          * 
@@ -150,38 +317,98 @@ namespace ASE
         }
 
 
+        /**
+         * @brief Set the caps of the internal message queue, before its thread starts
+         * 
+         * @param limits 
+         */
+        void setSendQueueLimits(const SendQueueLimits &limits)
+        {
+            std::lock_guard<std::mutex> lock(internal_messages_queue_mutex_);
+            internal_messages_queue_.setLimits(limits);
+        }
+
+        /**
+         * @brief Get the depth and the counters of the internal message queue <Thread Safe>
+         * 
+         * @return SendQueueStats 
+         */
+        SendQueueStats getSendQueueStats()
+        {
+            std::lock_guard<std::mutex> lock(internal_messages_queue_mutex_);
+            return internal_messages_queue_.getStats();
+        }
+
+        /**
+         * @brief Tell if the internal message queue stayed over its caps for the grace period,
+         * the engine serving the client must disconnect it <Thread Safe>
+         * 
+         * @param now server clock
+         */
+        bool isSendQueueOverdue(VirtualClock::Clock::time_point now)
+        {
+            std::lock_guard<std::mutex> lock(internal_messages_queue_mutex_);
+            return internal_messages_queue_.isOverdue(now);
+        }
+
         /**
          * @brief Add internal message to his internal_message_queue <Thread Safe> A TESTER ! !
          * 
          * @param message Message to give
+         * @param now server clock, starts the grace period if the queue goes over its caps
+         * @return true if queued, false if dropped by the policy of the full queue
          */
-        void giveInternalMessage(InternalMessage message)
+        bool giveInternalMessage(InternalMessage message, VirtualClock::Clock::time_point now)
         {
             internal_messages_queue_mutex_.lock();
 
-                internal_messages_queue_.emplace(message);
+                bool queued = internal_messages_queue_.push(std::move(message), now);
+
+                // too slow for the grace period: wakes the engine blocked on the socket, which disconnects the client
+                if(!socket_closed_ && internal_messages_queue_.isOverdue(now))
+                {
+                    #ifdef WIN32
+                    shutdown(socket_, SD_BOTH);
+
+                    #elif defined(__linux__)
+                    shutdown(socket_, SHUT_RDWR);
+                    #endif
+                }
 
             internal_messages_queue_mutex_.unlock();
+
+            // served by push, the message goes out without waiting for the tick
+            if(queued)
+            {
+                notifyPush();
+            }
+            return queued;
         }
 
 
+        /**
+         * @brief Tell if internal messages wait to be sent <Thread Safe>
+         * 
+         */
+        bool hasInternalMessages()
+        {
+            std::lock_guard<std::mutex> lock(internal_messages_queue_mutex_);
+            return !internal_messages_queue_.isEmpty();
+        }
+
         /**
          * @brief Get the first internal message object  A TESTER ! !
          *        <Thread Safe>
          * 
-         * @return InternalMessage or ?? if empty
+         * @param max_messages slots left in the frame, the message stays queued if it needs more
+         * @return InternalMessage or EMPTY if empty or if it does not fit
          */
-        InternalMessage getFirstInternalMessage()
+        InternalMessage getFirstInternalMessage(std::size_t max_messages = SIZE_MAX)
         {
             InternalMessage output;
             internal_messages_queue_mutex_.lock();
 
-                if(!internal_messages_queue_.empty())
-                {
-                    output = internal_messages_queue_.front();
-                    internal_messages_queue_.pop();
-                }
-                else
+                if(!internal_messages_queue_.pop(output, max_messages))
                 {
                     output = InternalMessage(EMPTY, {});
                 }
@@ -202,7 +429,8 @@ namespace ASE
         {
             std::string output = "";
             internal_messages_queue_mutex_.lock();
-                output += "front = " + internal_messages_queue_.front().to_string();
+                const SendQueueStats &stats = internal_messages_queue_.getStats();
+                output += "queued = " + std::to_string(stats.messages) + ", bytes = " + std::to_string(stats.bytes);
             internal_messages_queue_mutex_.unlock();
 
             return output;
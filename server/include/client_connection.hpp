@@ -0,0 +1,329 @@
+/**
+ * @file client_connection.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef CLIENT_CONNECTION_HPP
+#define CLIENT_CONNECTION_HPP
+
+#include <vector>
+#include <iostream>
+
+#include "cross_sockets.hpp"
+#include "frame.hpp"
+#include "frame_view.hpp"
+#include "frame_receiver.hpp"
+#include "internal_message.hpp"
+#include "compression.hpp"
+#include "connection_limits.hpp"
+#include "fragmentation.hpp"
+#include "shared_ring.hpp"
+
+namespace ASE
+{
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    class Server;
+
+
+    /**
+     * @brief State of a connected client owned by the engine serving it (its client thread or a reactor thread):
+     * what was negotiated during the handshake and the buffers reused at each frame
+     * 
+     */
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    struct ClientConnection
+    {
+        int id;
+        SOCKET socket;
+        CompressionContext *compression;    // owned by the Client
+        WireVersion wire_version;
+        ConnectionLimits peer_limits;
+
+        #if defined(__linux__)
+        SharedMemoryLink *shared_link;      // owned by the Client, nullptr if the frames go through the socket
+        #endif
+
+        int push_fd;                        // owned by the Client, -1 if the frames are answers (see readClientFrame)
+
+        FrameReceiver receiver;
+        Frame to_send;
+
+        // messages too big for one side, cut in fragments sent in the free slots of the frames
+        FragmentSender fragments;
+        FragmentReassembler reassembler;
+
+        /**
+         * @brief Load what was negotiated with the client during the handshake
+         * 
+         * @param server_ref
+         * @param client_id
+         */
+        ClientConnection(Server<ClientDataStructure,ServerDataStructure> &server_ref, int client_id): id(client_id), socket(INVALID_SOCKET), compression(nullptr), wire_version(WIRE_V1), push_fd(-1),
+                                                                                                     reassembler(server_ref.limits.max_reassembly_size)
+        {
+            #if defined(__linux__)
+            shared_link = nullptr;
+            #endif
+
+            server_ref.getClientList().getClientAccess(client_id, [&](auto &client){
+                socket = client.getSocket();
+                compression = &client.getCompressionContext();
+                wire_version = client.getWireVersion();
+                peer_limits = client.getPeerLimits();
+                push_fd = client.getPushFd();
+                #if defined(__linux__)
+                shared_link = client.getSharedMemoryLink();
+                #endif
+            });
+
+            receiver.setSocket(socket);
+            receiver.setCompressionContext(compression);
+            receiver.setWireVersion(wire_version);
+            receiver.setLimits(server_ref.limits);
+        }
+    };
+
+
+    /**
+     * @brief Add to a client frame the messages an internal message carries: its shared serialized messages
+     * if it has some, else a message with its data
+     * 
+     * @param msg internal message received by the client thread
+     * @param code code of the message to create if msg has no serialized messages
+     * @param to_send frame of the client
+     */
+    inline void addInternalMessageToFrame(const InternalMessage &msg, MessageCodes code, Frame &to_send)
+    {
+        if(msg.getWire() != nullptr)
+        {
+            to_send.addShared(msg.getWire());
+        }
+        else
+        {
+            to_send.addMessage(Message(code, msg.getDataRef().data(), msg.getDataRef().size()));
+        }
+    }
+
+
+    /**
+     * @brief Handle the messages of a frame received from a client with the user hooks.
+     * connection.to_send is cleared, and only gets the answer of a DISCONNECT
+     * 
+     * @param server_ref
+     * @param connection connection of the client
+     * @param recv_from_client frame received
+     * @return true if the connection goes on, false if the client must be disconnected once connection.to_send
+     * is sent (if not empty)
+     */
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    bool readClientFrame(Server<ClientDataStructure,ServerDataStructure> &server_ref, ClientConnection<ClientDataStructure,ServerDataStructure> &connection, const FrameView &recv_from_client)
+    {
+        int my_id = connection.id;
+        Frame &to_send = connection.to_send;
+        to_send.clear();
+
+        std::vector<uint8_t> end_data_to_send;
+
+        // returns false when the connection is over
+        auto analyse_message = [&](const MessageView &message) -> bool
+        {
+            switch (message.getHat())
+            {
+            case DATA:
+                server_ref.client_routine_data_recv_lambda(server_ref, message.getData(), my_id);
+                break;
+
+            case SNAPACK:
+                try
+                {
+                    uint32_t acked_id = message.as<uint32_t>();
+                    server_ref.getClientList().getClientAccess(my_id, [&](auto &me){
+                        me.getSnapshotEncoder().acknowledge(acked_id);
+                    });
+                }
+                catch(DataSizeException& e)
+                {
+                    // bad ack ignored, next snapshots stay based on the previous one
+                }
+                break;
+
+            case DISCONNECT:
+
+                #if DEBUG
+                std::cout << "client " << my_id << " asked for disconnection\n";
+                #endif
+
+
+                server_ref.disconnection_lambda(server_ref, message.toMessage().getDataCopy(), end_data_to_send);
+
+                to_send.addMessage(Message(DISCONNECT, std::move(end_data_to_send)));
+                connection.fragments.fragmentFrame(to_send, connection.peer_limits);
+                return false;
+                break;
+
+            default:
+
+                std::cout << "client " << my_id << " sended wrong hat\n";
+                to_send.clear();
+                return false;
+
+                break;
+            }
+
+            return true;
+        };
+
+        for(const MessageView &message : recv_from_client)
+        {
+            if(message.getHat() != FRAGMENT)
+            {
+                if(!analyse_message(message))
+                {
+                    return false;
+                }
+                continue;
+            }
+
+            bool completed = false;
+            try
+            {
+                completed = connection.reassembler.push(message);
+            }
+            catch(const std::exception& e)
+            {
+                #if DEBUG
+                std::cout << "error during client " << my_id << " fragment reassembly: "<< e.what() << "\n";
+                #endif
+
+                to_send.clear();
+                return false;
+            }
+
+            if(completed && !analyse_message(connection.reassembler.getCompleted()))
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Add to connection.to_send the client's internal messages, then the user's data to send.
+     * Done for each answer in lock-step, or for each push notification
+     * 
+     * @param server_ref
+     * @param connection connection of the client
+     * @return true if the connection goes on, false if the client must be disconnected once connection.to_send
+     * is sent (kicked, or its send queue stayed over its caps)
+     */
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    bool prepareClientFrame(Server<ClientDataStructure,ServerDataStructure> &server_ref, ClientConnection<ClientDataStructure,ServerDataStructure> &connection)
+    {
+        int my_id = connection.id;
+        Frame &to_send = connection.to_send;
+
+        auto now = server_ref.getClock().now();
+
+        // the internal messages not fitting in the client's frame limit stay queued for the next frame,
+        // they go before the user's data (deferred by fragmentFrame if over the limit)
+        std::size_t max_messages = connection.peer_limits.max_frame_messages;
+        bool left = false;
+
+        for(;;)
+        {
+            std::size_t used = std::size_t(to_send.getLength());
+            std::size_t room = used < max_messages ? max_messages - used : 0;
+
+            InternalMessage msg;
+            bool overdue = false;
+            server_ref.getClientList().getClientAccess(my_id, [&](auto &me){
+                overdue = me.isSendQueueOverdue(now);
+                // a message bigger than the limit goes alone, fragmentFrame unshares it
+                msg = me.getFirstInternalMessage(used == 0 ? SIZE_MAX : room);
+                left = msg.getHat() == EMPTY && me.hasInternalMessages();
+            });
+
+            // too slow to read what it is sent, see SendQueueLimits
+            if(overdue)
+            {
+                #if DEBUG
+                std::cout << "client " << my_id << " send queue overdue\n";
+                #endif
+
+                return false;
+            }
+
+            if(msg.getHat() == EMPTY)
+                break;
+
+
+            switch (msg.getHat())
+            {
+            case NEWCLIENT:
+                addInternalMessageToFrame(msg, OCONNECT, to_send);
+                break;
+
+            case REMOVECLIENT:
+                addInternalMessageToFrame(msg, ODISCONNECT, to_send);
+                break;
+
+            case BROADCAST:
+                addInternalMessageToFrame(msg, DATA, to_send);
+                break;
+
+            case KICK_YOU:
+                addInternalMessageToFrame(msg, KICK, to_send);
+                connection.fragments.fragmentFrame(to_send, connection.peer_limits);
+                return false;
+                break;
+
+            case CUSTOM:
+                server_ref.internal_custom_message_analysis_lambda(server_ref, msg, to_send);
+                break;
+
+            default:
+                break;
+            }
+        }
+
+
+        server_ref.client_routine_data_to_send_lambda(server_ref, to_send, my_id);
+        connection.fragments.fragmentFrame(to_send, connection.peer_limits);
+
+        // served by push, what did not fit goes in the next frame without waiting for a new message
+        if(connection.push_fd >= 0 && (left || connection.fragments.getPendingCount() > 0))
+        {
+            server_ref.getClientList().getClientAccess(my_id, [](auto &me){
+                me.notifyPush();
+            });
+        }
+
+        return true;
+    }
+
+    /**
+     * @brief Handle a frame received from a client and prepare the answer in connection.to_send:
+     * user hooks on its messages, then the client's internal messages, then the user's data to send.
+     * Used by every engine for the clients in lock-step, sending the answer is left to the caller
+     * 
+     * @param server_ref
+     * @param connection connection of the client
+     * @param recv_from_client frame received
+     * @return true if the connection goes on, false if the client must be disconnected once connection.to_send
+     * is sent (if not empty)
+     */
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    bool processClientFrame(Server<ClientDataStructure,ServerDataStructure> &server_ref, ClientConnection<ClientDataStructure,ServerDataStructure> &connection, const FrameView &recv_from_client)
+    {
+        if(!readClientFrame(server_ref, connection, recv_from_client))
+        {
+            return false;
+        }
+
+        return prepareClientFrame(server_ref, connection);
+    }
+
+}
+
+#endif
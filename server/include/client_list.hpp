@@ -68,14 +68,15 @@ namespace ASE
          * 
          * @param client_socket (int)
          * @param name client internal name
+         * @param send_queue_limits caps of its internal message queue, set before it is visible
          * @return int: id of the new client
          */
-        int addClient(SOCKET client_socket,const std::string name)
+        int addClient(SOCKET client_socket,const std::string name, const SendQueueLimits &send_queue_limits = SendQueueLimits())
         {
             std::unique_lock<std::shared_mutex> writer_lock(all_clients_lock_);
 
             int id = 0;
-            all_clients.emplace_back(client_socket,id);
+            all_clients.emplace_back(client_socket,id,send_queue_limits);
 
             return id;
         }
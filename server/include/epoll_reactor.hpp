@@ -0,0 +1,578 @@
+/**
+ * @file epoll_reactor.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef EPOLL_REACTOR_HPP
+#define EPOLL_REACTOR_HPP
+
+#if defined(__linux__)
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <iostream>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "cross_sockets.hpp"
+#include "client_connection.hpp"
+#include "virtual_clock.hpp"
+
+// events read at most by one epoll_wait call
+#define REACTOR_MAX_EVENTS 256
+// delay between two checks of the idle connections
+#define REACTOR_SWEEP_MILLI 1000
+// epoll token of the wake eventfd, others are client ids
+#define REACTOR_WAKE_TOKEN UINT64_MAX
+// bit of the epoll token of a client's push eventfd
+#define REACTOR_PUSH_BIT (uint64_t(1) << 62)
+
+namespace ASE
+{
+
+    /**
+     * @brief Engine serving the clients with a fixed set of I/O threads, each one running an epoll loop
+     * over the non-blocking sockets of its clients, instead of one blocking thread per client.
+     * When a client's frame is complete it is handled by processClientFrame, like in ClientRoutine,
+     * and the answer is written without blocking: what the socket does not take is kept until it is writable.
+     * The push eventfd of the clients served by push is in the epoll set too, each notification writes a frame
+     * 
+     */
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    class EpollReactor
+    {
+        private:
+
+            struct ReactorConnection
+            {
+                ClientConnection<ClientDataStructure,ServerDataStructure> client;
+
+                std::vector<uint8_t> output;    // answer not sent yet
+                std::size_t output_pos;
+                bool writing;                   // EPOLLOUT registered
+                bool closing;                   // disconnect once output is sent
+                bool push_pending;              // push notified while output was not sent, its messages wait in the send queue
+                VirtualClock::Clock::time_point last_activity;     // server clock
+
+                ReactorConnection(Server<ClientDataStructure,ServerDataStructure> &server_ref, int client_id): client(server_ref, client_id), output_pos(0), writing(false), closing(false), push_pending(false),
+                                                                                                              last_activity(server_ref.getClock().now())
+                {
+
+                }
+            };
+
+            struct Worker
+            {
+                int epoll_fd = -1;
+                int wake_fd = -1;       // eventfd waking the loop when clients are given
+                std::thread thread;
+
+                std::mutex new_clients_mutex;
+                std::vector<int> new_clients;
+
+                std::unordered_map<int, std::unique_ptr<ReactorConnection>> connections;
+                std::atomic<std::size_t> connection_count{0};
+            };
+
+            Server<ClientDataStructure,ServerDataStructure> &server_ref_;
+            std::vector<std::unique_ptr<Worker>> workers_;
+            std::atomic<bool> running_;
+            std::atomic<std::size_t> next_worker_;
+
+
+            /**
+             * @brief Take the clients given to the worker and register their sockets
+             * 
+             */
+            void adoptClients(Worker &worker)
+            {
+                std::vector<int> new_clients;
+                {
+                    std::lock_guard<std::mutex> lock(worker.new_clients_mutex);
+                    new_clients.swap(worker.new_clients);
+                }
+
+                for(int client_id : new_clients)
+                {
+                    std::unique_ptr<ReactorConnection> connection;
+                    try
+                    {
+                        connection = std::make_unique<ReactorConnection>(server_ref_, client_id);
+                    }
+                    catch(const std::exception& e)
+                    {
+                        continue;   // already gone
+                    }
+
+                    SOCKET sock = connection->client.socket;
+                    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+                    struct epoll_event event = {};
+                    event.events = EPOLLIN;
+                    event.data.u64 = uint64_t(client_id);
+                    if(epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, sock, &event) != 0)
+                    {
+                        disconnectClient(server_ref_, client_id);
+                        continue;
+                    }
+
+                    if(connection->client.push_fd >= 0)
+                    {
+                        event.data.u64 = uint64_t(client_id) | REACTOR_PUSH_BIT;
+                        epoll_ctl(worker.epoll_fd, EPOLL_CTL_ADD, connection->client.push_fd, &event);
+                    }
+
+                    worker.connections.emplace(client_id, std::move(connection));
+                    worker.connection_count++;
+                }
+            }
+
+            /**
+             * @brief Disconnect the client and forget its connection
+             * 
+             */
+            void closeConnection(Worker &worker, ReactorConnection &connection)
+            {
+                int client_id = connection.client.id;
+
+                epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, connection.client.socket, nullptr);
+                if(connection.client.push_fd >= 0)
+                {
+                    // closed with the Client
+                    epoll_ctl(worker.epoll_fd, EPOLL_CTL_DEL, connection.client.push_fd, nullptr);
+                }
+                try
+                {
+                    disconnectClient(server_ref_, client_id);
+                }
+                catch(const std::exception& e)
+                {
+                    // already removed
+                }
+
+                worker.connections.erase(client_id);
+                worker.connection_count--;
+            }
+
+            /**
+             * @brief Write as much of the pending answer as the socket takes
+             * 
+             * @return false if the connection was closed
+             */
+            bool flush(Worker &worker, ReactorConnection &connection)
+            {
+                while(connection.output_pos < connection.output.size())
+                {
+                    ssize_t sent = send(connection.client.socket, (const char*)(connection.output.data() + connection.output_pos), connection.output.size() - connection.output_pos, MSG_NOSIGNAL);
+
+                    if(sent > 0)
+                    {
+                        connection.output_pos += std::size_t(sent);
+                        continue;
+                    }
+
+                    if(sent < 0 && errno == EINTR)
+                    {
+                        continue;
+                    }
+
+                    if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+                    {
+                        if(!connection.writing)
+                        {
+                            struct epoll_event event = {};
+                            event.events = EPOLLIN | EPOLLOUT;
+                            event.data.u64 = uint64_t(connection.client.id);
+                            epoll_ctl(worker.epoll_fd, EPOLL_CTL_MOD, connection.client.socket, &event);
+                            connection.writing = true;
+                        }
+                        return true;
+                    }
+
+                    closeConnection(worker, connection);
+                    return false;
+                }
+
+                connection.output.clear();
+                connection.output_pos = 0;
+
+                if(connection.closing)
+                {
+                    closeConnection(worker, connection);
+                    return false;
+                }
+
+                if(connection.writing)
+                {
+                    struct epoll_event event = {};
+                    event.events = EPOLLIN;
+                    event.data.u64 = uint64_t(connection.client.id);
+                    epoll_ctl(worker.epoll_fd, EPOLL_CTL_MOD, connection.client.socket, &event);
+                    connection.writing = false;
+                }
+
+                return true;
+            }
+
+            /**
+             * @brief Read what the client sent and answer each complete frame
+             * 
+             */
+            void onReadable(Worker &worker, ReactorConnection &connection)
+            {
+                try
+                {
+                    if(connection.client.receiver.fill() == 0)
+                    {
+                        return;
+                    }
+                }
+                catch(const std::exception& e)
+                {
+                    #if DEBUG
+                    std::cout << "error during client " << connection.client.id << " data recv: "<< e.what() << "\n";
+                    #endif
+
+                    closeConnection(worker, connection);
+                    return;
+                }
+
+                connection.last_activity = server_ref_.getClock().now();
+
+                FrameView recv_from_client;
+                while(!connection.closing)
+                {
+                    try
+                    {
+                        if(!connection.client.receiver.tryParseFrameView(recv_from_client))
+                        {
+                            break;
+                        }
+
+                        // a client served by push gets no answer, only its DISCONNECT one
+                        bool push = connection.client.push_fd >= 0;
+                        bool keep_connection = push ? readClientFrame(server_ref_, connection.client, recv_from_client) : processClientFrame(server_ref_, connection.client, recv_from_client);
+
+                        if((keep_connection && !push) || connection.client.to_send.getLength() > 0)
+                        {
+                            connection.client.to_send.serializeFrame(connection.output, connection.client.compression, connection.client.wire_version);
+                        }
+                        connection.closing = !keep_connection;
+                    }
+                    catch(const std::exception& e)
+                    {
+                        #if DEBUG
+                        std::cout << "error during client " << connection.client.id << " frame: "<< e.what() << "\n";
+                        #endif
+
+                        closeConnection(worker, connection);
+                        return;
+                    }
+                }
+
+                recv_from_client.clear();
+                flush(worker, connection);
+            }
+
+            /**
+             * @brief Write the frame of a push notification. While the previous frame is not sent, the messages 
+             * stay in the client's send queue, bounded by its caps, instead of piling up in output
+             * 
+             */
+            void onPush(Worker &worker, ReactorConnection &connection)
+            {
+                uint64_t value;
+                ssize_t ignored = read(connection.client.push_fd, &value, sizeof(value));
+                (void)ignored;
+
+                pushFrame(worker, connection);
+            }
+
+            /**
+             * @brief Prepare and write the frame of a client served by push, later if output is not sent yet
+             * 
+             */
+            void pushFrame(Worker &worker, ReactorConnection &connection)
+            {
+                if(connection.closing)
+                {
+                    return;
+                }
+
+                if(connection.output_pos < connection.output.size())
+                {
+                    connection.push_pending = true;
+                    return;
+                }
+                connection.push_pending = false;
+
+                try
+                {
+                    connection.client.to_send.clear();
+                    bool keep_connection = prepareClientFrame(server_ref_, connection.client);
+
+                    if(connection.client.to_send.getLength() > 0)
+                    {
+                        connection.client.to_send.serializeFrame(connection.output, connection.client.compression, connection.client.wire_version);
+                    }
+                    connection.closing = !keep_connection;
+                }
+                catch(const std::exception& e)
+                {
+                    #if DEBUG
+                    std::cout << "error during client " << connection.client.id << " push: "<< e.what() << "\n";
+                    #endif
+
+                    closeConnection(worker, connection);
+                    return;
+                }
+
+                flush(worker, connection);
+            }
+
+            /**
+             * @brief Disconnect the clients silent for more than the server's timeout
+             * 
+             */
+            void sweep(Worker &worker)
+            {
+                auto limit = server_ref_.getClock().now() - std::chrono::seconds(server_ref_.getTimeoutLimit());
+
+                std::vector<ReactorConnection*> idle;
+                for(auto &[client_id, connection] : worker.connections)
+                {
+                    if(connection->last_activity < limit)
+                    {
+                        idle.push_back(connection.get());
+                    }
+                }
+
+                for(ReactorConnection *connection : idle)
+                {
+                    #if DEBUG
+                    std::cout << "client " << connection->client.id << " timed out\n";
+                    #endif
+
+                    closeConnection(worker, *connection);
+                }
+            }
+
+            /**
+             * @brief Event loop of an I/O thread
+             * 
+             */
+            void run(Worker &worker)
+            {
+                struct epoll_event events[REACTOR_MAX_EVENTS];
+                auto next_sweep = std::chrono::steady_clock::now() + std::chrono::milliseconds(REACTOR_SWEEP_MILLI);
+
+                while(running_)
+                {
+                    int nb_events = epoll_wait(worker.epoll_fd, events, REACTOR_MAX_EVENTS, REACTOR_SWEEP_MILLI);
+
+                    for(int i = 0; i < nb_events; i++)
+                    {
+                        if(events[i].data.u64 == REACTOR_WAKE_TOKEN)
+                        {
+                            uint64_t value;
+                            ssize_t ignored = read(worker.wake_fd, &value, sizeof(value));
+                            (void)ignored;
+                            adoptClients(worker);
+                            continue;
+                        }
+
+                        // a connection closed by a previous event of this batch is not in the map anymore
+                        auto connection_it = worker.connections.find(int(events[i].data.u64 & ~REACTOR_PUSH_BIT));
+                        if(connection_it == worker.connections.end())
+                        {
+                            continue;
+                        }
+                        ReactorConnection *connection = connection_it->second.get();
+
+                        if(events[i].data.u64 & REACTOR_PUSH_BIT)
+                        {
+                            onPush(worker, *connection);
+                            continue;
+                        }
+
+                        if(events[i].events & EPOLLOUT)
+                        {
+                            if(!flush(worker, *connection))
+                            {
+                                continue;
+                            }
+
+                            if(connection->push_pending && connection->output.empty())
+                            {
+                                pushFrame(worker, *connection);
+                                if(worker.connections.count(int(events[i].data.u64)) == 0)
+                                {
+                                    continue;
+                                }
+                            }
+                        }
+
+                        if(events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                        {
+                            onReadable(worker, *connection);
+                        }
+                    }
+
+                    if(std::chrono::steady_clock::now() >= next_sweep)
+                    {
+                        sweep(worker);
+                        next_sweep = std::chrono::steady_clock::now() + std::chrono::milliseconds(REACTOR_SWEEP_MILLI);
+                    }
+                }
+            }
+
+        public:
+
+            /**
+             * @brief Create the reactor, its threads are launched by start
+             * 
+             * @param server_ref server whose clients are served
+             * @param nb_threads number of I/O threads
+             */
+            EpollReactor(Server<ClientDataStructure,ServerDataStructure> &server_ref, int nb_threads): server_ref_(server_ref), running_(false), next_worker_(0)
+            {
+                for(int i = 0; i < std::max(nb_threads, 1); i++)
+                {
+                    auto worker = std::make_unique<Worker>();
+                    worker->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+                    worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+                    if(worker->epoll_fd < 0 || worker->wake_fd < 0)
+                    {
+                        throw std::runtime_error("Error during reactor creation");
+                    }
+
+                    struct epoll_event event = {};
+                    event.events = EPOLLIN;
+                    event.data.u64 = REACTOR_WAKE_TOKEN;
+                    epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &event);
+
+                    workers_.push_back(std::move(worker));
+                }
+            }
+
+            ~EpollReactor()
+            {
+                stop();
+
+                for(auto &worker : workers_)
+                {
+                    close(worker->wake_fd);
+                    close(worker->epoll_fd);
+                }
+            }
+
+            /**
+             * @brief Launch the I/O threads
+             * 
+             */
+            void start()
+            {
+                running_ = true;
+                for(auto &worker : workers_)
+                {
+                    Worker *worker_ptr = worker.get();
+                    worker->thread = std::thread([this, worker_ptr](){
+                        run(*worker_ptr);
+                    });
+                }
+            }
+
+            /**
+             * @brief Stop and join the I/O threads, the connections are left as they are
+             * 
+             */
+            void stop()
+            {
+                running_ = false;
+                for(auto &worker : workers_)
+                {
+                    uint64_t one = 1;
+                    ssize_t ignored = write(worker->wake_fd, &one, sizeof(one));
+                    (void)ignored;
+
+                    if(worker->thread.joinable())
+                    {
+                        worker->thread.join();
+                    }
+                }
+            }
+
+            /**
+             * @brief Give a client, who finished its handshake, to an I/O thread <Thread Safe>
+             * 
+             * @param client_id
+             * @param preferred_worker I/O thread to use (modulo their number), -1 for the least loaded one
+             */
+            void addClient(int client_id, int preferred_worker = -1)
+            {
+                Worker *chosen = workers_[next_worker_++ % workers_.size()].get();
+                if(preferred_worker >= 0)
+                {
+                    chosen = workers_[std::size_t(preferred_worker) % workers_.size()].get();
+                }
+                else
+                {
+                    for(auto &worker : workers_)
+                    {
+                        if(worker->connection_count < chosen->connection_count)
+                        {
+                            chosen = worker.get();
+                        }
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(chosen->new_clients_mutex);
+                    chosen->new_clients.push_back(client_id);
+                }
+
+                uint64_t one = 1;
+                ssize_t ignored = write(chosen->wake_fd, &one, sizeof(one));
+                (void)ignored;
+            }
+
+            /**
+             * @brief Get the number of I/O threads
+             * 
+             * @return std::size_t
+             */
+            std::size_t getThreadCount() const
+            {
+                return workers_.size();
+            }
+
+            /**
+             * @brief Get the number of clients served <Thread Safe>
+             * 
+             * @return std::size_t
+             */
+            std::size_t getConnectionCount() const
+            {
+                std::size_t output = 0;
+                for(auto &worker : workers_)
+                {
+                    output += worker->connection_count;
+                }
+                return output;
+            }
+    };
+
+}
+
+#endif
+
+#endif
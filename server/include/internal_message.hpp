@@ -6,6 +6,9 @@
 #ifndef INTERNAL_MESSAGE_HPP
 #define INTERNAL_MESSAGE_HPP
 
+#include <memory>
+
+#include "wire_buffer.hpp"
 
 namespace ASE
 {
@@ -16,23 +19,54 @@ enum InternalMessageCodes {
     REMOVECLIENT = 0x01,
     KICK_YOU = 0x02,
     CUSTOM = 0x03,
-    EMPTY = 0x04
+    EMPTY = 0x04,
+    BROADCAST = 0x05
 };
 
 
 class InternalMessage
 {
 private:
+    /**
+     * @brief Share data between clients, empty data is not allocated
+     * 
+     */
+    static std::shared_ptr<const std::vector<uint8_t>> share(std::vector<uint8_t> data)
+    {
+        if(data.empty())
+        {
+            return nullptr;
+        }
+        return std::make_shared<const std::vector<uint8_t>>(std::move(data));
+    }
+
     int hat_;
-    std::vector<uint8_t> data_;
+    std::shared_ptr<const std::vector<uint8_t>> data_;     // shared by all the clients receiving the message
+    SharedWireBuffer wire_;                                 // messages to send as-is, can be nullptr
+
+    // what a full send queue may do with it (see send_queue.hpp)
+    bool droppable_ = false;
+    int state_key_ = -1;                                    // superseded by a newer message with the same key, -1 for none
 public:
 
-    InternalMessage()
+    InternalMessage() : hat_(EMPTY)
     {
 
     }
 
-    InternalMessage(int hat, std::vector<uint8_t> data) : hat_(hat), data_(data)
+    InternalMessage(int hat, std::vector<uint8_t> data) : hat_(hat), data_(share(std::move(data)))
+    {
+
+    }
+
+    /**
+     * @brief Create an internal message carrying messages serialized once for all clients
+     * 
+     * @param hat 
+     * @param data 
+     * @param wire serialized messages the client thread adds to its frame
+     */
+    InternalMessage(int hat, std::vector<uint8_t> data, SharedWireBuffer wire) : hat_(hat), data_(share(std::move(data))), wire_(std::move(wire))
     {
 
     }
@@ -47,12 +81,81 @@ public:
 
     std::vector<uint8_t> getDataCopy() const
     {
-        return data_;
+        return getDataRef();
     }
 
     const std::vector<uint8_t> &getDataRef() const
     {
-        return data_;
+        static const std::vector<uint8_t> empty_data;
+        return data_ != nullptr ? *data_ : empty_data;
+    }
+
+    /**
+     * @brief Get the serialized messages to send, nullptr if the message has none
+     * 
+     * @return const SharedWireBuffer& 
+     */
+    const SharedWireBuffer &getWire() const
+    {
+        return wire_;
+    }
+
+    /**
+     * @brief Get the bytes the message sends, counted by the send queues: its serialized messages if any, 
+     * else its data (the data of a message with both is only a copy)
+     * 
+     * @return std::size_t 
+     */
+    std::size_t getSize() const
+    {
+        return wire_ != nullptr ? wire_->getBytes().size() : getDataRef().size();
+    }
+
+    /**
+     * @brief Get the number of messages it adds to a frame, a custom message counts as one
+     * 
+     * @return std::size_t 
+     */
+    std::size_t getMessageCount() const
+    {
+        return wire_ != nullptr ? std::size_t(wire_->getLength()) : 1;
+    }
+
+    bool isDroppable() const
+    {
+        return droppable_;
+    }
+
+    int getStateKey() const
+    {
+        return state_key_;
+    }
+
+
+    // ~~~~~ SET ~~~~~
+
+    /**
+     * @brief Let a full send queue drop the message
+     * 
+     * @return InternalMessage& 
+     */
+    InternalMessage &setDroppable(bool droppable = true)
+    {
+        droppable_ = droppable;
+        return *this;
+    }
+
+    /**
+     * @brief Mark the message as a state superseded by the next message with the same key: 
+     * a full send queue keeps only the newest one
+     * 
+     * @param key positive, -1 for none
+     * @return InternalMessage& 
+     */
+    InternalMessage &setStateKey(int key)
+    {
+        state_key_ = key;
+        return *this;
     }
     
     std::string to_string()
@@ -64,12 +167,27 @@ public:
 
 InternalMessage CreateNewClientInternalMessage(int client_id)
 {
-    return InternalMessage(NEWCLIENT, {uint8_t(client_id), uint8_t(client_id >> 8), uint8_t(client_id >> 16), uint8_t(client_id >> 24)});
+    std::vector<uint8_t> data = {uint8_t(client_id), uint8_t(client_id >> 8), uint8_t(client_id >> 16), uint8_t(client_id >> 24)};
+    SharedWireBuffer wire = makeWireBuffer({Message(OCONNECT, data.data(), data.size())});
+    return InternalMessage(NEWCLIENT, std::move(data), std::move(wire));
 }
 
 InternalMessage CreateRemoveClientInternalMessage(int client_id)
 {
-    return InternalMessage(REMOVECLIENT, {uint8_t(client_id), uint8_t(client_id >> 8), uint8_t(client_id >> 16), uint8_t(client_id >> 24)});
+    std::vector<uint8_t> data = {uint8_t(client_id), uint8_t(client_id >> 8), uint8_t(client_id >> 16), uint8_t(client_id >> 24)};
+    SharedWireBuffer wire = makeWireBuffer({Message(ODISCONNECT, data.data(), data.size())});
+    return InternalMessage(REMOVECLIENT, std::move(data), std::move(wire));
+}
+
+InternalMessage CreateKickInternalMessage(std::vector<uint8_t> reason)
+{
+    SharedWireBuffer wire = makeWireBuffer({Message(KICK, reason.data(), reason.size())});
+    return InternalMessage(KICK_YOU, std::move(reason), std::move(wire));
+}
+
+InternalMessage CreateBroadcastInternalMessage(SharedWireBuffer wire)
+{
+    return InternalMessage(BROADCAST, {}, std::move(wire));
 }
 
 InternalMessage CreateCustomInternalMessage(std::vector<uint8_t> data)
@@ -80,4 +198,4 @@ InternalMessage CreateCustomInternalMessage(std::vector<uint8_t> data)
 
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,648 @@
+/**
+ * @file io_uring_reactor.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef IO_URING_REACTOR_HPP
+#define IO_URING_REACTOR_HPP
+
+#if defined(__linux__)
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <iostream>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "cross_sockets.hpp"
+#include "io_uring_queue.hpp"
+#include "client_connection.hpp"
+#include "virtual_clock.hpp"
+
+// submission ring size of an I/O thread
+#define URING_REACTOR_ENTRIES 4096
+// provided receive buffers of an I/O thread (power of 2) and their size
+#define URING_REACTOR_BUFFER_COUNT 1024
+#define URING_REACTOR_BUFFER_SIZE 4096
+// delay between two checks of the idle connections
+#define URING_REACTOR_SWEEP_MILLI 1000
+
+namespace ASE
+{
+
+    /**
+     * @brief Engine serving the clients with a fixed set of I/O threads, each one driving an io_uring:
+     * one multishot receive per client fills provided buffers, and the answers of all the frames
+     * handled in a loop turn are submitted together by the io_uring_enter that waits for the next completions,
+     * instead of one send per client. Frames are handled by processClientFrame, like in the other engines.
+     * A client served by push also has a read of its push eventfd armed, each completion prepares a frame
+     * 
+     */
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    class IoUringReactor
+    {
+        private:
+
+            // operation kind, in the low byte of the user data (the rest is the connection serial)
+            enum Operation : uint64_t {
+                OP_WAKE = 0,
+                OP_RECV = 1,
+                OP_SEND = 2,
+                OP_CANCEL = 3,
+                OP_PUSH = 4         // read of the push eventfd of a client served by push
+            };
+
+            struct ReactorConnection
+            {
+                ClientConnection<ClientDataStructure,ServerDataStructure> client;
+                uint64_t serial;                // identifies the connection in the user data, never reused
+
+                std::vector<uint8_t> output;    // answers waiting for the current send
+                std::vector<uint8_t> sending;   // answers being sent, untouched until the completion
+                std::size_t sending_pos;
+                bool send_in_flight;
+                bool receiving;                 // multishot receive armed
+                bool push_armed;                // read of the push eventfd armed
+                uint64_t push_value;
+                bool push_pending;              // push notified while a frame was being sent, its messages wait in the send queue
+                bool closing;                   // disconnect once output is sent
+                bool closed;                    // disconnected, kept until its operations complete
+                VirtualClock::Clock::time_point last_activity;     // server clock
+
+                ReactorConnection(Server<ClientDataStructure,ServerDataStructure> &server_ref, int client_id, uint64_t connection_serial): client(server_ref, client_id), serial(connection_serial),
+                                                                                                                                           sending_pos(0), send_in_flight(false), receiving(false), push_armed(false), push_value(0), push_pending(false), closing(false), closed(false),
+                                                                                                                                           last_activity(server_ref.getClock().now())
+                {
+
+                }
+            };
+
+            struct Worker
+            {
+                std::unique_ptr<IoUringQueue> ring;
+                int wake_fd = -1;       // eventfd waking the loop when clients are given
+                uint64_t wake_value = 0;
+                std::thread thread;
+
+                std::mutex new_clients_mutex;
+                std::vector<int> new_clients;
+
+                std::unordered_map<uint64_t, std::unique_ptr<ReactorConnection>> connections;
+                std::vector<uint64_t> to_flush;     // connections with answers to submit at the end of the turn
+                uint64_t next_serial = 1;
+                std::atomic<std::size_t> connection_count{0};
+                std::atomic<std::size_t> enter_count{0};
+            };
+
+            Server<ClientDataStructure,ServerDataStructure> &server_ref_;
+            std::vector<std::unique_ptr<Worker>> workers_;
+            std::atomic<bool> running_;
+            std::atomic<std::size_t> next_worker_;
+
+
+            static uint64_t userData(uint64_t serial, Operation operation)
+            {
+                return (serial << 8) | operation;
+            }
+
+            /**
+             * @brief Arm the read of the push eventfd of a client served by push
+             * 
+             */
+            void armPush(Worker &worker, ReactorConnection &connection)
+            {
+                if(connection.client.push_fd >= 0)
+                {
+                    worker.ring->prepareRead(connection.client.push_fd, &connection.push_value, sizeof(connection.push_value), userData(connection.serial, OP_PUSH));
+                    connection.push_armed = true;
+                }
+            }
+
+            /**
+             * @brief Take the clients given to the worker and arm their receives
+             * 
+             */
+            void adoptClients(Worker &worker)
+            {
+                std::vector<int> new_clients;
+                {
+                    std::lock_guard<std::mutex> lock(worker.new_clients_mutex);
+                    new_clients.swap(worker.new_clients);
+                }
+
+                for(int client_id : new_clients)
+                {
+                    std::unique_ptr<ReactorConnection> connection;
+                    try
+                    {
+                        connection = std::make_unique<ReactorConnection>(server_ref_, client_id, worker.next_serial++);
+                    }
+                    catch(const std::exception& e)
+                    {
+                        continue;   // already gone
+                    }
+
+                    worker.ring->prepareRecvMultishot(connection->client.socket, userData(connection->serial, OP_RECV));
+                    connection->receiving = true;
+                    armPush(worker, *connection);
+
+                    worker.connections.emplace(connection->serial, std::move(connection));
+                    worker.connection_count++;
+                }
+            }
+
+            /**
+             * @brief Forget the connection if none of its operations is still running
+             * 
+             */
+            void releaseConnection(Worker &worker, ReactorConnection &connection)
+            {
+                if(connection.closed && !connection.receiving && !connection.send_in_flight && !connection.push_armed)
+                {
+                    worker.connections.erase(connection.serial);
+                }
+            }
+
+            /**
+             * @brief Disconnect the client, its connection is kept until releaseConnection sees its operations completed
+             * 
+             */
+            void closeConnection(Worker &worker, ReactorConnection &connection)
+            {
+                if(connection.closed)
+                {
+                    return;
+                }
+                connection.closed = true;
+
+                if(connection.receiving)
+                {
+                    worker.ring->prepareCancel(userData(connection.serial, OP_RECV), userData(connection.serial, OP_CANCEL));
+                }
+
+                // the eventfd is closed with the Client, the ring keeps it open until the read ends
+                if(connection.push_armed)
+                {
+                    worker.ring->prepareCancel(userData(connection.serial, OP_PUSH), userData(connection.serial, OP_CANCEL));
+                }
+
+                try
+                {
+                    disconnectClient(server_ref_, connection.client.id);
+                }
+                catch(const std::exception& e)
+                {
+                    // already removed
+                }
+
+                worker.connection_count--;
+            }
+
+            /**
+             * @brief Prepare the sends of the answers produced during the turn, submitted all at once by the next wait
+             * 
+             */
+            void prepareSends(Worker &worker)
+            {
+                for(uint64_t serial : worker.to_flush)
+                {
+                    auto connection_it = worker.connections.find(serial);
+                    if(connection_it == worker.connections.end())
+                    {
+                        continue;
+                    }
+                    ReactorConnection &connection = *connection_it->second;
+
+                    if(connection.closed || connection.send_in_flight)
+                    {
+                        continue;
+                    }
+
+                    if(connection.sending_pos >= connection.sending.size())
+                    {
+                        if(connection.output.empty())
+                        {
+                            if(connection.closing)
+                            {
+                                closeConnection(worker, connection);
+                                releaseConnection(worker, connection);
+                            }
+                            continue;
+                        }
+
+                        connection.sending.swap(connection.output);
+                        connection.output.clear();
+                        connection.sending_pos = 0;
+                    }
+
+                    worker.ring->prepareSend(connection.client.socket, connection.sending.data() + connection.sending_pos, connection.sending.size() - connection.sending_pos, userData(serial, OP_SEND));
+                    connection.send_in_flight = true;
+                }
+
+                worker.to_flush.clear();
+            }
+
+            /**
+             * @brief Handle bytes received from a client and prepare the answer of each complete frame
+             * 
+             */
+            void onReceived(Worker &worker, ReactorConnection &connection, std::span<const uint8_t> data)
+            {
+                connection.client.receiver.feed(data);
+                connection.last_activity = server_ref_.getClock().now();
+
+                FrameView recv_from_client;
+                bool answered = false;
+                while(!connection.closing)
+                {
+                    try
+                    {
+                        if(!connection.client.receiver.tryParseFrameView(recv_from_client))
+                        {
+                            break;
+                        }
+
+                        // a client served by push gets no answer, only its DISCONNECT one
+                        bool push = connection.client.push_fd >= 0;
+                        bool keep_connection = push ? readClientFrame(server_ref_, connection.client, recv_from_client) : processClientFrame(server_ref_, connection.client, recv_from_client);
+
+                        if((keep_connection && !push) || connection.client.to_send.getLength() > 0)
+                        {
+                            connection.client.to_send.serializeFrame(connection.output, connection.client.compression, connection.client.wire_version);
+                            answered = true;
+                        }
+                        connection.closing = !keep_connection;
+                        answered = answered || connection.closing;
+                    }
+                    catch(const std::exception& e)
+                    {
+                        #if DEBUG
+                        std::cout << "error during client " << connection.client.id << " frame: "<< e.what() << "\n";
+                        #endif
+
+                        closeConnection(worker, connection);
+                        return;
+                    }
+                }
+
+                if(answered)
+                {
+                    worker.to_flush.push_back(connection.serial);
+                }
+            }
+
+            /**
+             * @brief Prepare the frame of a push notification, submitted with the answers of the turn.
+             * While the previous frame is being sent, the messages stay in the client's send queue, 
+             * bounded by its caps, instead of piling up in output
+             * 
+             */
+            void onPush(Worker &worker, ReactorConnection &connection)
+            {
+                if(connection.closing)
+                {
+                    return;
+                }
+
+                if(connection.send_in_flight || connection.sending_pos < connection.sending.size() || !connection.output.empty())
+                {
+                    connection.push_pending = true;
+                    return;
+                }
+                connection.push_pending = false;
+
+                try
+                {
+                    connection.client.to_send.clear();
+                    bool keep_connection = prepareClientFrame(server_ref_, connection.client);
+
+                    if(connection.client.to_send.getLength() > 0)
+                    {
+                        connection.client.to_send.serializeFrame(connection.output, connection.client.compression, connection.client.wire_version);
+                    }
+                    connection.closing = !keep_connection;
+                }
+                catch(const std::exception& e)
+                {
+                    #if DEBUG
+                    std::cout << "error during client " << connection.client.id << " push: "<< e.what() << "\n";
+                    #endif
+
+                    closeConnection(worker, connection);
+                    return;
+                }
+
+                if(!connection.output.empty() || connection.closing)
+                {
+                    worker.to_flush.push_back(connection.serial);
+                }
+            }
+
+            /**
+             * @brief Handle a completion of the worker's ring
+             * 
+             */
+            void onCompletion(Worker &worker, const IoUringCompletion &completion)
+            {
+                Operation operation = Operation(completion.user_data & 0xFF);
+                uint64_t serial = completion.user_data >> 8;
+
+                if(operation == OP_WAKE)
+                {
+                    adoptClients(worker);
+                    if(running_)
+                    {
+                        worker.ring->prepareRead(worker.wake_fd, &worker.wake_value, sizeof(worker.wake_value), userData(0, OP_WAKE));
+                    }
+                    return;
+                }
+
+                auto connection_it = worker.connections.find(serial);
+                if(operation == OP_CANCEL || connection_it == worker.connections.end())
+                {
+                    return;
+                }
+                ReactorConnection &connection = *connection_it->second;
+
+                if(operation == OP_RECV)
+                {
+                    connection.receiving = completion.more;
+
+                    if(!connection.closed && completion.result > 0)
+                    {
+                        onReceived(worker, connection, completion.data);
+                    }
+                    else if(!connection.closed && completion.result != -ENOBUFS)
+                    {
+                        #if DEBUG
+                        std::cout << "error during client " << connection.client.id << " data recv: "<< completion.result << "\n";
+                        #endif
+
+                        closeConnection(worker, connection);
+                    }
+
+                    // a receive stopped by the lack of buffers is armed again, they are given back as completions are handled
+                    if(!connection.closed && !connection.receiving)
+                    {
+                        worker.ring->prepareRecvMultishot(connection.client.socket, userData(serial, OP_RECV));
+                        connection.receiving = true;
+                    }
+                }
+                else if(operation == OP_PUSH)
+                {
+                    connection.push_armed = false;
+
+                    if(!connection.closed && completion.result > 0)
+                    {
+                        onPush(worker, connection);
+                    }
+                    else if(!connection.closed)
+                    {
+                        closeConnection(worker, connection);
+                    }
+
+                    if(!connection.closed)
+                    {
+                        armPush(worker, connection);
+                    }
+                }
+                else if(operation == OP_SEND)
+                {
+                    connection.send_in_flight = false;
+
+                    if(!connection.closed && completion.result <= 0)
+                    {
+                        closeConnection(worker, connection);
+                    }
+                    else if(!connection.closed)
+                    {
+                        connection.sending_pos += std::size_t(completion.result);
+                        if(connection.sending_pos < connection.sending.size() || !connection.output.empty() || connection.closing)
+                        {
+                            worker.to_flush.push_back(serial);
+                        }
+                        else if(connection.push_pending)
+                        {
+                            onPush(worker, connection);
+                        }
+                    }
+                }
+
+                releaseConnection(worker, connection);
+            }
+
+            /**
+             * @brief Disconnect the clients silent for more than the server's timeout
+             * 
+             */
+            void sweep(Worker &worker)
+            {
+                auto limit = server_ref_.getClock().now() - std::chrono::seconds(server_ref_.getTimeoutLimit());
+
+                std::vector<ReactorConnection*> idle;
+                for(auto &[serial, connection] : worker.connections)
+                {
+                    if(!connection->closed && connection->last_activity < limit)
+                    {
+                        idle.push_back(connection.get());
+                    }
+                }
+
+                for(ReactorConnection *connection : idle)
+                {
+                    #if DEBUG
+                    std::cout << "client " << connection->client.id << " timed out\n";
+                    #endif
+
+                    closeConnection(worker, *connection);
+                    releaseConnection(worker, *connection);
+                }
+            }
+
+            /**
+             * @brief Event loop of an I/O thread: one io_uring_enter per turn submits the answers and waits
+             * 
+             */
+            void run(Worker &worker)
+            {
+                worker.ring->prepareRead(worker.wake_fd, &worker.wake_value, sizeof(worker.wake_value), userData(0, OP_WAKE));
+                auto next_sweep = std::chrono::steady_clock::now() + std::chrono::milliseconds(URING_REACTOR_SWEEP_MILLI);
+
+                while(running_)
+                {
+                    prepareSends(worker);
+                    worker.ring->submitAndWait(URING_REACTOR_SWEEP_MILLI);
+                    worker.enter_count = worker.ring->getEnterCount();
+
+                    worker.ring->forEachCompletion([&](const IoUringCompletion &completion){
+                        onCompletion(worker, completion);
+                    });
+
+                    if(std::chrono::steady_clock::now() >= next_sweep)
+                    {
+                        sweep(worker);
+                        next_sweep = std::chrono::steady_clock::now() + std::chrono::milliseconds(URING_REACTOR_SWEEP_MILLI);
+                    }
+                }
+            }
+
+        public:
+
+            /**
+             * @brief Create the reactor, its threads are launched by start.
+             * Throw std::runtime_error if the kernel lacks the io_uring features used
+             * 
+             * @param server_ref server whose clients are served
+             * @param nb_threads number of I/O threads
+             */
+            IoUringReactor(Server<ClientDataStructure,ServerDataStructure> &server_ref, int nb_threads): server_ref_(server_ref), running_(false), next_worker_(0)
+            {
+                for(int i = 0; i < std::max(nb_threads, 1); i++)
+                {
+                    auto worker = std::make_unique<Worker>();
+                    worker->ring = std::make_unique<IoUringQueue>(URING_REACTOR_ENTRIES, URING_REACTOR_BUFFER_COUNT, URING_REACTOR_BUFFER_SIZE);
+                    worker->wake_fd = eventfd(0, EFD_CLOEXEC);
+
+                    if(worker->wake_fd < 0)
+                    {
+                        throw std::runtime_error("Error during reactor creation");
+                    }
+
+                    workers_.push_back(std::move(worker));
+                }
+            }
+
+            ~IoUringReactor()
+            {
+                stop();
+
+                for(auto &worker : workers_)
+                {
+                    // closing the ring ends the operations still running before their buffers are freed
+                    worker->ring.reset();
+                    close(worker->wake_fd);
+                }
+            }
+
+            /**
+             * @brief Launch the I/O threads
+             * 
+             */
+            void start()
+            {
+                running_ = true;
+                for(auto &worker : workers_)
+                {
+                    Worker *worker_ptr = worker.get();
+                    worker->thread = std::thread([this, worker_ptr](){
+                        run(*worker_ptr);
+                    });
+                }
+            }
+
+            /**
+             * @brief Stop and join the I/O threads, the connections are left as they are
+             * 
+             */
+            void stop()
+            {
+                running_ = false;
+                for(auto &worker : workers_)
+                {
+                    uint64_t one = 1;
+                    ssize_t ignored = write(worker->wake_fd, &one, sizeof(one));
+                    (void)ignored;
+
+                    if(worker->thread.joinable())
+                    {
+                        worker->thread.join();
+                    }
+                }
+            }
+
+            /**
+             * @brief Give a client, who finished its handshake, to an I/O thread <Thread Safe>
+             * 
+             * @param client_id
+             * @param preferred_worker I/O thread to use (modulo their number), -1 for the least loaded one
+             */
+            void addClient(int client_id, int preferred_worker = -1)
+            {
+                Worker *chosen = workers_[next_worker_++ % workers_.size()].get();
+                if(preferred_worker >= 0)
+                {
+                    chosen = workers_[std::size_t(preferred_worker) % workers_.size()].get();
+                }
+                else
+                {
+                    for(auto &worker : workers_)
+                    {
+                        if(worker->connection_count < chosen->connection_count)
+                        {
+                            chosen = worker.get();
+                        }
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(chosen->new_clients_mutex);
+                    chosen->new_clients.push_back(client_id);
+                }
+
+                uint64_t one = 1;
+                ssize_t ignored = write(chosen->wake_fd, &one, sizeof(one));
+                (void)ignored;
+            }
+
+            /**
+             * @brief Get the number of I/O threads
+             * 
+             * @return std::size_t
+             */
+            std::size_t getThreadCount() const
+            {
+                return workers_.size();
+            }
+
+            /**
+             * @brief Get the number of clients served <Thread Safe>
+             * 
+             * @return std::size_t
+             */
+            std::size_t getConnectionCount() const
+            {
+                std::size_t output = 0;
+                for(auto &worker : workers_)
+                {
+                    output += worker->connection_count;
+                }
+                return output;
+            }
+
+            /**
+             * @brief Get the number of io_uring_enter calls done by the I/O threads <Thread Safe>
+             * 
+             * @return std::size_t
+             */
+            std::size_t getSubmitCallCount() const
+            {
+                std::size_t output = 0;
+                for(auto &worker : workers_)
+                {
+                    output += worker->enter_count;
+                }
+                return output;
+            }
+    };
+
+}
+
+#endif
+
+#endif
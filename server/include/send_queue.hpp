@@ -0,0 +1,227 @@
+/**
+ * @file send_queue.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef SEND_QUEUE_HPP
+#define SEND_QUEUE_HPP
+
+#include <stdint.h>
+#include <cstddef>
+#include <deque>
+#include <chrono>
+
+#include "internal_message.hpp"
+#include "virtual_clock.hpp"
+
+namespace ASE
+{
+
+enum SendQueuePolicy {
+  SEND_QUEUE_COALESCE = 0x1,    // a state message replaces the queued one with the same key
+  SEND_QUEUE_DROP = 0x2,        // droppable messages are dropped, the oldest first
+  SEND_QUEUE_DISCONNECT = 0x4   // the client is disconnected if its queue stays over the caps for the grace period
+};
+
+/**
+ * @brief Caps of the messages waiting to be sent to a client, and what is done when they are reached.
+ * Set per Server, copied to each client when it is admitted
+ * 
+ */
+struct SendQueueLimits
+{
+    std::size_t max_messages = 4096;
+    std::size_t max_bytes = 1 << 20;
+    int policy = SEND_QUEUE_COALESCE | SEND_QUEUE_DROP | SEND_QUEUE_DISCONNECT;
+    int grace_milli = 2000;
+};
+
+/**
+ * @brief Depth and counters of a client's send queue
+ * 
+ */
+struct SendQueueStats
+{
+    std::size_t messages = 0;
+    std::size_t bytes = 0;
+    uint64_t coalesced = 0;
+    uint64_t dropped = 0;
+    bool over = false;      // over the caps with messages the policy could not drop
+};
+
+
+/**
+ * @brief Internal messages waiting for the next frame of a client, bounded by SendQueueLimits.
+ * Reliable messages are always queued, even over the caps, the DISCONNECT policy ends it.
+ * Not thread safe, guarded by its client
+ * 
+ */
+class SendQueue
+{
+    private:
+        std::deque<InternalMessage> messages_;
+        SendQueueLimits limits_;
+        SendQueueStats stats_;
+        VirtualClock::Clock::time_point over_since_;
+
+        bool fits(std::size_t size) const
+        {
+            return messages_.size() < limits_.max_messages && stats_.bytes + size <= limits_.max_bytes;
+        }
+
+        bool isOverCaps() const
+        {
+            return messages_.size() > limits_.max_messages || stats_.bytes > limits_.max_bytes;
+        }
+
+        /**
+         * @brief Update the stats after a push, the grace period starts when the queue goes over the caps
+         * 
+         */
+        void updateAfterPush(VirtualClock::Clock::time_point now)
+        {
+            stats_.messages = messages_.size();
+            bool over = isOverCaps();
+            if(over && !stats_.over)
+            {
+                over_since_ = now;
+            }
+            stats_.over = over;
+        }
+
+        /**
+         * @brief Replace the queued state message with the same key
+         * 
+         * @return true if replaced
+         */
+        bool coalesce(InternalMessage &message, std::size_t size)
+        {
+            for(InternalMessage &queued : messages_)
+            {
+                if(queued.getStateKey() == message.getStateKey())
+                {
+                    stats_.bytes = stats_.bytes + size - queued.getSize();
+                    queued = std::move(message);
+                    stats_.coalesced++;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /**
+         * @brief Drop the oldest droppable messages until size fits
+         * 
+         */
+        void dropUntilFits(std::size_t size)
+        {
+            for(auto it = messages_.begin(); it != messages_.end() && !fits(size);)
+            {
+                if(!it->isDroppable())
+                {
+                    ++it;
+                    continue;
+                }
+
+                stats_.bytes -= it->getSize();
+                it = messages_.erase(it);
+                stats_.dropped++;
+            }
+        }
+
+    public:
+
+        // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+        const SendQueueStats &getStats() const
+        {
+            return stats_;
+        }
+
+        bool isEmpty() const
+        {
+            return messages_.empty();
+        }
+
+        /**
+         * @brief Tell if the queue stayed over its caps for the grace period, with the DISCONNECT policy
+         * 
+         * @param now server clock
+         */
+        bool isOverdue(VirtualClock::Clock::time_point now) const
+        {
+            return stats_.over && (limits_.policy & SEND_QUEUE_DISCONNECT) && now - over_since_ >= std::chrono::milliseconds(limits_.grace_milli);
+        }
+
+
+        // ~~~~~~~~~~ SET ~~~~~~~~~~
+
+        void setLimits(const SendQueueLimits &limits)
+        {
+            limits_ = limits;
+        }
+
+
+        /**
+         * @brief Queue a message, applying the policy if it does not fit in the caps
+         * 
+         * @param message
+         * @param now server clock
+         * @return true if queued (or coalesced), false if dropped
+         */
+        bool push(InternalMessage message, VirtualClock::Clock::time_point now)
+        {
+            std::size_t size = message.getSize();
+
+            if(!fits(size))
+            {
+                if((limits_.policy & SEND_QUEUE_COALESCE) && message.getStateKey() >= 0 && coalesce(message, size))
+                {
+                    updateAfterPush(now);
+                    return true;
+                }
+
+                if(limits_.policy & SEND_QUEUE_DROP)
+                {
+                    dropUntilFits(size);
+                    if(!fits(size) && message.isDroppable())
+                    {
+                        stats_.dropped++;
+                        updateAfterPush(now);
+                        return false;
+                    }
+                }
+            }
+
+            messages_.push_back(std::move(message));
+            stats_.bytes += size;
+            updateAfterPush(now);
+            return true;
+        }
+
+        /**
+         * @brief Take the oldest message if it fits in the slots left in the frame
+         * 
+         * @param output
+         * @param max_messages slots left, see InternalMessage::getMessageCount
+         * @return true if a message was taken, false if the queue is empty or the message waits for the next frame
+         */
+        bool pop(InternalMessage &output, std::size_t max_messages = SIZE_MAX)
+        {
+            if(messages_.empty() || messages_.front().getMessageCount() > max_messages)
+            {
+                return false;
+            }
+
+            output = std::move(messages_.front());
+            messages_.pop_front();
+            stats_.messages = messages_.size();
+            stats_.bytes -= output.getSize();
+            stats_.over = stats_.over && isOverCaps();
+            return true;
+        }
+};
+
+}
+
+#endif
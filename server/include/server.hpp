@@ -12,16 +12,49 @@
 #include <chrono>
 #include <string>
 #include <iostream>
+#include <span>
+#include <memory>
+#include <algorithm>
 
 #include "cross_sockets.hpp"
 #include "client_list.hpp"
 #include "welcome_thread_functions.hpp"
 #include "frame.hpp"
+#include "frame_receiver.hpp"
 #include "internal_message.hpp"
+#include "compression.hpp"
+#include "capabilities.hpp"
+#include "connection_limits.hpp"
+#include "fragmentation.hpp"
+#include "client_connection.hpp"
+#include "epoll_reactor.hpp"
+#include "io_uring_reactor.hpp"
+#include "admission_pool.hpp"
+#include "udp_channel.hpp"
+#include "virtual_clock.hpp"
+#include "tick_scheduler.hpp"
+
+// longest wait of a welcome thread between two checks of the handshake deadlines
+#define WELCOME_POLL_MILLI 100
+// initial receive buffer of a connection waiting for its connect frame
+#define WELCOME_RECEIVER_CAPACITY 512
+// longest wait of a push client thread between two checks of the idle timeout
+#define CLIENT_PUSH_POLL_MILLI 1000
 
 namespace ASE
 {   
     // ~~~~~~~~~~~~~~~~ Declarations ~~~~~~~~~~~~~~~~
+
+    /**
+     * @brief How a server serves its connected clients
+     * 
+     */
+    enum ServerEngine {
+        ENGINE_THREAD_PER_CLIENT = 0,   // one blocking ClientRoutine thread per client
+        ENGINE_EPOLL_REACTOR = 1,       // a few I/O threads running epoll loops (Linux only, else thread per client)
+        ENGINE_IO_URING_REACTOR = 2     // a few I/O threads driving io_uring rings (Linux only, else epoll reactor)
+    };
+
     template<typename ClientDataStructure,typename ServerDataStructure>
     class Server;
 
@@ -29,11 +62,23 @@ namespace ASE
     void ClientRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref, int my_id);
 
     template<typename ClientDataStructure,typename ServerDataStructure>
-    void WelcomeRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref);
+    void WelcomeRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref, int shard);
+
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    void AdmitClient(Server<ClientDataStructure,ServerDataStructure> &server_ref, SOCKET client_socket, SOCKADDR_IN client_addr, Frame &client_hello, int shard, SharedMemoryLink *local_link = nullptr);
 
     template<typename ClientDataStructure,typename ServerDataStructure>
     void MainServeurRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref);
 
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    void SharedMemoryClientRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref, int my_id);
+
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    void ClientPushRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref, int my_id);
+
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    void LocalAcceptRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref);
+
     template<typename ClientDataStructure,typename ServerDataStructure>
     void LocalInputRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref);
 
@@ -48,9 +93,20 @@ namespace ASE
 
         SOCKET server_socket;
         SOCKADDR_IN server_socket_addr_in;
+        std::vector<SOCKET> listening_sockets_;     // one per acceptor shard, server_socket is the first
+
+        // ~~~~ Welcome Threads, one per acceptor shard ~~~~
+        std::vector<std::thread> welcome_threads;
+
+        AdmissionPool admission_pool_;      // ends the handshakes started by the welcome threads
 
-        // ~~~~ Welcome Thread ~~~~
-        std::thread welcome_thread;
+        UdpChannel udp_channel_;            // unreliable side channel, bound next to the listener if udp_enabled
+
+        VirtualClock clock_;                // main thread delay and timeouts, virtual for headless simulations
+        TickScheduler tick_scheduler_;      // deadlines of the main thread ticks, on clock_
+
+        SOCKET local_socket_;               // Unix socket of local_socket_path, INVALID_SOCKET if none
+        std::thread local_accept_thread_;
         
         bool welcome_thread_running;
         std::mutex welcome_thread_running_mutex;
@@ -85,13 +141,21 @@ namespace ASE
         ClientList<ClientDataStructure> client_list_;
         // std::shared_mutex client_list_lock_;
 
+        #if defined(__linux__)
+        std::unique_ptr<EpollReactor<ClientDataStructure,ServerDataStructure>> reactor_;
+        std::unique_ptr<IoUringReactor<ClientDataStructure,ServerDataStructure>> uring_reactor_;
+        #endif
+
         
 
 
     public:
-        std::function<void(Server<ClientDataStructure,ServerDataStructure> &server_ref)> global_routine_lambda; 
-        std::function<void(Server<ClientDataStructure,ServerDataStructure> &server_ref, const std::vector<uint8_t> &data, int my_id)> client_routine_data_recv_lambda;
+        std::function<void(Server<ClientDataStructure,ServerDataStructure> &server_ref)> global_routine_lambda;    // simulate phase of each tick
+        std::function<void(Server<ClientDataStructure,ServerDataStructure> &server_ref)> pre_input_lambda;         // optional, first phase of each tick: take the inputs received since the last one
+        std::function<void(Server<ClientDataStructure,ServerDataStructure> &server_ref)> build_snapshot_lambda;    // optional, phase after the simulation: queue the state to send, pushed and flushed right after
+        std::function<void(Server<ClientDataStructure,ServerDataStructure> &server_ref, std::span<const uint8_t> data, int my_id)> client_routine_data_recv_lambda;
         std::function<void(Server<ClientDataStructure,ServerDataStructure> &server_ref, Frame &to_send, int my_id)> client_routine_data_to_send_lambda;   
+        std::function<void(Server<ClientDataStructure,ServerDataStructure> &server_ref, std::span<const uint8_t> data, int my_id)> unreliable_data_recv_lambda;  // DATA received unreliably by UDP, called by the channel thread (also calling client_routine_data_recv_lambda for the reliable ones)
 
         std::function<std::tuple<bool, Message>(Server<ClientDataStructure,ServerDataStructure> &server_ref, Message client_message, SOCKADDR_IN client_addr_infos)> connection_control_lambda; 
         std::function<void(Server<ClientDataStructure,ServerDataStructure> &server_ref, Message &to_send)> init_client_and_prepare_package_to_send_lambda; 
@@ -102,7 +166,38 @@ namespace ASE
         int timeout_limit;
         int server_id;
         int number_max_of_remote_command_threads;
-        int main_thread_delay_milli;
+        int main_thread_delay_milli;        // period of the main thread ticks if tick_rate is 0
+
+        // ~~~~ Main thread ticks, to set before launchThreads ~~~~
+        int tick_rate;                      // ticks per second, 0 for one tick each main_thread_delay_milli
+        TickCatchUpPolicy tick_policy;      // ticks late after a long one run back to back, or skipped
+        int max_catch_up_ticks;
+
+        // ~~~~ Compression, negotiated with clients offering it ~~~~
+        bool compression_enabled;
+        std::size_t compression_threshold;                                  // frames smaller than this are sent raw
+        std::shared_ptr<const CompressionDictionary> compression_dictionary;  // used if the client has the same one
+
+        bool wire_v2_enabled;       // accept the varint framing with clients offering it
+        bool push_enabled;          // push frames each tick to the clients offering it, instead of answering theirs (Linux only, not with shared memory)
+
+        ConnectionLimits limits;    // sizes accepted from clients, bigger messages are fragmented by them
+        SendQueueLimits send_queue_limits;  // caps of the internal messages waiting for each client, and the policy of a slow client (set before it is admitted)
+
+        // ~~~~ Engine, to set before launchThreads ~~~~
+        ServerEngine engine;
+        int reactor_threads;        // I/O threads of the reactor engines
+        int acceptor_shards;        // listening sockets sharing the port with SO_REUSEPORT, each one with its welcome thread (Linux only)
+
+        // ~~~~ Admission, to set before launchThreads ~~~~
+        int admission_threads;      // threads running connection_control_lambda and init_client_and_prepare_package_to_send_lambda, which must be thread safe
+        int max_pending_handshakes; // connections of a shard waiting for their connect frame or their admission, the next ones wait in the listen backlog
+
+        // ~~~~ Unreliable channel, to set before Start ~~~~
+        bool udp_enabled;           // bind a UDP socket on the port of the listener and offer it to the clients
+
+        // ~~~~ Co-located processes, to set before Start ~~~~
+        std::string local_socket_path;  // Unix socket accepting the clients of the same host, offered shared memory rings, empty for none (Linux only)
         
         
 
@@ -111,7 +206,7 @@ namespace ASE
          * @brief Create a server, which must be started 
          * 
          */
-        Server(/* args */)
+        Server(/* args */): tick_scheduler_(clock_)
         {
             welcome_thread_running = true;
             welcome_thread_welcoming = true;
@@ -119,6 +214,20 @@ namespace ASE
             server_id = 0;
             number_max_of_remote_command_threads = 2;
             main_thread_delay_milli = 10;
+            tick_rate = 0;
+            tick_policy = TICK_CATCH_UP;
+            max_catch_up_ticks = 5;
+            compression_enabled = false;
+            compression_threshold = 128;
+            wire_v2_enabled = true;
+            push_enabled = true;
+            engine = ENGINE_THREAD_PER_CLIENT;
+            reactor_threads = std::max(1, int(std::thread::hardware_concurrency()));
+            acceptor_shards = 1;
+            admission_threads = 4;
+            max_pending_handshakes = 1024;
+            udp_enabled = false;
+            local_socket_ = INVALID_SOCKET;
         }
         // ~Server();
 
@@ -136,6 +245,47 @@ namespace ASE
             return server_socket;
         }
 
+        /**
+         * @brief Get the listening socket of an acceptor shard
+         * 
+         * @param shard 
+         * @return SOCKET 
+         */
+        inline SOCKET getSocket(int shard) const
+        {
+            return listening_sockets_[shard];
+        }
+
+        /**
+         * @brief Get the Unix socket accepting the clients of the same host
+         * 
+         * @return SOCKET INVALID_SOCKET if local_socket_path was not set or could not be bound
+         */
+        inline SOCKET getLocalSocket() const
+        {
+            return local_socket_;
+        }
+
+        /**
+         * @brief Get the number of handshakes waiting for or in the admission pool <Thread Safe>
+         * 
+         * @return std::size_t 
+         */
+        inline std::size_t getAdmissionPendingCount() const
+        {
+            return admission_pool_.getPendingCount();
+        }
+
+        /**
+         * @brief Get the number of acceptor shards, each one accepting clients on its own listening socket
+         * 
+         * @return int 
+         */
+        inline int getAcceptorShardCount() const
+        {
+            return int(listening_sockets_.size());
+        }
+
         /**
          * @brief Get the Timeout Limit of server sockets
          * 
@@ -185,6 +335,48 @@ namespace ASE
             return client_list_;
         }
 
+        /**
+         * @brief Get the unreliable side channel, open if udp_enabled was set and the port could be bound
+         * 
+         * @return UdpChannel& 
+         */
+        UdpChannel &getUdpChannel()
+        {
+            return udp_channel_;
+        }
+
+        /**
+         * @brief Get the clock of the main thread delay and the timeouts, set it virtual before launchThreads
+         * to run a simulation faster than real time
+         * 
+         * @return VirtualClock& 
+         */
+        VirtualClock &getClock()
+        {
+            return clock_;
+        }
+
+        /**
+         * @brief Get the scheduler of the main thread ticks, for its tick number and its measures 
+         * (overruns, jitter, work time of each phase)
+         * 
+         * @return TickScheduler& 
+         */
+        TickScheduler &getTickScheduler()
+        {
+            return tick_scheduler_;
+        }
+
+        /**
+         * @brief Get the number of the tick run by the main thread <Thread Safe>
+         * 
+         * @return uint64_t 
+         */
+        uint64_t getTick() const
+        {
+            return tick_scheduler_.getTick();
+        }
+
         /**
          * @brief Get the number Of clients in client_list
          * 
@@ -195,6 +387,194 @@ namespace ASE
             return client_list_.getNumberOfClients();
         }
 
+        /**
+         * @brief Get the number of threads serving the connected clients
+         * 
+         * @return std::size_t 
+         */
+        std::size_t getEngineThreadCount()
+        {
+            #if defined(__linux__)
+            if(reactor_ != nullptr)
+            {
+                return reactor_->getThreadCount();
+            }
+
+            if(uring_reactor_ != nullptr)
+            {
+                return uring_reactor_->getThreadCount();
+            }
+            #endif
+
+            return std::size_t(getNumberOfClients());
+        }
+
+        /**
+         * @brief Give a client whose connect frame arrived to the admission pool, which ends its handshake <Thread Safe>
+         * 
+         * @param client_socket blocking socket of the client
+         * @param client_addr 
+         * @param client_hello connect frame received
+         * @param shard acceptor shard which accepted the client
+         */
+        void admitClient(SOCKET client_socket, SOCKADDR_IN client_addr, Frame client_hello, int shard)
+        {
+            admission_pool_.submit([this, client_socket, client_addr, client_hello = std::move(client_hello), shard]() mutable {
+                AdmitClient(*this, client_socket, client_addr, client_hello, shard);
+            });
+        }
+
+        /**
+         * @brief Give a client who finished its handshake to the engine
+         * 
+         * @param client_id 
+         * @param shard acceptor shard which accepted the client, -1 for none
+         */
+        void serveClient(int client_id, int shard = -1)
+        {
+            #if defined(__linux__)
+            // a futex wait cannot be polled by the reactors, such a client has its own thread whatever the engine
+            bool shared_memory = false;
+            client_list_.getClientAccess(client_id, [&](auto &client){
+                shared_memory = client.getSharedMemoryLink() != nullptr;
+            });
+
+            if(shared_memory)
+            {
+                std::thread shared_memory_thread(SharedMemoryClientRoutine<ClientDataStructure, ServerDataStructure>, std::ref(*this), client_id);
+
+                client_list_.getClientAccess(client_id, [&](auto &client){
+                    client.setThread(shared_memory_thread.get_id());
+                });
+
+                shared_memory_thread.detach();
+                return;
+            }
+
+            // sharded: a shard's clients share a reactor thread, else the least loaded one is used
+            int worker = getAcceptorShardCount() > 1 ? shard : -1;
+
+            if(reactor_ != nullptr)
+            {
+                reactor_->addClient(client_id, worker);
+                return;
+            }
+
+            if(uring_reactor_ != nullptr)
+            {
+                uring_reactor_->addClient(client_id, worker);
+                return;
+            }
+
+            // the client thread also waits for the push notifications
+            bool push = false;
+            client_list_.getClientAccess(client_id, [&](auto &client){
+                push = client.getPushFd() >= 0;
+            });
+
+            if(push)
+            {
+                std::thread push_thread(ClientPushRoutine<ClientDataStructure, ServerDataStructure>, std::ref(*this), client_id);
+
+                client_list_.getClientAccess(client_id, [&](auto &client){
+                    client.setThread(push_thread.get_id());
+                });
+
+                push_thread.detach();
+                return;
+            }
+            #endif
+
+            std::thread new_client_thread(ClientRoutine<ClientDataStructure, ServerDataStructure>, std::ref(*this), client_id);
+           
+            client_list_.getClientAccess(client_id, [&](auto &client){
+                client.setThread(new_client_thread.get_id());
+            });
+
+            new_client_thread.detach();
+        }
+
+        #if defined(__linux__)
+        /**
+         * @brief Open a connection to the server from the same process, through a pair of in-process byte rings: 
+         * no socket, no port, no system call while both sides are busy, for bots and tests. The server end goes 
+         * through the usual handshake by the admission pool, the connection is then served by its own thread 
+         * like the shared memory clients. Needs launchThreads, Start is only needed for remote clients (Linux only) <Thread Safe>
+         * 
+         * @return SharedMemoryLink client end, to give to ServerLink::connectLink
+         */
+        SharedMemoryLink connectLocal()
+        {
+            SharedMemoryLink client_end;
+            auto server_end = std::make_shared<SharedMemoryLink>();
+            SharedMemoryLink::createLocalPair(client_end, *server_end);
+
+            SOCKADDR_IN local_addr = { 0, 0, 0, 0 };
+            local_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            local_addr.sin_family = AF_INET;
+
+            // the connect frame is sent by the client right after, the end is closed with the job if it is not accepted
+            admission_pool_.submit([this, server_end, local_addr]() {
+                Frame client_hello;
+                try
+                {
+                    FrameReceiver receiver;
+                    receiver.setLimits(limits);
+
+                    FrameView hello_view;
+                    auto start = getClock().now();
+                    while(!server_end->recvFrameView(receiver, hello_view))
+                    {
+                        if(getClock().now() - start >= std::chrono::seconds(getTimeoutLimit()))
+                        {
+                            throw RemoteConnectionException("Timeout during connect frame receiving");
+                        }
+                    }
+                    client_hello = hello_view.toFrame();
+                }
+                catch(const std::exception& e)
+                {
+                    std::cerr << e.what() << '\n';
+                    return;
+                }
+
+                AdmitClient(*this, INVALID_SOCKET, local_addr, client_hello, 0, server_end.get());
+            });
+
+            return client_end;
+        }
+        #endif
+
+        /**
+         * @brief Give a client of the same host to the admission pool, which waits for its connect frame
+         * then ends its handshake, no welcome thread polls it <Thread Safe>
+         * 
+         * @param client_socket blocking Unix socket of the client
+         */
+        void admitLocalClient(SOCKET client_socket)
+        {
+            SOCKADDR_IN local_addr = { 0, 0, 0, 0 };
+            local_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            local_addr.sin_family = AF_INET;
+
+            // the connect frame is sent by the client right after connecting
+            admission_pool_.submit([this, client_socket, local_addr]() {
+                Frame client_hello;
+                try
+                {
+                    client_hello = recvFrame(client_socket, WIRE_V1, limits);
+                }
+                catch(const std::exception& e)
+                {
+                    std::cerr << e.what() << '\n';
+                    closesocket(client_socket);
+                    return;
+                }
+
+                AdmitClient(*this, client_socket, local_addr, client_hello, 0);
+            });
+        }
+
         /**
          * @brief Get main_thread_delay_milli
          * 
@@ -267,6 +647,22 @@ namespace ASE
         }
 
         
+        /**
+         * @brief Add to the frame of a client the state as a snapshot, encoded as a delta against the 
+         * newest snapshot the client acknowledged (full if none), to use in client_routine_data_to_send_lambda
+         * 
+         * @param client_id client receiving the frame
+         * @param to_send frame of the client
+         * @param state full state of the world for this client
+         */
+        void addSnapshot(int client_id, Frame &to_send, std::span<const uint8_t> state)
+        {
+            client_list_.getClientAccess(client_id, [&](auto &client){
+                to_send.addMessage(client.getSnapshotEncoder().encode(state));
+            });
+        }
+
+
         // ~~~~~~~~~~ INTERNAL MESSAGES ~~~~~~~~~~
 
         /**
@@ -276,8 +672,9 @@ namespace ASE
          */
         void sendInternalMessageToAllClients(InternalMessage msg)
         {
+            auto now = clock_.now();
             client_list_.forEach([&](auto &client){
-                client.giveInternalMessage(msg);
+                client.giveInternalMessage(msg, now);
             });
         }
 
@@ -289,9 +686,125 @@ namespace ASE
          */
         void sendInternalMessageToClient(int client_id, InternalMessage msg)
         {
+            auto now = clock_.now();
+            client_list_.getClientAccess(client_id, [&](auto &client){
+                client.giveInternalMessage(msg, now);
+            });
+        }
+
+        /**
+         * @brief Get the depth and the counters of the internal messages waiting for a client <Thread Safe>
+         * 
+         * @param client_id 
+         * @return SendQueueStats 
+         */
+        SendQueueStats getSendQueueStats(int client_id)
+        {
+            SendQueueStats output;
             client_list_.getClientAccess(client_id, [&](auto &client){
-                client.giveInternalMessage(msg);
+                output = client.getSendQueueStats();
             });
+            return output;
+        }
+
+        /**
+         * @brief Wake the engine of each client served by push, so that it sends its frame now.
+         * Done by the main thread in the flush phase of each tick
+         * 
+         */
+        void pushFrames()
+        {
+            client_list_.forEach([&](auto &client){
+                client.notifyPush();
+            });
+        }
+
+        /**
+         * @brief Send the messages of a frame to all connected clients, 
+         * they are serialized only once and shared by all client threads
+         * 
+         * @param messages frame holding the messages to broadcast
+         * @param state_key if not -1, a client whose send queue is full only keeps the newest broadcast with this key
+         * @param droppable a client whose send queue is full may drop it
+         */
+        void broadcastFrame(const Frame &messages, int state_key = -1, bool droppable = false)
+        {
+            broadcast(makeWireBuffer(messages.getMessagesConstRef()), state_key, droppable);
+        }
+
+        /**
+         * @brief Send already serialized messages to all connected clients, see broadcastFrame
+         * 
+         * @param wire 
+         * @param state_key 
+         * @param droppable 
+         */
+        void broadcast(SharedWireBuffer wire, int state_key = -1, bool droppable = false)
+        {
+            InternalMessage message = CreateBroadcastInternalMessage(std::move(wire));
+            message.setStateKey(state_key).setDroppable(droppable);
+            sendInternalMessageToAllClients(std::move(message));
+        }
+
+        /**
+         * @brief Queue a frame to a client on the unreliable channel, sent at the next flushUnreliable 
+         * (done by the main thread in the flush phase of each tick). It may be lost, and is dropped by the client 
+         * if a newer one arrived before. Throw std::length_error if it does not fit in a datagram
+         * 
+         * @param client_id 
+         * @param frame 
+         * @return true if queued, false if the client has no unreliable channel or did not use it yet
+         */
+        bool sendUnreliable(int client_id, Frame &frame)
+        {
+            return udp_channel_.queueFrame(client_id, frame);
+        }
+
+        /**
+         * @brief Queue a frame to all clients on the unreliable channel, see sendUnreliable
+         * 
+         * @param frame 
+         * @return std::size_t number of clients it was queued to
+         */
+        std::size_t broadcastUnreliable(Frame &frame)
+        {
+            return udp_channel_.queueFrameToAll(frame);
+        }
+
+        /**
+         * @brief Send data to a client on the reliable channels of the UDP side channel: retransmitted until 
+         * acknowledged, without the lost messages of the other clients or channels holding it back like on TCP.
+         * Sent by the next flushUnreliable calls. Throw std::length_error if bigger than RELIABLE_MAX_PAYLOAD_SIZE
+         * 
+         * @param client_id 
+         * @param data 
+         * @param data_size 
+         * @param channel ordered or not
+         * @return true if queued, false if the client has no unreliable channel
+         */
+        bool sendReliable(int client_id, const void *data, std::size_t data_size, ReliableChannel channel = CHANNEL_RELIABLE_ORDERED)
+        {
+            return udp_channel_.queueReliable(client_id, Message(DATA, data, data_size), channel);
+        }
+
+        /**
+         * @brief Send data to all clients on the reliable channels, see sendReliable
+         * 
+         * @return std::size_t number of clients it was queued to
+         */
+        std::size_t broadcastReliable(const void *data, std::size_t data_size, ReliableChannel channel = CHANNEL_RELIABLE_ORDERED)
+        {
+            return udp_channel_.queueReliableToAll(Message(DATA, data, data_size), channel);
+        }
+
+        /**
+         * @brief Send the queued unreliable frames and what the reliable channels must send, by batches of datagrams
+         * 
+         * @return std::size_t number of datagrams sent
+         */
+        std::size_t flushUnreliable()
+        {
+            return udp_channel_.flush();
         }
 
         /**
@@ -325,13 +838,10 @@ namespace ASE
         */
         void Start(int port, int queue_length)
         {
-            SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
-            if(sock == INVALID_SOCKET)
-            {
-                std::cerr << "Error during server start: " << strerror(errno);
-                exit(errno);
-            }
-
+            int nb_shards = 1;
+            #if defined(__linux__)
+            nb_shards = std::max(1, acceptor_shards);
+            #endif
 
             SOCKADDR_IN sin = { 0, 0, 0, 0 }; /* initialise la structure avec des 0 */
 
@@ -340,28 +850,80 @@ namespace ASE
             sin.sin_port = htons(port); /* on utilise htons pour le port */
             sin.sin_family = AF_INET;
 
+            for(int shard = 0; shard < nb_shards; shard++)
+            {
+                SOCKET sock = socket(AF_INET, SOCK_STREAM, 0);
+                if(sock == INVALID_SOCKET)
+                {
+                    std::cerr << "Error during server start: " << strerror(errno);
+                    exit(errno);
+                }
 
-            
-            #ifdef WIN32
-            DWORD timeout = timeout_limit * 1000;
-            setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
-            
-            #elif defined(__linux__)
-                struct timeval tv;
-                tv.tv_sec = timeout_limit;
-                tv.tv_usec = 0;
-                setsockopt(server_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-            #endif
-            
+                
+                #ifdef WIN32
+                DWORD timeout = timeout_limit * 1000;
+                setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+                
+                #elif defined(__linux__)
+                    struct timeval tv;
+                    tv.tv_sec = timeout_limit;
+                    tv.tv_usec = 0;
+                    setsockopt(server_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+
+                    // all shards bind the same port, the kernel spreads the incoming connections between them
+                    if(nb_shards > 1)
+                    {
+                        int yes = 1;
+                        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (const char*)&yes, sizeof(int));
+                    }
+                #endif
+                
 
-            bind(sock, (SOCKADDR*)&sin, sizeof(sin));
+                if(bind(sock, (SOCKADDR*)&sin, sizeof(sin)) != 0 && nb_shards > 1)
+                {
+                    std::cerr << "Error during acceptor shard " << shard << " start: " << strerror(errno);
+                    exit(errno);
+                }
 
-            
-            listen(sock, queue_length);
+                
+                listen(sock, queue_length);
+
+                listening_sockets_.push_back(sock);
+            }
 
-            server_socket = sock;
+            server_socket = listening_sockets_[0];
             server_socket_addr_in = sin;
 
+            // same port number, over UDP
+            if(udp_enabled && !udp_channel_.open(sin))
+            {
+                std::cerr << "Error during unreliable channel start: " << strerror(errno) << ", clients stay on TCP only\n";
+                udp_enabled = false;
+            }
+
+            #if defined(__linux__)
+            if(!local_socket_path.empty())
+            {
+                struct sockaddr_un local_addr = {};
+                local_addr.sun_family = AF_UNIX;
+                strncpy(local_addr.sun_path, local_socket_path.c_str(), sizeof(local_addr.sun_path) - 1);
+
+                // left by a previous run
+                unlink(local_socket_path.c_str());
+
+                local_socket_ = socket(AF_UNIX, SOCK_STREAM, 0);
+                if(local_socket_ == INVALID_SOCKET || bind(local_socket_, (SOCKADDR*)&local_addr, sizeof(local_addr)) != 0 || listen(local_socket_, queue_length) != 0)
+                {
+                    std::cerr << "Error during local socket start: " << strerror(errno) << ", clients of the host stay on TCP\n";
+                    if(local_socket_ != INVALID_SOCKET)
+                    {
+                        closesocket(local_socket_);
+                    }
+                    local_socket_ = INVALID_SOCKET;
+                }
+            }
+            #endif
+
             printf("ready listening...\n");
 
             
@@ -374,11 +936,30 @@ namespace ASE
         void CloseFromCommand()
         {
             std::string leave_message = "serveur closed";
-            sendInternalMessageToAllClients(InternalMessage(KICK_YOU,std::vector<uint8_t>(leave_message.begin(), leave_message.end())));
+            sendInternalMessageToAllClients(CreateKickInternalMessage(std::vector<uint8_t>(leave_message.begin(), leave_message.end())));
 
             setWelcomeThreadRunning(false);
-            closesocket(server_socket);
-            welcome_thread.join();
+            for(SOCKET sock : listening_sockets_)
+            {
+                closesocket(sock);
+            }
+            for(std::thread &welcome_thread : welcome_threads)
+            {
+                welcome_thread.join();
+            }
+            #if defined(__linux__)
+            if(local_socket_ != INVALID_SOCKET)
+            {
+                // wakes the blocking accept
+                shutdown(local_socket_, SHUT_RDWR);
+                local_accept_thread_.join();
+                closesocket(local_socket_);
+                unlink(local_socket_path.c_str());
+            }
+            #endif
+
+            admission_pool_.stop();
+            udp_channel_.stop();
         }
 
         /**
@@ -387,7 +968,71 @@ namespace ASE
          */
         void launchThreads()
         {
-            welcome_thread = std::move(std::thread(WelcomeRoutine<ClientDataStructure,ServerDataStructure>,std::ref(*this)));
+            #if defined(__linux__)
+            if(engine == ENGINE_IO_URING_REACTOR)
+            {
+                try
+                {
+                    uring_reactor_ = std::make_unique<IoUringReactor<ClientDataStructure,ServerDataStructure>>(*this, reactor_threads);
+                    uring_reactor_->start();
+                }
+                catch(const std::exception& e)
+                {
+                    // kernel without io_uring (or too old for the features used)
+                    std::cout << "io_uring engine unavailable (" << e.what() << "), epoll reactor used\n";
+                    engine = ENGINE_EPOLL_REACTOR;
+                }
+            }
+
+            if(engine == ENGINE_EPOLL_REACTOR)
+            {
+                reactor_ = std::make_unique<EpollReactor<ClientDataStructure,ServerDataStructure>>(*this, reactor_threads);
+                reactor_->start();
+            }
+            #endif
+
+            if(udp_channel_.isOpen())
+            {
+                udp_channel_.start([this](int client_id, const MessageView &message, bool reliable){
+                    // control traffic stays on TCP, only DATA is taken from datagrams
+                    if(message.getHat() != DATA)
+                    {
+                        return;
+                    }
+
+                    // reliable messages go to the same hook as the ones received by TCP
+                    if(reliable)
+                    {
+                        client_routine_data_recv_lambda(*this, message.getData(), client_id);
+                    }
+                    else if(unreliable_data_recv_lambda)
+                    {
+                        unreliable_data_recv_lambda(*this, message.getData(), client_id);
+                    }
+                });
+            }
+
+            admission_pool_.start(admission_threads);
+
+            for(int shard = 0; shard < getAcceptorShardCount(); shard++)
+            {
+                welcome_threads.emplace_back(WelcomeRoutine<ClientDataStructure,ServerDataStructure>, std::ref(*this), shard);
+            }
+
+            if(local_socket_ != INVALID_SOCKET)
+            {
+                local_accept_thread_ = std::thread(LocalAcceptRoutine<ClientDataStructure,ServerDataStructure>, std::ref(*this));
+            }
+
+            if(tick_rate > 0)
+            {
+                tick_scheduler_.setPeriod(std::chrono::duration_cast<VirtualClock::Clock::duration>(std::chrono::duration<double>(1.0 / tick_rate)));
+            }
+            else
+            {
+                tick_scheduler_.setPeriod(std::chrono::milliseconds(main_thread_delay_milli));
+            }
+            tick_scheduler_.setCatchUpPolicy(tick_policy, max_catch_up_ticks);
 
             main_thread = std::move(std::thread(MainServeurRoutine<ClientDataStructure,ServerDataStructure>, std::ref(*this)));
             main_thread.detach();
@@ -425,9 +1070,10 @@ namespace ASE
     void disconnectClient(Server<ClientDataStructure,ServerDataStructure> &server_ref, int client_id)
     {
         server_ref.getClientList().getClientAccess(client_id,[&](auto &client){
-            closesocket(client.getSocket());
+            client.closeSocket();
         });
 
+        server_ref.getUdpChannel().unregisterClient(client_id);
         server_ref.getClientList().removeClient(client_id);
         server_ref.announceRemoveClient(client_id);
 
@@ -452,24 +1098,18 @@ namespace ASE
     template<typename ClientDataStructure,typename ServerDataStructure>
     void ClientRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref, int my_id)
     {
-        
-        SOCKET my_socket = 0;
-        server_ref.getClientList().getClientAccess(my_id,[&](auto &client){
-            my_socket = client.getSocket();
-        });
-
+        // owned by the connection for its whole life, so its buffers capacity is reused at each tick
+        ClientConnection<ClientDataStructure,ServerDataStructure> connection(server_ref, my_id);
 
         while (true)
         {
             
-
-            Frame to_send;
-            Frame recv_from_client;
+            FrameView recv_from_client;
             
             try
             {
 
-                recv_from_client = recvFrame(my_socket);
+                recv_from_client = connection.receiver.recvFrameView();
                 
             }
             catch(const std::exception& e)
@@ -481,216 +1121,250 @@ namespace ASE
                 disconnectClient(server_ref, my_id);
                 return;
             }
-            
-            const std::vector<Message> message_list_from_client = recv_from_client.getMessagesConstRef();
-            std::vector<uint8_t> end_data_to_send;
 
-            for(const Message &message : message_list_from_client)
+            bool keep_connection = false;
+            try
             {
-                
-                switch (message.getHat())
-                {
-                case DATA:
-                    server_ref.client_routine_data_recv_lambda(server_ref, message.getDataConstRef(), my_id);
-                    break;
-                
-                case DISCONNECT:
-
-                    #if DEBUG
-                    std::cout << "client " << my_id << " asked for disconnection\n";
-                    #endif
+                keep_connection = processClientFrame(server_ref, connection, recv_from_client);
 
-                    
-                    server_ref.disconnection_lambda(server_ref, message.getDataConstRef(), end_data_to_send);
-
-                    to_send.addMessage(Message(DISCONNECT, std::move(end_data_to_send)));
-                    to_send.sendFrame(my_socket);
-
-
-                    disconnectClient(server_ref, my_id);
-                    return;
-                    break;
-                
-                default:
-
-                    std::cout << "client " << my_id << " sended wrong hat\n";
-                    disconnectClient(server_ref, my_id);
-                    return;
-
-                    break;
+                if(keep_connection || connection.to_send.getLength() > 0)
+                {
+                    connection.to_send.sendFrame(connection.socket, connection.compression, connection.wire_version);
                 }
             }
+            catch(const std::exception& e)
+            {
+                #if DEBUG
+                std::cout << "error during client " << my_id << " data send: "<< e.what() << "\n";
+                #endif
+                
+                keep_connection = false;
+            }
 
-            for(;;)
+            if(!keep_connection)
             {
-                InternalMessage msg;
-                server_ref.getClientList().getClientAccess(my_id, [&](auto &me){
-                    msg = me.getFirstInternalMessage();
-                });
+                disconnectClient(server_ref, my_id);
+                return;
+            }
+            
+        }
+        
+        
+    }
 
-                if(msg.getHat() == EMPTY)
-                    break;
+    /**
+     * @brief Routine function of the threads of the clients served by push, instead of ClientRoutine: waits both 
+     * for the client's frames, only read, and for the push notifications, which send the client its frame.
+     * The idle timeout is checked on the server clock (Linux only)
+     * 
+     * @tparam ClientDataStructure 
+     * @tparam ServerDataStructure 
+     * @param server_ref 
+     * @param my_id client's id
+     */
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    void ClientPushRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref, int my_id)
+    {
+        #if defined(__linux__)
+        ClientConnection<ClientDataStructure,ServerDataStructure> connection(server_ref, my_id);
+
+        auto last_activity = server_ref.getClock().now();
+        struct pollfd fds[2] = {{connection.socket, POLLIN, 0}, {connection.push_fd, POLLIN, 0}};
 
+        while (true)
+        {
+            bool keep_connection = true;
+            try
+            {
+                poll(fds, 2, CLIENT_PUSH_POLL_MILLI);
 
-                switch (msg.getHat())
+                if(fds[0].revents != 0 && connection.receiver.fill() > 0)
                 {
-                case NEWCLIENT:
-                    to_send.addMessage(Message(OCONNECT,msg.getDataCopy()));
-                    break;
-                
-                case REMOVECLIENT:
-                    to_send.addMessage(Message(ODISCONNECT,msg.getDataCopy()));
-                    break;
+                    last_activity = server_ref.getClock().now();
+
+                    FrameView recv_from_client;
+                    while(keep_connection && connection.receiver.tryParseFrameView(recv_from_client))
+                    {
+                        keep_connection = readClientFrame(server_ref, connection, recv_from_client);
+                    }
+
+                    // answer of a DISCONNECT
+                    if(!keep_connection && connection.to_send.getLength() > 0)
+                    {
+                        connection.to_send.sendFrame(connection.socket, connection.compression, connection.wire_version);
+                    }
+                }
 
-                case KICK_YOU:
-                    to_send.addMessage(Message(KICK, msg.getDataCopy()));
-                    to_send.sendFrame(my_socket);
+                if(keep_connection && fds[1].revents != 0)
+                {
+                    uint64_t value;
+                    ssize_t ignored = read(connection.push_fd, &value, sizeof(value));
+                    (void)ignored;
 
-                    disconnectClient(server_ref, my_id); 
-                    return;
-                    break;
+                    connection.to_send.clear();
+                    keep_connection = prepareClientFrame(server_ref, connection);
 
-                case CUSTOM:
-                    server_ref.internal_custom_message_analysis_lambda(server_ref, msg, to_send);
-                    break;
-                
-                default:
-                    break;
+                    if(connection.to_send.getLength() > 0)
+                    {
+                        connection.to_send.sendFrame(connection.socket, connection.compression, connection.wire_version);
+                    }
                 }
-            }
 
-            
-            server_ref.client_routine_data_to_send_lambda(server_ref, to_send, my_id);
-            try
-            {
-                
-                to_send.sendFrame(my_socket);
-                
+                if(server_ref.getClock().now() - last_activity >= std::chrono::seconds(server_ref.getTimeoutLimit()))
+                {
+                    throw RemoteConnectionException("Timeout during frame receiving");
+                }
             }
             catch(const std::exception& e)
             {
                 #if DEBUG
-                std::cout << "error during client " << my_id << " data send: "<< e.what() << "\n";
+                std::cout << "error during client " << my_id << " push: "<< e.what() << "\n";
                 #endif
-                
+
+                keep_connection = false;
+            }
+
+            if(!keep_connection)
+            {
                 disconnectClient(server_ref, my_id);
                 return;
             }
-
-            
         }
-        
-        
+        #endif
     }
 
     /**
-     * @brief Routine function of the Welcome thread
+     * @brief Routine function of the threads of the clients using shared memory rings, like ClientRoutine 
+     * but the frames go through the rings, and the idle timeout is checked on the server clock (Linux only)
      * 
      * @tparam ClientDataStructure 
      * @tparam ServerDataStructure 
      * @param server_ref 
+     * @param my_id client's id
      */
     template<typename ClientDataStructure,typename ServerDataStructure>
-    void WelcomeRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref)
+    void SharedMemoryClientRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref, int my_id)
     {
-
-        while (server_ref.getWelcomeThreadRunning())
+        #if defined(__linux__)
+        ClientConnection<ClientDataStructure,ServerDataStructure> connection(server_ref, my_id);
+        if(connection.shared_link == nullptr)
         {
-            
-            #if DEBUG
-            std::cout << "New wait\n";
-            #endif
+            disconnectClient(server_ref, my_id);
+            return;
+        }
 
-            std::tuple<SOCKET,SOCKADDR_IN> accept_out;
-            
+        auto last_activity = server_ref.getClock().now();
+
+        while (true)
+        {
+            FrameView recv_from_client;
 
             try
             {
-                accept_out = waitClient(server_ref.getSocket());
+                while(!connection.shared_link->recvFrameView(connection.receiver, recv_from_client))
+                {
+                    if(server_ref.getClock().now() - last_activity >= std::chrono::seconds(server_ref.getTimeoutLimit()))
+                    {
+                        throw RemoteConnectionException("Timeout during frame receiving");
+                    }
+                }
+                last_activity = server_ref.getClock().now();
             }
             catch(const std::exception& e)
             {
-                std::cerr << e.what() << '\n';
+                #if DEBUG
+                std::cout << "error during client " << my_id << " data recv: "<< e.what() << "\n";
+                #endif
+                
+                disconnectClient(server_ref, my_id);
                 return;
             }
-            
-            SOCKET client_socket = std::get<0>(accept_out);
-            SOCKADDR_IN client_addr = std::get<1>(accept_out);
 
-            #ifdef WIN32
-            DWORD timeout = timeout_limit * 1000;
-            setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
-            
-            #elif defined(__linux__)
-                // No tcp delay, because we use recv for little data packages
-                int yes = 1;
-                setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(int));
-
-                // Timeout
-                struct timeval tv;
-                tv.tv_sec = server_ref.timeout_limit;
-                tv.tv_usec = 0;
-                setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
-            #endif
-
-
-            if(client_socket < 0)
-            {
-                continue;       // error during connection, pass to next client waiting
-            }
-
-            #if DEBUG
-            std::cout << "New connection\n";
-            #endif
-
-            Frame client_hello;
+            bool keep_connection = false;
             try
             {
-                client_hello = recvFrame(client_socket); 
+                keep_connection = processClientFrame(server_ref, connection, recv_from_client);
+
+                if(keep_connection || connection.to_send.getLength() > 0)
+                {
+                    connection.shared_link->sendFrame(connection.to_send, connection.compression, connection.wire_version);
+                }
             }
-            catch(RemoteConnectionException& e)
+            catch(const std::exception& e)
             {
-                std::cerr << e.what() << '\n';
-                continue;
+                #if DEBUG
+                std::cout << "error during client " << my_id << " data send: "<< e.what() << "\n";
+                #endif
+                
+                keep_connection = false;
             }
-            
-              
-            message_code client_hello_code = client_hello.getMessages()[0].getHat();
 
-            if(!server_ref.getWelcomeThreadWelcoming())
+            if(!keep_connection)
             {
-                // Server currently not accepting clients
-                dontAcceptClient(client_socket, FULL);
-                continue;
+                disconnectClient(server_ref, my_id);
+                return;
             }
+        }
+        #endif
+    }
 
-            if(client_hello.getLength() != 1 || (client_hello_code != CONNECT && client_hello_code != CONNECTWINFO))
-            {
-                // Bad connect message from client
-                dontAcceptClient(client_socket, BADCODATA);
-                continue;
-            }
+    /**
+     * @brief End the handshake of a client whose connect frame arrived: connection control, roster, 
+     * capabilities answer, then the client is given to the engine. Run by the admission pool threads
+     * 
+     * @tparam ClientDataStructure 
+     * @tparam ServerDataStructure 
+     * @param server_ref 
+     * @param client_socket blocking socket of the client
+     * @param client_addr 
+     * @param client_hello connect frame received from the client
+     * @param shard acceptor shard which accepted the client
+     * @param local_link link of a client of this process (Server::connectLocal), client_socket is then INVALID_SOCKET.
+     * Taken by the client if it is accepted, else left to its owner
+     */
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    void AdmitClient(Server<ClientDataStructure,ServerDataStructure> &server_ref, SOCKET client_socket, SOCKADDR_IN client_addr, Frame &client_hello, int shard, SharedMemoryLink *local_link)
+    {
+        if(client_hello.getLength() == 0)
+        {
+            dontAcceptClient(client_socket, BADCODATA, local_link);
+            return;
+        }
 
-            #if DEBUG
-            std::cout << "Checking\n";
-            #endif
+        message_code client_hello_code = client_hello.getMessages()[0].getHat();
+
+        if(!server_ref.getWelcomeThreadWelcoming())
+        {
+            // Server currently not accepting clients
+            dontAcceptClient(client_socket, FULL, local_link);
+            return;
+        }
 
+        // optional CAPABILITIES message after the connect one
+        bool client_has_capabilities = client_hello.getLength() == 2 && client_hello.getMessages()[1].getHat() == CAPABILITIES;
+
+        if((client_hello.getLength() != 1 && !client_has_capabilities) || (client_hello_code != CONNECT && client_hello_code != CONNECTWINFO))
+        {
+            // Bad connect message from client
+            dontAcceptClient(client_socket, BADCODATA, local_link);
+            return;
+        }
+
+        #if DEBUG
+        std::cout << "Checking\n";
+        #endif
+
+        // until the client thread or reactor takes it, the socket is closed here on any error,
+        // with the client if it was registered
+        int new_client_id = -1;
+        try
+        {
             //lambda welcome decision
             auto [accept_client, message_to_client] =  server_ref.connection_control_lambda(server_ref,  client_hello.getMessages()[0], client_addr);
             if(!accept_client)
             {
-                try
-                {
-                     refuseClient(client_socket, message_to_client);
-                }
-                catch(RemoteConnectionException& e)
-                {
-                    std::cerr << e.what() << '\n';
-                }
-                
-
-                closesocket(client_socket);
-                continue;
+                refuseClient(client_socket, message_to_client, local_link);
+                return;
             }
 
 
@@ -700,9 +1374,27 @@ namespace ASE
 
 
             // ~~~~~ adding client in client list ~~~~~
-            int new_client_id = 0;
-            new_client_id = server_ref.getClientList().addClient(client_socket, "basic_client");
-            
+            new_client_id = server_ref.getClientList().addClient(client_socket, "basic_client", server_ref.send_queue_limits);
+
+            // a client not reading its socket makes the blocking sends to it fail after the grace period
+            // of a slow client (or the timeout), instead of stalling its thread
+            int send_timeout_milli = server_ref.timeout_limit * 1000;
+            if(server_ref.send_queue_limits.policy & SEND_QUEUE_DISCONNECT)
+            {
+                send_timeout_milli = std::min(send_timeout_milli, server_ref.send_queue_limits.grace_milli);
+            }
+
+            #ifdef WIN32
+            DWORD send_timeout = send_timeout_milli;
+            setsockopt(client_socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&send_timeout, sizeof(send_timeout));
+
+            #elif defined(__linux__)
+            struct timeval send_timeout;
+            send_timeout.tv_sec = send_timeout_milli / 1000;
+            send_timeout.tv_usec = (send_timeout_milli % 1000) * 1000;
+            setsockopt(client_socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&send_timeout, sizeof(send_timeout));
+            #endif
+        
             // ~~~~~ Warning all clients of the arrival (even me)~~~~~
             server_ref.announceNewClient(new_client_id);
 
@@ -711,65 +1403,339 @@ namespace ASE
             Frame init_client_frame;
 
             // Create message with client's ids list
-            std::vector<int> client_id_list = {};
+            Message client_id_list_to_send(COACCEPTED, nullptr, 0);
             server_ref.getClientList().forEach([&](auto &client){
-                client_id_list.emplace_back(client.getId());
+                client_id_list_to_send.append(int32_t(client.getId()));
             });
 
-            Message client_id_list_to_send(COACCEPTED,client_id_list.data(), client_id_list.size() * sizeof(int));
             std::cout << "sending client_id_list = " << client_id_list_to_send.toString() << "\n";
             // Create custom user connect message
             Message init_user_msg_to_send(CODATA,{});
             server_ref.init_client_and_prepare_package_to_send_lambda(server_ref, init_user_msg_to_send) ;
 
             init_client_frame.addMessage(std::move(client_id_list_to_send));
-            init_client_frame.addMessage(Message(YOURID, &new_client_id, sizeof(int)));
+            init_client_frame.add(YOURID, int32_t(new_client_id));
             init_client_frame.addMessage(std::move(init_user_msg_to_send));
 
+            // Answer the client's capabilities with the accepted ones, a client of this process has its rings already
+            bool shared_memory_accepted = local_link != nullptr;
+            if(client_has_capabilities)
+            {
+                // fields unknown by the client are left to 0: not offered
+                ConnectionCapabilities offered = decodeCapabilities(client_hello.getMessages()[1].getData());
+
+                ConnectionCapabilities accepted;
+                server_ref.getClientList().getClientAccess(new_client_id, [&](auto &client){
+                    client.setPeerLimits(offered.getLimits());
+                });
+
+                if((offered.flags & CAPABILITY_COMPRESSION) && server_ref.compression_enabled)
+                {
+                    std::shared_ptr<const CompressionDictionary> dictionary = nullptr;
+                    if(server_ref.compression_dictionary != nullptr && offered.dictionary_id == server_ref.compression_dictionary->getId())
+                    {
+                        dictionary = server_ref.compression_dictionary;
+                    }
+
+                    server_ref.getClientList().getClientAccess(new_client_id, [&](auto &client){
+                        client.getCompressionContext().enable(dictionary, server_ref.compression_threshold);
+                        accepted = client.getCompressionContext().getCapabilities();
+                    });
+                }
+
+                // the answer is still v1, the connection switches after it
+                if((offered.flags & CAPABILITY_WIRE_V2) && server_ref.wire_v2_enabled)
+                {
+                    server_ref.getClientList().getClientAccess(new_client_id, [&](auto &client){
+                        client.setWireVersion(WIRE_V2);
+                    });
+                    accepted.flags |= CAPABILITY_WIRE_V2;
+                }
+
+                // datagrams use the wire version of the connection
+                if((offered.flags & CAPABILITY_UNRELIABLE) && server_ref.getUdpChannel().isOpen())
+                {
+                    WireVersion version = (accepted.flags & CAPABILITY_WIRE_V2) ? WIRE_V2 : WIRE_V1;
+                    accepted.unreliable_token = server_ref.getUdpChannel().registerClient(new_client_id, version, server_ref.limits, offered.getLimits());
+                    accepted.flags |= CAPABILITY_UNRELIABLE;
+                }
+
+                // the client gives its shared memory once it has the answer
+                #if defined(__linux__)
+                if((offered.flags & CAPABILITY_SHARED_MEMORY) && local_link == nullptr)
+                {
+                    struct sockaddr_storage socket_addr;
+                    socklen_t socket_addr_size = sizeof(socket_addr);
+                    if(getsockname(client_socket, (SOCKADDR*)&socket_addr, &socket_addr_size) == 0 && socket_addr.ss_family == AF_UNIX)
+                    {
+                        accepted.flags |= CAPABILITY_SHARED_MEMORY;
+                        shared_memory_accepted = true;
+                    }
+                }
+
+                // the rings are read by a futex wait, which the push cannot wake
+                if((offered.flags & CAPABILITY_SERVER_PUSH) && server_ref.push_enabled && !shared_memory_accepted)
+                {
+                    bool push_accepted = false;
+                    server_ref.getClientList().getClientAccess(new_client_id, [&](auto &client){
+                        push_accepted = client.enablePush();
+                    });
+
+                    if(push_accepted)
+                    {
+                        accepted.flags |= CAPABILITY_SERVER_PUSH;
+                    }
+                }
+                #endif
+
+                accepted.setLimits(server_ref.limits);
+                init_client_frame.add(CAPABILITIES, accepted);
+            }
+
 
             // Sending initial infos to client
-            try
+            sendHandshakeFrame(init_client_frame, client_socket, local_link);
+
+            #if defined(__linux__)
+            if(shared_memory_accepted)
             {
-                init_client_frame.sendFrame(client_socket);
+                auto shared_link = std::make_unique<SharedMemoryLink>();
+                if(local_link != nullptr)
+                {
+                    *shared_link = std::move(*local_link);
+                }
+                else
+                {
+                    shared_link->accept(client_socket);
+                }
+                server_ref.getClientList().getClientAccess(new_client_id, [&](auto &client){
+                    client.setSharedMemoryLink(std::move(shared_link));
+                });
             }
-            catch(RemoteConnectionException& e)
+            #endif
+        }
+        catch(const std::exception& e)
+        {
+            std::cout << "Client admission failed: " << e.what() << "\n";
+            if(new_client_id >= 0)
             {
-                std::cout << "Client disconnected during sending initial infos\n";
+                server_ref.getUdpChannel().unregisterClient(new_client_id);
                 server_ref.getClientList().removeClient(new_client_id);
                 server_ref.announceRemoveClient(new_client_id);
+            }
 
-                closesocket(client_socket);
-                
+            closesocket(client_socket);
+            return;
+        }
+
+
+        #if DEBUG
+        std::cout << "Serve client\n";
+        #endif
+
+
+
+        // ~~~~~ Client thread or reactor ~~~~~
+        server_ref.serveClient(new_client_id, shard);
+    }
+
+    /**
+     * @brief Routine function of the Welcome threads, each one accepts the clients of an acceptor shard.
+     * Connections are accepted by batches without blocking, then each one has until timeout_limit to send
+     * its connect frame, many handshakes being in progress at once. Complete connect frames are handed to
+     * the admission pool, which ends the handshakes
+     * 
+     * @tparam ClientDataStructure 
+     * @tparam ServerDataStructure 
+     * @param server_ref 
+     * @param shard index of the listening socket accepted from
+     */
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    void WelcomeRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref, int shard)
+    {
+        // accepted connection waiting for its connect frame
+        struct PendingHandshake
+        {
+            SOCKET socket;
+            SOCKADDR_IN addr;
+            FrameReceiver receiver;
+            VirtualClock::Clock::time_point deadline;
+        };
+
+        SOCKET server_socket = server_ref.getSocket(shard);
+        setSocketBlocking(server_socket, false);
+
+        std::vector<std::unique_ptr<PendingHandshake>> pending;
+        std::vector<struct pollfd> poll_fds;
+
+        while (server_ref.getWelcomeThreadRunning())
+        {
+            // full: new connections wait in the listen backlog
+            bool accepting = pending.size() + server_ref.getAdmissionPendingCount() < std::size_t(std::max(1, server_ref.max_pending_handshakes));
+
+            poll_fds.clear();
+            poll_fds.push_back({server_socket, short(accepting ? POLLIN : 0), 0});
+            for(auto &handshake : pending)
+            {
+                poll_fds.push_back({handshake->socket, POLLIN, 0});
+            }
+
+            if(pollSockets(poll_fds.data(), poll_fds.size(), WELCOME_POLL_MILLI) < 0 && errno != EINTR)
+            {
+                std::cerr << strerror(errno) << '\n';
+                break;
+            }
+
+            auto now = server_ref.getClock().now();
+
+            // backwards, a finished handshake is replaced by the last one which was already checked
+            for(std::size_t i = pending.size(); i-- > 0;)
+            {
+                PendingHandshake &handshake = *pending[i];
+                bool finished = false;
+
+                if(poll_fds[i + 1].revents != 0)
+                {
+                    Frame client_hello;
+                    try
+                    {
+                        handshake.receiver.fill();
+                        if(handshake.receiver.tryParseFrame(client_hello))
+                        {
+                            #if DEBUG
+                            std::cout << "Connect frame received\n";
+                            #endif
+
+                            setSocketBlocking(handshake.socket, true);
+                            server_ref.admitClient(handshake.socket, handshake.addr, std::move(client_hello), shard);
+                            finished = true;
+                        }
+                    }
+                    catch(const std::exception& e)
+                    {
+                        std::cerr << e.what() << '\n';
+                        closesocket(handshake.socket);
+                        finished = true;
+                    }
+                }
+
+                if(!finished && now >= handshake.deadline)
+                {
+                    #if DEBUG
+                    std::cout << "Connect frame timeout\n";
+                    #endif
+
+                    closesocket(handshake.socket);
+                    finished = true;
+                }
+
+                if(finished)
+                {
+                    pending[i] = std::move(pending.back());
+                    pending.pop_back();
+                }
+            }
+
+            if(!accepting || (poll_fds[0].revents & POLLIN) == 0)
+            {
                 continue;
             }
 
+            std::tuple<SOCKET,SOCKADDR_IN> accept_out;
+            while(pending.size() + server_ref.getAdmissionPendingCount() < std::size_t(std::max(1, server_ref.max_pending_handshakes)))
+            {
+                try
+                {
+                    if(!tryAcceptClient(server_socket, accept_out))
+                    {
+                        break;
+                    }
+                }
+                catch(const std::exception& e)
+                {
+                    std::cerr << e.what() << '\n';
+                    break;
+                }
 
-            #if DEBUG
-            std::cout << "Launch thread\n";
-            #endif
+                SOCKET client_socket = std::get<0>(accept_out);
 
+                #ifdef WIN32
+                DWORD timeout = timeout_limit * 1000;
+                setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+                
+                #elif defined(__linux__)
+                    // No tcp delay, because we use recv for little data packages
+                    int yes = 1;
+                    setsockopt(client_socket, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(int));
+
+                    // Timeout
+                    struct timeval tv;
+                    tv.tv_sec = server_ref.timeout_limit;
+                    tv.tv_usec = 0;
+                    setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+                #endif
 
+                #if DEBUG
+                std::cout << "New connection\n";
+                #endif
 
-            // ~~~~~ Launch of client thread ~~~~~
-            std::thread new_client_thread(ClientRoutine<ClientDataStructure, ServerDataStructure>, std::ref(server_ref), new_client_id);
-           
-            server_ref.getClientList().getClientAccess(new_client_id, [&](auto &client){
-                client.setThread(new_client_thread.get_id());
-            });
+                setSocketBlocking(client_socket, false);
 
+                auto handshake = std::make_unique<PendingHandshake>(PendingHandshake{client_socket, std::get<1>(accept_out), FrameReceiver(client_socket, WELCOME_RECEIVER_CAPACITY), now + std::chrono::seconds(server_ref.timeout_limit)});
+                handshake->receiver.setLimits(server_ref.limits);
+                pending.push_back(std::move(handshake));
+            }
+        }
+
+        for(auto &handshake : pending)
+        {
+            closesocket(handshake->socket);
+        }
+    }
+    /**
+     * @brief Routine function of the local accept thread: accepts the clients of the same host on the Unix socket
+     * and gives them to the admission pool, until the socket is shut down
+     * 
+     * @tparam ClientDataStructure 
+     * @tparam ServerDataStructure 
+     * @param server_ref 
+     */
+    template<typename ClientDataStructure,typename ServerDataStructure>
+    void LocalAcceptRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref)
+    {
+        #if defined(__linux__)
+        while (server_ref.getWelcomeThreadRunning())
+        {
+            SOCKET client_socket = accept(server_ref.getLocalSocket(), nullptr, nullptr);
+            if(client_socket == INVALID_SOCKET)
+            {
+                if(errno == EINTR || errno == ECONNABORTED)
+                {
+                    continue;
+                }
+                break;
+            }
+
+            // the handshake and the idle socket time out like on TCP
+            struct timeval tv;
+            tv.tv_sec = server_ref.timeout_limit;
+            tv.tv_usec = 0;
+            setsockopt(client_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
 
             #if DEBUG
-            std::cout << "Detach thread\n";
+            std::cout << "New local connection\n";
             #endif
 
-
-            new_client_thread.detach();
-            
+            server_ref.admitLocalClient(client_socket);
         }
-        
+        #endif
     }
+
     /**
-     * @brief Main thread routine, all user game logic should be done here by lambda
+     * @brief Main thread routine, all user game logic should be done here by lambda.
+     * Runs ticks at the fixed rate of the tick scheduler, on the server clock. Each tick runs its phases in order: 
+     * pre_input_lambda, global_routine_lambda, build_snapshot_lambda, then the flush of the sends 
+     * (unreliable frames queued, and frames of the clients served by push)
      * 
      * @tparam ClientDataStructure 
      * @tparam ServerDataStructure 
@@ -778,10 +1744,35 @@ namespace ASE
     template<typename ClientDataStructure,typename ServerDataStructure>
     void MainServeurRoutine(Server<ClientDataStructure,ServerDataStructure> &server_ref)
     {
+        TickScheduler &scheduler = server_ref.getTickScheduler();
         while(true)
         {
-            server_ref.global_routine_lambda(server_ref);
-            std::this_thread::sleep_for(std::chrono::milliseconds(server_ref.getMainDelayMilli()));
+            scheduler.waitNextTick();
+
+            scheduler.runPhase(TICK_PRE_INPUT, [&](){
+                if(server_ref.pre_input_lambda)
+                {
+                    server_ref.pre_input_lambda(server_ref);
+                }
+            });
+
+            scheduler.runPhase(TICK_SIMULATE, [&](){
+                server_ref.global_routine_lambda(server_ref);
+            });
+
+            scheduler.runPhase(TICK_BUILD_SNAPSHOT, [&](){
+                if(server_ref.build_snapshot_lambda)
+                {
+                    server_ref.build_snapshot_lambda(server_ref);
+                }
+            });
+
+            scheduler.runPhase(TICK_FLUSH_SENDS, [&](){
+                server_ref.flushUnreliable();
+                server_ref.pushFrames();
+            });
+
+            scheduler.endTick();
         }
     }
 
@@ -820,7 +1811,26 @@ namespace ASE
                 std::cout << "Enter id of client to kick: ";
                 std::cin >> id_to_kick;
 
-                server_ref.sendInternalMessageToClient(id_to_kick,InternalMessage(KICK_YOU, {}));
+                server_ref.sendInternalMessageToClient(id_to_kick,CreateKickInternalMessage({}));
+            }
+            else if(command.compare("queues") == 0)
+            {
+                server_ref.getClientList().forEach([&](auto &client){
+                    SendQueueStats stats = client.getSendQueueStats();
+                    std::cout << client.getId() << ": " << stats.messages << " messages, " << stats.bytes << " bytes, " << stats.coalesced << " coalesced, " 
+                              << stats.dropped << " dropped" << (stats.over ? ", over the caps" : "") << "\n";
+                });
+            }
+            else if(command.compare("ticks") == 0)
+            {
+                TickStats stats = server_ref.getTickScheduler().getStats();
+                auto micro = [](TickStats::Duration duration){
+                    return std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+                };
+
+                std::cout << "ticks: " << stats.ticks << ", overruns: " << stats.overruns << ", skipped: " << stats.skipped << "\n";
+                std::cout << "jitter (us): last " << micro(stats.last_jitter) << ", mean " << micro(stats.getMeanJitter()) << ", max " << micro(stats.max_jitter) << "\n";
+                std::cout << "work (us): last " << micro(stats.last_work) << ", max " << micro(stats.max_work) << "\n";
             }
 
             /**
@@ -0,0 +1,676 @@
+/**
+ * @file udp_channel.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef UDP_CHANNEL_HPP
+#define UDP_CHANNEL_HPP
+
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <random>
+#include <functional>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+
+#include "cross_sockets.hpp"
+#include "frame.hpp"
+#include "frame_view.hpp"
+#include "connection_limits.hpp"
+#include "unreliable_datagram.hpp"
+#include "reliable_endpoint.hpp"
+
+// datagrams read by one recvmmsg or written by one sendmmsg
+#define UDP_BATCH_SIZE 64
+// longest wait of the receiving thread before checking if it must stop
+#define UDP_RECV_TIMEOUT_MILLI 100
+
+namespace ASE
+{
+
+    /**
+     * @brief UDP socket bound next to the TCP listener, carrying frames that may be lost or reordered
+     * (high frequency state). Each client offering it gets a token in the capabilities answer, its datagrams
+     * carry the token and the address they come from is where the datagrams to it are sent.
+     * Datagrams to send are queued then written by batches at flush, the received ones are read by batches
+     * by a thread of the channel. Messages can also be sent reliably (ReliableEndpoint), acks and retransmissions
+     * being sent at flush
+     * 
+     */
+    class UdpChannel
+    {
+        public:
+            // client id and message received, reliable if delivered by the reliable channels
+            using ReceiveHandler = std::function<void(int client_id, const MessageView &message, bool reliable)>;
+
+        private:
+            /**
+             * @brief Unreliable side of a connection
+             * 
+             */
+            struct Peer
+            {
+                uint64_t token;
+                WireVersion version;
+                SOCKADDR_IN addr;
+                bool addr_known;        // a datagram came from the client, it can be answered
+                uint32_t send_sequence;
+                UnreliableReceiver receiver;
+                ReliableEndpoint reliable;
+            };
+
+            /**
+             * @brief Datagram queued until the next flush, the frame bytes can be shared by several datagrams
+             * 
+             */
+            struct Outgoing
+            {
+                SOCKADDR_IN addr;
+                std::array<uint8_t, UNRELIABLE_HEADER_SIZE> header;
+                std::shared_ptr<const std::vector<uint8_t>> frame;
+            };
+
+            SOCKET socket_;
+
+            std::unordered_map<int, Peer> peers_;
+            std::unordered_map<uint64_t, int> tokens_;
+            std::mutex peers_mutex_;
+            std::random_device token_source_;         // tokens drawn from the system's entropy, not guessable from the previous ones
+
+            std::vector<Outgoing> outgoing_;
+            std::mutex outgoing_mutex_;
+
+            std::thread recv_thread_;
+            std::atomic<bool> running_;
+
+            std::atomic<std::size_t> sent_count_;
+            std::atomic<std::size_t> send_call_count_;
+            std::atomic<std::size_t> received_count_;
+            std::atomic<std::size_t> dropped_count_;   // unknown token, too old or malformed
+
+            LossSimulator loss_;                        // used under outgoing_mutex_
+
+            /**
+             * @brief Serialize a frame without the datagram header
+             * 
+             */
+            static std::shared_ptr<const std::vector<uint8_t>> serializeUnreliableFrame(Frame &frame, WireVersion version)
+            {
+                std::vector<uint8_t> datagram;
+                encodeUnreliableDatagram(UnreliableHeader(), frame, version, datagram);
+                return std::make_shared<const std::vector<uint8_t>>(datagram.begin() + UNRELIABLE_HEADER_SIZE, datagram.end());
+            }
+
+            /**
+             * @brief Queue a datagram to a peer, peers_mutex_ held
+             * 
+             */
+            void queueTo(Peer &peer, std::shared_ptr<const std::vector<uint8_t>> frame, std::vector<Outgoing> &output)
+            {
+                UnreliableHeader header;
+                header.token = peer.token;
+                header.sequence = ++peer.send_sequence;
+
+                Outgoing datagram;
+                datagram.addr = peer.addr;
+                encodeTo(header, datagram.header.data());
+                datagram.frame = std::move(frame);
+                output.push_back(std::move(datagram));
+            }
+
+            /**
+             * @brief Pair a datagram with its client and check it, its reliable messages are given to the client's endpoint
+             * 
+             * @param datagram
+             * @param from address the datagram comes from
+             * @param client_id client who sent it
+             * @param unreliable frame carried, empty if an newer datagram was received before
+             * @param reliable messages delivered by the reliable channels
+             * @return true if the datagram is accepted
+             */
+            bool acceptDatagram(std::span<const uint8_t> datagram, const SOCKADDR_IN &from, int &client_id, FrameView &unreliable, std::vector<Message> &reliable)
+            {
+                UnreliableHeader header;
+                if(!decodeUnreliableHeader(datagram, header))
+                {
+                    return false;
+                }
+
+                std::lock_guard<std::mutex> lock(peers_mutex_);
+
+                auto token_it = tokens_.find(header.token);
+                if(token_it == tokens_.end())
+                {
+                    return false;
+                }
+
+                Peer &peer = peers_.at(token_it->second);
+                FrameView frame;
+                bool newest = false;
+                if(!peer.receiver.receive(header, datagram, frame, newest))
+                {
+                    return false;
+                }
+
+                ReliableEndpoint::Clock::time_point now = ReliableEndpoint::Clock::now();
+                for(const MessageView &message : frame)
+                {
+                    peer.reliable.receive(message, now);
+                }
+
+                Message delivered(STOP, nullptr, 0);
+                while(peer.reliable.popDelivered(delivered))
+                {
+                    reliable.push_back(std::move(delivered));
+                }
+
+                if(newest)
+                {
+                    // the newest datagram tells where the client is, even if its address changed
+                    peer.addr = from;
+                    peer.addr_known = true;
+                    unreliable = frame;
+                }
+                client_id = token_it->second;
+                return true;
+            }
+
+            /**
+             * @brief Routine of the receiving thread
+             * 
+             */
+            void recvRoutine(ReceiveHandler handler)
+            {
+                std::vector<uint8_t> buffers(std::size_t(UDP_BATCH_SIZE) * UNRELIABLE_MAX_DATAGRAM_SIZE);
+                std::array<SOCKADDR_IN, UDP_BATCH_SIZE> addrs;
+                std::vector<Message> reliable;
+
+                #if defined(__linux__)
+                std::array<struct mmsghdr, UDP_BATCH_SIZE> headers;
+                std::array<struct iovec, UDP_BATCH_SIZE> iovs;
+                #endif
+
+                while(running_)
+                {
+                    int nb_received = 0;
+
+                    #ifdef WIN32
+                    int addr_size = sizeof(addrs[0]);
+                    int size = recvfrom(socket_, (char*)buffers.data(), UNRELIABLE_MAX_DATAGRAM_SIZE, 0, (SOCKADDR*)&addrs[0], &addr_size);
+                    std::array<std::size_t, 1> sizes = { std::size_t(std::max(size, 0)) };
+                    nb_received = size > 0 ? 1 : 0;
+
+                    #elif defined(__linux__)
+                    for(int i = 0; i < UDP_BATCH_SIZE; i++)
+                    {
+                        iovs[i].iov_base = buffers.data() + std::size_t(i) * UNRELIABLE_MAX_DATAGRAM_SIZE;
+                        iovs[i].iov_len = UNRELIABLE_MAX_DATAGRAM_SIZE;
+                        std::memset(&headers[i], 0, sizeof(headers[i]));
+                        headers[i].msg_hdr.msg_iov = &iovs[i];
+                        headers[i].msg_hdr.msg_iovlen = 1;
+                        headers[i].msg_hdr.msg_name = &addrs[i];
+                        headers[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+                    }
+
+                    // waits for the first datagram (or the timeout) then takes all the others already there
+                    nb_received = recvmmsg(socket_, headers.data(), UDP_BATCH_SIZE, MSG_WAITFORONE, nullptr);
+                    #endif
+
+                    for(int i = 0; i < nb_received; i++)
+                    {
+                        #ifdef WIN32
+                        std::size_t size = sizes[i];
+                        #elif defined(__linux__)
+                        std::size_t size = headers[i].msg_len;
+                        if(headers[i].msg_hdr.msg_flags & MSG_TRUNC)
+                        {
+                            dropped_count_++;
+                            continue;
+                        }
+                        #endif
+
+                        received_count_++;
+
+                        int client_id = -1;
+                        FrameView unreliable;
+                        reliable.clear();
+                        std::span<const uint8_t> datagram(buffers.data() + std::size_t(i) * UNRELIABLE_MAX_DATAGRAM_SIZE, size);
+                        if(!acceptDatagram(datagram, addrs[i], client_id, unreliable, reliable))
+                        {
+                            dropped_count_++;
+                            continue;
+                        }
+
+                        for(const Message &message : reliable)
+                        {
+                            handler(client_id, MessageView(message.getHat(), message.getData()), true);
+                        }
+
+                        for(const MessageView &message : unreliable)
+                        {
+                            if(message.getHat() != RELIABLE && message.getHat() != RACK)
+                            {
+                                handler(client_id, message, false);
+                            }
+                        }
+                    }
+                }
+            }
+
+        public:
+            UdpChannel(): socket_(INVALID_SOCKET), running_(false),
+                          sent_count_(0), send_call_count_(0), received_count_(0), dropped_count_(0)
+            {
+
+            }
+
+            ~UdpChannel()
+            {
+                stop();
+            }
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            /**
+             * @brief Tell if the socket is bound
+             * 
+             */
+            inline bool isOpen() const
+            {
+                return socket_ != INVALID_SOCKET;
+            }
+
+            /**
+             * @brief Get the number of datagrams sent
+             * 
+             */
+            inline std::size_t getSentCount() const
+            {
+                return sent_count_;
+            }
+
+            /**
+             * @brief Get the number of system calls used to send the datagrams
+             * 
+             */
+            inline std::size_t getSendCallCount() const
+            {
+                return send_call_count_;
+            }
+
+            /**
+             * @brief Get the number of datagrams received, dropped ones included
+             * 
+             */
+            inline std::size_t getReceivedCount() const
+            {
+                return received_count_;
+            }
+
+            /**
+             * @brief Get the number of datagrams dropped: unknown token, older than the newest one of the client or malformed
+             * 
+             */
+            inline std::size_t getDroppedCount() const
+            {
+                return dropped_count_;
+            }
+
+            /**
+             * @brief Get the counters of the reliable channels of a client <Thread Safe>
+             * 
+             * @param client_id 
+             * @param output 
+             * @return true if the client has an unreliable channel
+             */
+            bool getReliableStats(int client_id, ReliableStats &output)
+            {
+                std::lock_guard<std::mutex> lock(peers_mutex_);
+
+                auto peer_it = peers_.find(client_id);
+                if(peer_it == peers_.end())
+                {
+                    return false;
+                }
+
+                output = peer_it->second.reliable.getStats();
+                return true;
+            }
+
+            /**
+             * @brief Drop a share of the datagrams sent, to test the reliable channels <Thread Safe>
+             * 
+             * @param loss_rate between 0 (none, the default) and 1
+             */
+            void setLossRate(double loss_rate)
+            {
+                std::lock_guard<std::mutex> lock(outgoing_mutex_);
+                loss_.setLossRate(loss_rate);
+            }
+
+
+            /**
+             * @brief Bind the UDP socket
+             * 
+             * @param addr address and port, the ones of the TCP listener
+             * @return true if bound
+             */
+            bool open(const SOCKADDR_IN &addr)
+            {
+                socket_ = socket(AF_INET, SOCK_DGRAM, 0);
+                if(socket_ == INVALID_SOCKET)
+                {
+                    return false;
+                }
+
+                #ifdef WIN32
+                DWORD timeout = UDP_RECV_TIMEOUT_MILLI;
+                setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+
+                #elif defined(__linux__)
+                struct timeval tv;
+                tv.tv_sec = 0;
+                tv.tv_usec = UDP_RECV_TIMEOUT_MILLI * 1000;
+                setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof(tv));
+                #endif
+
+                if(bind(socket_, (SOCKADDR*)&addr, sizeof(addr)) != 0)
+                {
+                    closesocket(socket_);
+                    socket_ = INVALID_SOCKET;
+                    return false;
+                }
+
+                return true;
+            }
+
+            /**
+             * @brief Launch the receiving thread
+             * 
+             * @param handler called by the thread for each accepted datagram
+             */
+            void start(ReceiveHandler handler)
+            {
+                running_ = true;
+                recv_thread_ = std::thread(&UdpChannel::recvRoutine, this, std::move(handler));
+            }
+
+            /**
+             * @brief Join the receiving thread and close the socket
+             * 
+             */
+            void stop()
+            {
+                running_ = false;
+                if(recv_thread_.joinable())
+                {
+                    recv_thread_.join();
+                }
+
+                if(socket_ != INVALID_SOCKET)
+                {
+                    closesocket(socket_);
+                    socket_ = INVALID_SOCKET;
+                }
+            }
+
+            /**
+             * @brief Issue the token of a client <Thread Safe>
+             * 
+             * @param client_id
+             * @param version wire version of the frames of its datagrams
+             * @param limits sizes accepted from the client
+             * @param peer_limits sizes accepted by the client
+             * @return uint64_t token to give to the client, never 0
+             */
+            uint64_t registerClient(int client_id, WireVersion version, const ConnectionLimits &limits, const ConnectionLimits &peer_limits)
+            {
+                std::lock_guard<std::mutex> lock(peers_mutex_);
+
+                uint64_t token = 0;
+                while(token == 0 || tokens_.count(token) != 0)
+                {
+                    token = (uint64_t(token_source_()) << 32) | uint64_t(token_source_());
+                }
+
+                Peer peer = { token, version, {}, false, 0, UnreliableReceiver(version, datagramLimits(limits)), ReliableEndpoint(peer_limits) };
+                peers_.insert_or_assign(client_id, std::move(peer));
+                tokens_[token] = client_id;
+
+                return token;
+            }
+
+            /**
+             * @brief Forget a client, its datagrams are dropped from now on <Thread Safe>
+             * 
+             * @param client_id
+             */
+            void unregisterClient(int client_id)
+            {
+                std::lock_guard<std::mutex> lock(peers_mutex_);
+
+                auto peer_it = peers_.find(client_id);
+                if(peer_it == peers_.end())
+                {
+                    return;
+                }
+
+                tokens_.erase(peer_it->second.token);
+                peers_.erase(peer_it);
+            }
+
+            /**
+             * @brief Queue a frame to a client until the next flush <Thread Safe>.
+             * Throw std::length_error if the frame does not fit in a datagram
+             * 
+             * @param client_id
+             * @param frame
+             * @return true if queued, false if the client has no unreliable channel or did not send a datagram yet
+             */
+            bool queueFrame(int client_id, Frame &frame)
+            {
+                std::vector<Outgoing> queued;
+                {
+                    std::lock_guard<std::mutex> lock(peers_mutex_);
+
+                    auto peer_it = peers_.find(client_id);
+                    if(peer_it == peers_.end() || !peer_it->second.addr_known)
+                    {
+                        return false;
+                    }
+
+                    queueTo(peer_it->second, serializeUnreliableFrame(frame, peer_it->second.version), queued);
+                }
+
+                std::lock_guard<std::mutex> lock(outgoing_mutex_);
+                outgoing_.push_back(std::move(queued.front()));
+                return true;
+            }
+
+            /**
+             * @brief Queue a frame to all clients able to receive it until the next flush,
+             * it is serialized once per wire version <Thread Safe>.
+             * Throw std::length_error if the frame does not fit in a datagram
+             * 
+             * @param frame
+             * @return std::size_t number of clients it was queued to
+             */
+            std::size_t queueFrameToAll(Frame &frame)
+            {
+                std::shared_ptr<const std::vector<uint8_t>> serialized[2];
+                std::vector<Outgoing> queued;
+                {
+                    std::lock_guard<std::mutex> lock(peers_mutex_);
+
+                    for(auto &[client_id, peer] : peers_)
+                    {
+                        if(!peer.addr_known)
+                        {
+                            continue;
+                        }
+
+                        std::shared_ptr<const std::vector<uint8_t>> &bytes = serialized[peer.version == WIRE_V2 ? 1 : 0];
+                        if(bytes == nullptr)
+                        {
+                            bytes = serializeUnreliableFrame(frame, peer.version);
+                        }
+                        queueTo(peer, bytes, queued);
+                    }
+                }
+
+                std::lock_guard<std::mutex> lock(outgoing_mutex_);
+                outgoing_.insert(outgoing_.end(), std::make_move_iterator(queued.begin()), std::make_move_iterator(queued.end()));
+                return queued.size();
+            }
+
+            /**
+             * @brief Queue a message to a client on its reliable channels, sent by the next flushes <Thread Safe>.
+             * Throw std::length_error if it is bigger than RELIABLE_MAX_PAYLOAD_SIZE
+             * 
+             * @param client_id 
+             * @param message 
+             * @param channel 
+             * @return true if queued, false if the client has no unreliable channel
+             */
+            bool queueReliable(int client_id, const Message &message, ReliableChannel channel)
+            {
+                std::lock_guard<std::mutex> lock(peers_mutex_);
+
+                auto peer_it = peers_.find(client_id);
+                if(peer_it == peers_.end())
+                {
+                    return false;
+                }
+
+                peer_it->second.reliable.send(message, channel);
+                return true;
+            }
+
+            /**
+             * @brief Queue a message to all clients on their reliable channels, see queueReliable <Thread Safe>
+             * 
+             * @param message 
+             * @param channel 
+             * @return std::size_t number of clients it was queued to
+             */
+            std::size_t queueReliableToAll(const Message &message, ReliableChannel channel)
+            {
+                std::lock_guard<std::mutex> lock(peers_mutex_);
+
+                for(auto &[client_id, peer] : peers_)
+                {
+                    peer.reliable.send(message, channel);
+                }
+                return peers_.size();
+            }
+
+            /**
+             * @brief Send the queued datagrams and what the reliable channels have to send (acks, retransmissions,
+             * messages the windows allow), UDP_BATCH_SIZE per system call on Linux <Thread Safe>
+             * 
+             * @return std::size_t number of datagrams sent
+             */
+            std::size_t flush()
+            {
+                std::vector<Outgoing> to_send;
+                {
+                    std::lock_guard<std::mutex> lock(peers_mutex_);
+
+                    ReliableEndpoint::Clock::time_point now = ReliableEndpoint::Clock::now();
+                    Frame frame;
+                    for(auto &[client_id, peer] : peers_)
+                    {
+                        if(!peer.addr_known)
+                        {
+                            continue;
+                        }
+
+                        while(peer.reliable.fillFrame(frame, now, peer.version))
+                        {
+                            queueTo(peer, serializeUnreliableFrame(frame, peer.version), to_send);
+                            frame.clear();
+                        }
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(outgoing_mutex_);
+                    to_send.insert(to_send.begin(), std::make_move_iterator(outgoing_.begin()), std::make_move_iterator(outgoing_.end()));
+                    outgoing_.clear();
+
+                    std::erase_if(to_send, [&](const Outgoing &){ return loss_.drop(); });
+                }
+
+                if(to_send.empty() || socket_ == INVALID_SOCKET)
+                {
+                    return 0;
+                }
+
+                std::size_t nb_sent = 0;
+
+                #ifdef WIN32
+                std::vector<uint8_t> datagram;
+                for(Outgoing &outgoing : to_send)
+                {
+                    datagram.assign(outgoing.header.begin(), outgoing.header.end());
+                    datagram.insert(datagram.end(), outgoing.frame->begin(), outgoing.frame->end());
+                    send_call_count_++;
+                    if(sendto(socket_, (const char*)datagram.data(), int(datagram.size()), 0, (SOCKADDR*)&outgoing.addr, sizeof(outgoing.addr)) > 0)
+                    {
+                        nb_sent++;
+                    }
+                }
+
+                #elif defined(__linux__)
+                std::array<struct mmsghdr, UDP_BATCH_SIZE> headers;
+                std::array<std::array<struct iovec, 2>, UDP_BATCH_SIZE> iovs;
+
+                for(std::size_t first = 0; first < to_send.size(); first += UDP_BATCH_SIZE)
+                {
+                    unsigned count = unsigned(std::min<std::size_t>(UDP_BATCH_SIZE, to_send.size() - first));
+                    for(unsigned i = 0; i < count; i++)
+                    {
+                        Outgoing &outgoing = to_send[first + i];
+                        iovs[i][0].iov_base = outgoing.header.data();
+                        iovs[i][0].iov_len = outgoing.header.size();
+                        iovs[i][1].iov_base = (void*)(outgoing.frame->data());
+                        iovs[i][1].iov_len = outgoing.frame->size();
+
+                        std::memset(&headers[i], 0, sizeof(headers[i]));
+                        headers[i].msg_hdr.msg_iov = iovs[i].data();
+                        headers[i].msg_hdr.msg_iovlen = 2;
+                        headers[i].msg_hdr.msg_name = &outgoing.addr;
+                        headers[i].msg_hdr.msg_namelen = sizeof(outgoing.addr);
+                    }
+
+                    // a datagram refused (e.g. full socket buffer) is lost like on the network, the next ones are still sent
+                    unsigned done = 0;
+                    while(done < count)
+                    {
+                        send_call_count_++;
+                        int result = sendmmsg(socket_, headers.data() + done, count - done, MSG_DONTWAIT);
+                        if(result <= 0)
+                        {
+                            done++;
+                            continue;
+                        }
+                        done += unsigned(result);
+                        nb_sent += std::size_t(result);
+                    }
+                }
+                #endif
+
+                sent_count_ += nb_sent;
+                return nb_sent;
+            }
+    };
+
+}
+
+#endif
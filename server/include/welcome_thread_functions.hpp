@@ -14,6 +14,7 @@
 #include "cross_sockets.hpp"
 #include "message_codes.hpp"
 #include "frame.hpp"
+#include "shared_ring.hpp"
 
 namespace ASE
 {
@@ -46,13 +47,102 @@ namespace ASE
 
     }
 
+    /**
+     * @brief Accept a connection without blocking, the server socket must be non-blocking
+     * 
+     * @param server_socket 
+     * @param output accepted socket and address
+     * @return true if a connection was accepted, false if none is waiting
+     */
+    inline bool tryAcceptClient(SOCKET server_socket, std::tuple<SOCKET,SOCKADDR_IN> &output)
+    {
+        SOCKADDR_IN client_addr = {0,0,0,0};
+        socklen_t client_addr_len = sizeof(client_addr);
+
+        SOCKET client_socket = accept(server_socket, (SOCKADDR*)&client_addr, &client_addr_len);
+
+        if(client_socket == INVALID_SOCKET)
+        {
+            #ifdef WIN32
+            if(WSAGetLastError() == WSAEWOULDBLOCK || WSAGetLastError() == WSAECONNRESET)
+            #elif defined(__linux__)
+            if(errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED)
+            #endif
+            {
+                return false;
+            }
+
+            throw ServerConnectionException(strerror(errno));
+        }
+
+        output = {client_socket, client_addr};
+        return true;
+    }
+
+    /**
+     * @brief Switch a socket between blocking and non-blocking mode
+     * 
+     * @param sock 
+     * @param blocking 
+     */
+    inline void setSocketBlocking(SOCKET sock, bool blocking)
+    {
+        #ifdef WIN32
+        u_long mode = blocking ? 0 : 1;
+        ioctlsocket(sock, FIONBIO, &mode);
+
+        #elif defined(__linux__)
+        int flags = fcntl(sock, F_GETFL, 0);
+        fcntl(sock, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
+        #endif
+    }
+
+    /**
+     * @brief Wait until one of the sockets is readable
+     * 
+     * @param fds sockets and the events waited, revents are filled
+     * @param count 
+     * @param timeout_milli 
+     * @return int number of sockets with events, -1 on error
+     */
+    inline int pollSockets(struct pollfd *fds, std::size_t count, int timeout_milli)
+    {
+        #ifdef WIN32
+        return WSAPoll(fds, ULONG(count), timeout_milli);
+
+        #elif defined(__linux__)
+        return poll(fds, nfds_t(count), timeout_milli);
+        #endif
+    }
+
+    /**
+     * @brief Send a frame of the handshake, through the local link of a client of this process if there is one
+     * 
+     * @param frame 
+     * @param client_socket 
+     * @param local_link nullptr for a client with a socket
+     */
+    void sendHandshakeFrame(Frame &frame, SOCKET client_socket, SharedMemoryLink *local_link)
+    {
+        #if defined(__linux__)
+        if(local_link != nullptr)
+        {
+            local_link->sendFrame(frame);
+            return;
+        }
+        #endif
+
+        frame.sendFrame(client_socket);
+    }
+
     /**
      * @brief Close the client socket after sending him a code with an explanation of why
      * 
      * @param client_socket client socket to close
      * @param reason_code can be FULL or BADCODATA
+     * @param local_link link the code goes through for a client of this process, closed by its owner
      */
-    void dontAcceptClient(SOCKET client_socket, MessageCodes reason_code)
+    void dontAcceptClient(SOCKET client_socket, MessageCodes reason_code, SharedMemoryLink *local_link = nullptr)
     {
         Frame to_send;
         Message infos(reason_code, std::vector<uint8_t>());
@@ -60,7 +150,7 @@ namespace ASE
 
         try
         {
-            to_send.sendFrame(client_socket);
+            sendHandshakeFrame(to_send, client_socket, local_link);
         }
         catch(const std::exception& e)
         {
@@ -78,14 +168,22 @@ namespace ASE
      * 
      * @param client_socket client socket to close
      * @param reason custom message by the user
+     * @param local_link link the refusal goes through for a client of this process, closed by its owner
      */
-    void refuseClient(SOCKET client_socket, Message reason)
+    void refuseClient(SOCKET client_socket, Message reason, SharedMemoryLink *local_link = nullptr)
     {
         Frame to_send;
         Message infos(COREFUSED, std::vector<uint8_t>());
         to_send.addMessage(std::move(infos));
 
-        to_send.sendFrame(client_socket);
+        try
+        {
+            sendHandshakeFrame(to_send, client_socket, local_link);
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
         
         closesocket(client_socket);
     }
@@ -0,0 +1,157 @@
+/**
+ * @file bit_stream.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef BIT_STREAM_HPP
+#define BIT_STREAM_HPP
+
+#include <stdint.h>
+#include <span>
+
+#include "payload_buffer.hpp"
+#include "message.hpp"
+#include "connection_expections.hpp"
+
+namespace ASE
+{
+
+    /**
+     * @brief Rotation, written by BitWriter with the smallest-three compression
+     * 
+     */
+    struct Quaternion
+    {
+        float x;
+        float y;
+        float z;
+        float w;
+    };
+
+    /**
+     * @brief Number of bits needed to write any value in [0, range]
+     * 
+     * @param range 
+     * @return int 
+     */
+    constexpr int bitsRequired(uint64_t range)
+    {
+        int bits = 0;
+        while(range > 0)
+        {
+            bits++;
+            range >>= 1;
+        }
+        return bits;
+    }
+
+    /**
+     * @brief Write values bit per bit at the end of a message's payload, 
+     * bits are packed from the lowest bit of each byte
+     * 
+     */
+    class BitWriter
+    {
+        private:
+            PayloadBuffer &output_;
+            std::size_t start_bit_;
+            std::size_t bit_pos_;    // position of the next bit to write in output_
+
+        public:
+
+            /**
+             * @brief Create a writer adding bits at the end of the message's data
+             * 
+             * @param message 
+             */
+            BitWriter(Message &message);
+
+            /**
+             * @brief Create a writer adding bits at the end of the buffer
+             * 
+             * @param output 
+             */
+            BitWriter(PayloadBuffer &output);
+
+            /**
+             * @brief Get the number of bits written since the creation
+             * 
+             * @return std::size_t 
+             */
+            std::size_t getBitsWritten() const;
+
+            /**
+             * @brief Write the bits lowest bits of value
+             * 
+             * @param value 
+             * @param bits between 0 and 64
+             */
+            void writeBits(uint64_t value, int bits);
+
+            void writeBool(bool value);
+
+            /**
+             * @brief Write an integer of [min, max] with just the bits the range needs
+             * 
+             */
+            void writeRangedInt(int64_t value, int64_t min, int64_t max);
+
+            /**
+             * @brief Write a float of [min, max] rounded to precision, clamped if out of range
+             * 
+             */
+            void writeQuantizedFloat(float value, float min, float max, float precision);
+
+            /**
+             * @brief Write a normalized quaternion with the smallest-three compression:
+             * index of the largest component (2 bits) and the three others on bits_per_component bits each
+             * 
+             */
+            void writeQuaternion(const Quaternion &rotation, int bits_per_component = 10);
+    };
+
+
+    /**
+     * @brief Read values written by a BitWriter
+     * 
+     */
+    class BitReader
+    {
+        private:
+            std::span<const uint8_t> input_;
+            std::size_t bit_pos_;
+
+        public:
+
+            BitReader(std::span<const uint8_t> input);
+
+            BitReader(const Message &message);
+
+            /**
+             * @brief Get the number of bits not read yet (including padding bits of the last byte)
+             * 
+             * @return std::size_t 
+             */
+            std::size_t getBitsLeft() const;
+
+            /**
+             * @brief Read bits bits, throw DataSizeException after the end of the data
+             * 
+             * @param bits between 0 and 64
+             * @return uint64_t 
+             */
+            uint64_t readBits(int bits);
+
+            bool readBool();
+
+            int64_t readRangedInt(int64_t min, int64_t max);
+
+            float readQuantizedFloat(float min, float max, float precision);
+
+            Quaternion readQuaternion(int bits_per_component = 10);
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,97 @@
+/**
+ * @file capabilities.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef CAPABILITIES_HPP
+#define CAPABILITIES_HPP
+
+#include <stdint.h>
+#include <tuple>
+#include <span>
+#include <array>
+#include <algorithm>
+
+#include "wire_schema.hpp"
+#include "connection_limits.hpp"
+
+namespace ASE
+{
+
+enum CapabilityFlags {
+  CAPABILITY_COMPRESSION = 0x1,
+  CAPABILITY_WIRE_V2 = 0x2,         // varint framing (see wire_codec.hpp) after the handshake
+  CAPABILITY_UNRELIABLE = 0x4,      // UDP side channel (see unreliable_datagram.hpp), paired with the token answered
+  CAPABILITY_SHARED_MEMORY = 0x8,   // frames through shared memory rings after the handshake (see shared_ring.hpp), Unix sockets only
+  CAPABILITY_SERVER_PUSH = 0x10     // the server sends its frames on its own schedule (each tick, or when it has messages), not as answers
+};
+
+/**
+ * @brief Optional features, offered by the client in a CAPABILITIES message next to CONNECT/CONNECTWINFO,
+ * and answered by the server with the accepted ones next to COACCEPTED
+ * 
+ */
+struct ConnectionCapabilities
+{
+    uint32_t flags = 0;
+    uint32_t dictionary_id = 0;     // compression dictionary, 0 for none
+    uint32_t max_frame_messages = 0;    // receiving limits of the sender, 0 for the default ones
+    uint32_t max_message_size = 0;
+    uint64_t unreliable_token = 0;  // answered by the server, pairs the UDP datagrams with the connection
+
+    /**
+     * @brief Advertise the receiving limits of this side
+     * 
+     * @param limits 
+     */
+    void setLimits(const ConnectionLimits &limits)
+    {
+        max_frame_messages = limits.max_frame_messages;
+        max_message_size = limits.max_message_size;
+    }
+
+    /**
+     * @brief Get the receiving limits advertised by the other side
+     * 
+     * @return ConnectionLimits default ones for the fields not advertised
+     */
+    ConnectionLimits getLimits() const
+    {
+        ConnectionLimits output;
+        if(max_frame_messages != 0)
+        {
+            output.max_frame_messages = max_frame_messages;
+        }
+        if(max_message_size != 0)
+        {
+            output.max_message_size = max_message_size;
+        }
+        return output;
+    }
+};
+
+template<>
+struct WireSchema<ConnectionCapabilities>
+{
+    static constexpr auto fields = std::make_tuple(&ConnectionCapabilities::flags, &ConnectionCapabilities::dictionary_id, 
+                                                   &ConnectionCapabilities::max_frame_messages, &ConnectionCapabilities::max_message_size,
+                                                   &ConnectionCapabilities::unreliable_token);
+};
+
+/**
+ * @brief Decode capabilities sent by any version: missing trailing fields are left to 0, 
+ * unknown trailing fields are ignored
+ * 
+ * @param data data of a CAPABILITIES message
+ * @return ConnectionCapabilities 
+ */
+inline ConnectionCapabilities decodeCapabilities(std::span<const uint8_t> data)
+{
+    std::array<uint8_t, wireSize<ConnectionCapabilities>()> padded = {};
+    std::copy_n(data.begin(), std::min(data.size(), padded.size()), padded.begin());
+    return decode<ConnectionCapabilities>(std::span<const uint8_t>(padded));
+}
+
+}
+
+#endif
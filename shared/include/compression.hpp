@@ -0,0 +1,150 @@
+/**
+ * @file compression.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <span>
+
+#include "cross_sockets.hpp"
+#include "lz_codec.hpp"
+#include "capabilities.hpp"
+#include "wire_codec.hpp"
+
+namespace ASE
+{
+
+    /**
+     * @brief Counters of a connection's compression, readable from any thread
+     * 
+     */
+    struct CompressionStats
+    {
+        std::atomic<uint64_t> frames_compressed{0};
+        std::atomic<uint64_t> frames_sent_raw{0};           // under the threshold or incompressible
+        std::atomic<uint64_t> frames_decompressed{0};
+        std::atomic<uint64_t> bytes_before_compression{0};
+        std::atomic<uint64_t> bytes_after_compression{0};
+        std::atomic<uint64_t> compression_nanoseconds{0};
+        std::atomic<uint64_t> decompression_nanoseconds{0};
+
+        /**
+         * @brief Get the compressed size / original size of the compressed frames
+         * 
+         * @return double 1 if nothing was compressed
+         */
+        double getCompressionRatio() const
+        {
+            uint64_t before = bytes_before_compression.load();
+            return before == 0 ? 1.0 : double(bytes_after_compression.load()) / double(before);
+        }
+    };
+
+
+    /**
+     * @brief Compression state of one connection, negotiated during the handshake
+     * 
+     */
+    class CompressionContext
+    {
+        private:
+            bool enabled_;
+            std::shared_ptr<const CompressionDictionary> dictionary_;
+            std::size_t threshold_;
+
+            // reused between frames
+            std::vector<uint8_t> raw_scratch_;
+            std::vector<uint8_t> compressed_scratch_;
+
+            CompressionStats stats_;
+
+        public:
+
+            /**
+             * @brief Create a disabled context
+             * 
+             */
+            CompressionContext();
+
+            /**
+             * @brief Compress the frames of the connection
+             * 
+             * @param dictionary dictionary negotiated, can be nullptr
+             * @param threshold frames smaller than this number of bytes are sent raw
+             */
+            void enable(std::shared_ptr<const CompressionDictionary> dictionary, std::size_t threshold);
+
+            void disable();
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            inline bool isEnabled() const
+            {
+                return enabled_;
+            }
+
+            inline const CompressionDictionary *getDictionary() const
+            {
+                return dictionary_.get();
+            }
+
+            inline std::shared_ptr<const CompressionDictionary> getDictionaryPtr() const
+            {
+                return dictionary_;
+            }
+
+            inline std::size_t getThreshold() const
+            {
+                return threshold_;
+            }
+
+            inline CompressionStats &getStats()
+            {
+                return stats_;
+            }
+
+            inline const CompressionStats &getStats() const
+            {
+                return stats_;
+            }
+
+            /**
+             * @brief Get the capabilities to offer or to accept for this context
+             * 
+             * @return ConnectionCapabilities 
+             */
+            ConnectionCapabilities getCapabilities() const;
+
+
+            /**
+             * @brief Compress the serialized frame described by iov
+             * 
+             * @param iov buffers of the raw frame
+             * @param iov_count 
+             * @param raw_size total size of the raw frame
+             * @param version wire version of the connection, gives the compressed frame header
+             * @return std::span<const uint8_t> compressed frame header and compressed bytes, empty if the frame must be sent raw
+             */
+            std::span<const uint8_t> compressFrame(const struct iovec *iov, std::size_t iov_count, std::size_t raw_size, WireVersion version = WIRE_V1);
+
+            /**
+             * @brief Decompress the payload of a compressed frame
+             * 
+             * @param compressed compressed bytes (after the compressed frame header)
+             * @param compressed_size 
+             * @param dst where to write the raw frame
+             * @param raw_size size of the raw frame
+             */
+            void decompressFrame(const uint8_t *compressed, std::size_t compressed_size, uint8_t *dst, std::size_t raw_size);
+    };
+
+}
+
+
+#endif
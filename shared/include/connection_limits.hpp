@@ -0,0 +1,31 @@
+/**
+ * @file connection_limits.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef CONNECTION_LIMITS_HPP
+#define CONNECTION_LIMITS_HPP
+
+#include <stdint.h>
+
+#include "security_properties.hpp"
+
+namespace ASE
+{
+
+/**
+ * @brief Sizes a side accepts to receive, set at runtime per Server and per ServerLink.
+ * The frame and message limits are exchanged during the handshake: 
+ * bigger messages are fragmented by the sender to fit the receiver's ones
+ * 
+ */
+struct ConnectionLimits
+{
+    uint32_t max_frame_messages = FRAME_SIZE_LIMIT;         // messages per frame
+    uint32_t max_message_size = MESSAGE_SIZE_LIMIT;         // bytes of data per message
+    uint32_t max_reassembly_size = REASSEMBLY_SIZE_LIMIT;   // bytes of fragmented messages being reassembled, not exchanged
+};
+
+}
+
+#endif
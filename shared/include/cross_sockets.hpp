@@ -12,14 +12,25 @@
 
 typedef SSIZE_T ssize_t;
 
+/* minimal iovec so that gather-writes can be described the same way on every platform */
+struct iovec
+{
+    void *iov_base;
+    size_t iov_len;
+};
+
 #elif defined(__linux__)    // Linux and POSIX
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <arpa/inet.h>
 #include <unistd.h> /* close */
+#include <fcntl.h>
+#include <poll.h>
 #include <netdb.h> /* gethostbyname */
 #define INVALID_SOCKET -1
 #define SOCKET_ERROR -1
@@ -0,0 +1,190 @@
+/**
+ * @file fragmentation.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef FRAGMENTATION_HPP
+#define FRAGMENTATION_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+
+#include "message.hpp"
+#include "frame.hpp"
+#include "frame_view.hpp"
+#include "connection_limits.hpp"
+
+// smallest receiver's message size allowing fragmentation (fragment header included)
+#define FRAGMENT_MIN_MESSAGE_SIZE 32
+
+namespace ASE
+{
+
+    /**
+     * @brief Sending side of the fragmentation of a connection.
+     * Messages too big for the receiver are queued and cut into FRAGMENT messages,
+     * which only fill the slots the frame has left: real-time messages of a frame are
+     * never delayed by a big transfer, which is spread over the next frames instead.
+     * Messages over the receiver's messages per frame wait for the next frame.
+     * 
+     * FRAGMENT data: varint(transfer id) varint(offset), then for the first one [code] varint(total size), then a chunk
+     * 
+     */
+    class FragmentSender
+    {
+        private:
+            struct Transfer
+            {
+                uint64_t id;
+                Message message;
+                std::size_t offset;
+            };
+
+            std::deque<Transfer> transfers_;    // served round-robin
+            std::vector<Message> deferred_;     // over the frame limit, first messages of the next frame
+            uint64_t next_id_;
+            std::size_t pending_size_;
+
+        public:
+
+            FragmentSender();
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            /**
+             * @brief Get the number of messages not completely sent yet
+             * 
+             * @return std::size_t
+             */
+            inline std::size_t getPendingCount() const
+            {
+                return transfers_.size() + deferred_.size();
+            }
+
+            /**
+             * @brief Get the number of messages over the frame limit, added first to the next frame:
+             * the slots they take are not free for new messages
+             * 
+             * @return std::size_t
+             */
+            inline std::size_t getDeferredCount() const
+            {
+                return deferred_.size();
+            }
+
+            /**
+             * @brief Get the number of bytes not sent yet
+             * 
+             * @return std::size_t
+             */
+            inline std::size_t getPendingSize() const
+            {
+                return pending_size_;
+            }
+
+            /**
+             * @brief Queue a message to send fragmented
+             * 
+             * @param message
+             */
+            void push(Message message);
+
+            /**
+             * @brief Move the messages of frame too big for the receiver in the queue,
+             * put the deferred messages first and defer the ones over the receiver's frame limit,
+             * then fill the frame's remaining slots with fragments of the queued ones
+             * 
+             * @param frame frame about to be sent
+             * @param peer_limits receiving limits of the other side
+             */
+            void fragmentFrame(Frame &frame, const ConnectionLimits &peer_limits);
+
+            /**
+             * @brief Forget the queued messages
+             * 
+             */
+            void clear();
+    };
+
+
+    /**
+     * @brief Receiving side of the fragmentation of a connection,
+     * the memory of the messages being reassembled is capped
+     * 
+     */
+    class FragmentReassembler
+    {
+        private:
+            struct Transfer
+            {
+                message_code hat;
+                std::size_t total_size;
+                std::vector<uint8_t> data;
+            };
+
+            std::unordered_map<uint64_t, Transfer> transfers_;
+            std::size_t reserved_size_;     // sum of the total sizes of transfers_
+            std::size_t max_size_;
+
+            message_code completed_hat_;
+            std::vector<uint8_t> completed_data_;
+
+        public:
+
+            /**
+             * @brief Create a reassembler
+             * 
+             * @param max_size bytes of messages being reassembled at once
+             */
+            FragmentReassembler(std::size_t max_size = REASSEMBLY_SIZE_LIMIT);
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            /**
+             * @brief Get the bytes reserved by the messages being reassembled
+             * 
+             * @return std::size_t
+             */
+            inline std::size_t getReservedSize() const
+            {
+                return reserved_size_;
+            }
+
+            /**
+             * @brief Get the last message reassembled
+             * 
+             * @return MessageView valid until the next push
+             */
+            inline MessageView getCompleted() const
+            {
+                return MessageView(completed_hat_, completed_data_);
+            }
+
+            // ~~~~~~~~~~ SET ~~~~~~~~~~
+
+            inline void setMaxSize(std::size_t max_size)
+            {
+                max_size_ = max_size;
+            }
+
+            /**
+             * @brief Add a FRAGMENT message, throw DataSizeException if the reassembly limits are broken
+             * and RemoteConnectionException if the fragment does not follow the previous ones
+             * 
+             * @param fragment
+             * @return true if it completed a message, available with getCompleted
+             */
+            bool push(const MessageView &fragment);
+
+            /**
+             * @brief Forget the messages being reassembled
+             * 
+             */
+            void clear();
+    };
+
+}
+
+#endif
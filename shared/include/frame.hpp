@@ -11,11 +11,18 @@
 #include <string>
 #include <stdint.h>
 #include <utility>
+#include <functional>
+#include <span>
 
 #include "cross_sockets.hpp"
 #include "message.hpp"
+#include "bit_stream.hpp"
 #include "message_codes.hpp"
 #include "connection_expections.hpp"
+#include "compression.hpp"
+#include "wire_buffer.hpp"
+#include "wire_codec.hpp"
+#include "connection_limits.hpp"
 
 
 namespace ASE
@@ -26,6 +33,23 @@ namespace ASE
         private:
             std::vector<Message> messages_;
 
+            // already serialized messages shared with other frames, sent before messages_
+            std::vector<SharedWireBuffer> shared_parts_;
+            int shared_length_;
+
+            // scratch buffers of sendFrame, kept to reuse their capacity between sends
+            std::vector<uint8_t> send_headers_;
+            std::vector<struct iovec> send_iov_;
+            struct iovec compressed_iov_;
+
+            /**
+             * @brief Gather the whole frame (headers, payloads and end code) in one iovec list,
+             * or in the compressed frame if compression is worth it
+             * 
+             * @return std::span<struct iovec> valid until the next call
+             */
+            std::span<struct iovec> gatherFrame(CompressionContext *compression, WireVersion version);
+
 
         public:
 
@@ -40,13 +64,23 @@ namespace ASE
             // ~~~~~~~~~~ GET ~~~~~~~~~~
 
             /**
-             * @brief Get the length of the list of messages contained in the Frame
+             * @brief Get the length of the list of messages contained in the Frame, shared ones included
              * 
              * @return int 
              */
             inline int getLength() const
             {
-                return int(messages_.size());
+                return int(messages_.size()) + shared_length_;
+            }
+
+            /**
+             * @brief Get the shared serialized parts of the frame
+             * 
+             * @return const std::vector<SharedWireBuffer>& 
+             */
+            inline const std::vector<SharedWireBuffer> &getSharedParts() const
+            {
+                return shared_parts_;
             }
 
             /**
@@ -80,12 +114,68 @@ namespace ASE
              */
             void addMessage(Message message);
 
+            /**
+             * @brief Add already serialized messages, sent as-is without copy before the frame's own messages
+             * 
+             * @param shared_part messages serialized once for all receivers
+             */
+            void addShared(SharedWireBuffer shared_part);
+
+            /**
+             * @brief Turn the shared serialized parts back into own messages, put before the other ones
+             * 
+             */
+            void unshareParts();
+
+            /**
+             * @brief Add at the end of the frame a message holding the encoded value
+             * 
+             * @param hat the MessageCode (normaly DATA)
+             * @param value value with a wire layout (see wire_schema.hpp)
+             */
+            template<WireEncodable T>
+            void add(MessageCodes hat, const T &value)
+            {
+                messages_.emplace_back(makeMessage(hat, value));
+            }
+
+            /**
+             * @brief Add at the end of the frame a message whose data is a bit stream,
+             * written directly in the message by writer_lambda
+             * 
+             * @param writer_lambda lambda packing values with the BitWriter
+             * @param hat the MessageCode (normaly DATA)
+             */
+            void addBitStream(std::function<void(BitWriter &writer)> writer_lambda, MessageCodes hat = DATA);
+
             /**
              * @brief Send the frame through receiver_socket
+             * The whole frame (headers, payloads and end code) is gathered in one iovec list
+             * and pushed with as few sendmsg calls as the socket allows
              * 
              * @param receiver_socket Socket of the receiver
+             * @param compression compression negotiated with the receiver, nullptr to send raw
+             * @param version wire version negotiated with the receiver
              */
-            void sendFrame(SOCKET receiver_socket);
+            void sendFrame(SOCKET receiver_socket, CompressionContext *compression = nullptr, WireVersion version = WIRE_V1);
+
+            /**
+             * @brief Append the frame, as sendFrame would send it, at the end of output 
+             * (for non-blocking sockets which may not take it at once)
+             * 
+             * @param output 
+             * @param compression compression negotiated with the receiver, nullptr to send raw
+             * @param version wire version negotiated with the receiver
+             */
+            void serializeFrame(std::vector<uint8_t> &output, CompressionContext *compression = nullptr, WireVersion version = WIRE_V1);
+
+            /**
+             * @brief Get the number of bytes the frame takes on the wire, without compression
+             * 
+             * @param version 
+             * @return std::size_t 
+             */
+            std::size_t getWireSize(WireVersion version = WIRE_V1) const;
 
             /**
              * @brief Reset Frame to empty
@@ -100,12 +190,26 @@ namespace ASE
     };
     
     /**
-     * @brief Wait and receive a frame from a sender through sender_socket
+     * @brief Wait and receive a frame from a sender through sender_socket,
+     * reads exactly the bytes of one frame (used for handshakes), 
+     * connection loops should use a FrameReceiver instead
      * 
      * @param sender_socket 
+     * @param version wire version of the sender
+     * @param limits sizes of frame and messages accepted
      * @return Frame 
      */
-    Frame recvFrame(SOCKET sender_socket);
+    Frame recvFrame(SOCKET sender_socket, WireVersion version = WIRE_V1, const ConnectionLimits &limits = ConnectionLimits());
+
+    /**
+     * @brief Send all the buffers described by iov through receiver_socket, 
+     * retry on partial writes until everything is sent
+     * 
+     * @param receiver_socket Socket of the receiver
+     * @param iov buffers to send, modified during the sending
+     * @param iov_count number of buffers
+     */
+    void sendAllBuffers(SOCKET receiver_socket, struct iovec *iov, std::size_t iov_count);
 
     
 
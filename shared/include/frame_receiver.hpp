@@ -0,0 +1,200 @@
+/**
+ * @file frame_receiver.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef FRAME_RECEIVER_HPP
+#define FRAME_RECEIVER_HPP
+
+#include <vector>
+#include <memory>
+#include <span>
+#include <stdint.h>
+
+#include "cross_sockets.hpp"
+#include "frame.hpp"
+#include "frame_view.hpp"
+#include "compression.hpp"
+#include "wire_codec.hpp"
+#include "connection_limits.hpp"
+#include "connection_expections.hpp"
+
+namespace ASE
+{
+
+    /**
+     * @brief Per connection receiving buffer: pulls as many bytes as available with one recv
+     * and cuts complete frames from them, incomplete frames are kept for the next call.
+     * The buffer is reference counted: FrameViews point directly into it, and it is only 
+     * compacted in place when no view is alive anymore
+     * 
+     */
+    class FrameReceiver
+    {
+        private:
+            SOCKET socket_;
+
+            std::shared_ptr<std::vector<uint8_t>> buffer_;
+            std::size_t read_pos_;      // first byte not parsed yet
+            std::size_t write_pos_;     // first free byte
+
+            CompressionContext *compression_;                   // not owned, nullptr if not negotiated
+            std::shared_ptr<std::vector<uint8_t>> inflated_;    // last decompressed frame
+
+            WireVersion version_;       // framing negotiated with the sender
+            ConnectionLimits limits_;
+
+            /**
+             * @brief Get the size of the raw frame at begin, throw if the frame breaks the security limits
+             * 
+             * @return std::size_t size in bytes of the complete frame, 0 if incomplete
+             */
+            static std::size_t rawFrameSize(WireVersion version, const ConnectionLimits &limits, const uint8_t *begin, std::size_t available);
+
+            /**
+             * @brief Check if a complete frame is in the buffer, throw if the frame breaks the security limits
+             * 
+             * @param header decoded header of the frame
+             * @param header_size size in bytes of the header
+             * @return std::size_t size in bytes of the complete frame, 0 if incomplete
+             */
+            std::size_t completeFrameSize(WireFrameHeader &header, std::size_t &header_size) const;
+
+            /**
+             * @brief Make room for at least min_free_space bytes after write_pos_
+             * 
+             */
+            void reserveFreeSpace(std::size_t min_free_space);
+
+        public:
+
+            /**
+             * @brief Create a receiver reading from sender_socket
+             * 
+             * @param sender_socket 
+             * @param initial_capacity initial size of the buffer in bytes
+             */
+            FrameReceiver(SOCKET sender_socket = INVALID_SOCKET, std::size_t initial_capacity = 4096);
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            /**
+             * @brief Get the socket read by the receiver
+             * 
+             * @return SOCKET 
+             */
+            inline SOCKET getSocket() const
+            {
+                return socket_;
+            }
+
+            /**
+             * @brief Get the number of received bytes not parsed yet
+             * 
+             * @return std::size_t 
+             */
+            inline std::size_t getBufferedSize() const
+            {
+                return write_pos_ - read_pos_;
+            }
+
+            /**
+             * @brief Get the wire version the frames are decoded with
+             * 
+             * @return WireVersion 
+             */
+            inline WireVersion getWireVersion() const
+            {
+                return version_;
+            }
+
+            // ~~~~~~~~~~ SET ~~~~~~~~~~
+
+            /**
+             * @brief Change the socket read by the receiver and forget buffered bytes
+             * 
+             * @param sender_socket 
+             */
+            void setSocket(SOCKET sender_socket);
+
+            /**
+             * @brief Set the compression negotiated with the sender, needed to read ZLENGTH frames
+             * 
+             * @param compression not owned, must live as long as the receiver, nullptr to refuse compressed frames
+             */
+            inline void setCompressionContext(CompressionContext *compression)
+            {
+                compression_ = compression;
+            }
+
+            /**
+             * @brief Set the sizes of frames and messages accepted
+             * 
+             * @param limits 
+             */
+            inline void setLimits(const ConnectionLimits &limits)
+            {
+                limits_ = limits;
+            }
+
+            /**
+             * @brief Set the wire version negotiated with the sender
+             * 
+             * @param version 
+             */
+            inline void setWireVersion(WireVersion version)
+            {
+                version_ = version;
+            }
+
+
+            /**
+             * @brief Read with one recv all the bytes the kernel has for us
+             * 
+             * @return std::size_t number of bytes read, 0 if the socket would block (or timed out)
+             */
+            std::size_t fill();
+
+            /**
+             * @brief Append bytes received by another way than fill (e.g. an io_uring completion)
+             * 
+             * @param data 
+             */
+            void feed(std::span<const uint8_t> data);
+
+            /**
+             * @brief Cut the first complete frame of the buffer if there is one, never blocks.
+             * No copy and no allocation: the view points into the receive buffer
+             * 
+             * @param output view on the messages received
+             * @return true if a frame was extracted
+             */
+            bool tryParseFrameView(FrameView &output);
+
+            /**
+             * @brief Cut the first complete frame of the buffer if there is one, never blocks
+             * 
+             * @param output frame filled with the messages received
+             * @return true if a frame was extracted
+             */
+            bool tryParseFrame(Frame &output);
+
+            /**
+             * @brief Wait until a complete frame is received and return it
+             * 
+             * @return Frame 
+             */
+            Frame recvFrame();
+
+            /**
+             * @brief Wait until a complete frame is received and return a view on it
+             * 
+             * @return FrameView 
+             */
+            FrameView recvFrameView();
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,241 @@
+/**
+ * @file frame_view.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef FRAME_VIEW_HPP
+#define FRAME_VIEW_HPP
+
+#include <vector>
+#include <memory>
+#include <span>
+#include <stdint.h>
+
+#include "message.hpp"
+#include "frame.hpp"
+
+namespace ASE
+{
+
+    /**
+     * @brief Non owning message: a code and a span on the receive buffer it was parsed from,
+     * valid as long as the FrameView it comes from is alive
+     * 
+     */
+    class MessageView
+    {
+        message_code hat_;
+        std::span<const uint8_t> data_;
+
+        public:
+
+            MessageView(): hat_(STOP)
+            {
+
+            }
+
+            MessageView(message_code hat, std::span<const uint8_t> data): hat_(hat), data_(data)
+            {
+
+            }
+
+            /**
+             * @brief Get the message's code
+             * 
+             * @return message_code 
+             */
+            inline message_code getHat() const
+            {
+                return hat_;
+            }
+
+            /**
+             * @brief Get the Size Of Data
+             * 
+             * @return std::size_t 
+             */
+            inline std::size_t getSizeOfData() const
+            {
+                return data_.size();
+            }
+
+            /**
+             * @brief Get the span on the message's data
+             * 
+             * @return std::span<const uint8_t> 
+             */
+            inline std::span<const uint8_t> getData() const
+            {
+                return data_;
+            }
+
+            /**
+             * @brief Get a void pointer on data
+             * 
+             * @return const void* 
+             */
+            inline const void *getRawData() const
+            {
+                return (const void*)(data_.data());
+            }
+
+            /**
+             * @brief Decode the index-th T of the data (see wire_schema.hpp)
+             * 
+             */
+            template<WireEncodable T>
+            T as(std::size_t index = 0) const
+            {
+                return decode<T>(data_, index);
+            }
+
+            /**
+             * @brief Get how many T the message holds
+             * 
+             */
+            template<WireEncodable T>
+            std::size_t count() const
+            {
+                return decodeCount<T>(data_);
+            }
+
+            /**
+             * @brief Get a reader on the bit stream held by the message
+             * 
+             * @return BitReader 
+             */
+            inline BitReader getBitReader() const
+            {
+                return BitReader(data_);
+            }
+
+            /**
+             * @brief Copy the data in an owning Message, to keep it after the view is released
+             * 
+             * @return Message 
+             */
+            Message toMessage() const;
+    };
+
+
+    /**
+     * @brief Non owning frame: keeps alive the reference-counted receive buffer
+     * it was parsed from and iterates on its messages without any copy
+     * 
+     */
+    class FrameView
+    {
+        private:
+            std::shared_ptr<const std::vector<uint8_t>> buffer_;
+            std::size_t offset_;    // offset of the first message header in buffer_
+            int length_;
+            WireVersion version_;   // encoding of the message headers
+
+        public:
+
+            /**
+             * @brief Forward iterator on the messages of the frame, parses headers on the fly
+             * 
+             */
+            class Iterator
+            {
+                private:
+                    const uint8_t *pos_;
+                    int remaining_;
+                    WireVersion version_;
+                
+                public:
+                    Iterator(const uint8_t *pos, int remaining, WireVersion version = WIRE_V1): pos_(pos), remaining_(remaining), version_(version)
+                    {
+
+                    }
+
+                    inline MessageView operator*() const
+                    {
+                        uint8_t hat;
+                        std::size_t size;
+                        std::size_t header_size = decodeMessageHeader(version_, pos_, WIRE_MAX_MESSAGE_HEADER_SIZE, hat, size);
+                        return MessageView(hat, std::span<const uint8_t>(pos_ + header_size, size));
+                    }
+
+                    inline Iterator &operator++()
+                    {
+                        uint8_t hat;
+                        std::size_t size;
+                        std::size_t header_size = decodeMessageHeader(version_, pos_, WIRE_MAX_MESSAGE_HEADER_SIZE, hat, size);
+                        pos_ += header_size + size;
+                        remaining_--;
+                        return *this;
+                    }
+
+                    inline bool operator!=(const Iterator &other) const
+                    {
+                        return remaining_ != other.remaining_;
+                    }
+
+                    inline bool operator==(const Iterator &other) const
+                    {
+                        return remaining_ == other.remaining_;
+                    }
+            };
+
+            /**
+             * @brief Create an empty FrameView
+             * 
+             */
+            FrameView(): offset_(0), length_(0), version_(WIRE_V1)
+            {
+
+            }
+
+            /**
+             * @brief Create a view on an already validated frame
+             * 
+             * @param buffer receive buffer holding the frame
+             * @param offset offset of the first message header in buffer
+             * @param length number of messages of the frame
+             * @param version wire version the frame was received with
+             */
+            FrameView(std::shared_ptr<const std::vector<uint8_t>> buffer, std::size_t offset, int length, WireVersion version = WIRE_V1): buffer_(std::move(buffer)), offset_(offset), length_(length), version_(version)
+            {
+
+            }
+
+            /**
+             * @brief Get the number of messages contained in the Frame
+             * 
+             * @return int 
+             */
+            inline int getLength() const
+            {
+                return length_;
+            }
+
+            inline Iterator begin() const
+            {
+                return Iterator(length_ > 0 ? buffer_->data() + offset_ : nullptr, length_, version_);
+            }
+
+            inline Iterator end() const
+            {
+                return Iterator(nullptr, 0);
+            }
+
+            /**
+             * @brief Copy all messages in an owning Frame
+             * 
+             * @return Frame 
+             */
+            Frame toFrame() const;
+
+            /**
+             * @brief Release the receive buffer, so that the receiver can reuse it
+             * 
+             */
+            void clear();
+    };
+
+}
+
+
+#endif
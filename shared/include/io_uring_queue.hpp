@@ -0,0 +1,216 @@
+/**
+ * @file io_uring_queue.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef IO_URING_QUEUE_HPP
+#define IO_URING_QUEUE_HPP
+
+#if defined(__linux__)
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <span>
+#include <linux/io_uring.h>
+
+#include "cross_sockets.hpp"
+
+namespace ASE
+{
+
+    /**
+     * @brief Completion of an operation of an IoUringQueue
+     * 
+     */
+    struct IoUringCompletion
+    {
+        uint64_t user_data;
+        int32_t result;                 // bytes transferred or -errno
+        bool more;                      // a multishot operation goes on
+        std::span<const uint8_t> data;  // bytes received in a provided buffer, valid during the handler only
+    };
+
+
+    /**
+     * @brief io_uring instance used through the raw system calls (no liburing needed):
+     * operations are prepared in the submission ring and all submitted by one io_uring_enter,
+     * which also waits for completions. Multishot receives take their memory from a ring of
+     * provided buffers, given back once the completion is handled.
+     * Not thread safe, a queue belongs to one thread
+     * 
+     */
+    class IoUringQueue
+    {
+        private:
+            int ring_fd_;
+
+            void *rings_map_;           // submission and completion rings
+            std::size_t rings_map_size_;
+            struct io_uring_sqe *sqes_;
+            std::size_t sqes_map_size_;
+
+            unsigned *sq_head_;
+            unsigned *sq_tail_;
+            unsigned *sq_array_;
+            unsigned sq_mask_;
+            unsigned sq_entries_;
+            unsigned sq_local_tail_;    // prepared entries not published yet
+
+            unsigned *cq_head_;
+            unsigned *cq_tail_;
+            unsigned cq_mask_;
+            struct io_uring_cqe *cqes_;
+
+            // provided buffers of the multishot receives. The ring is addressed as an array of io_uring_buf:
+            // the flexible array of io_uring_buf_ring is misplaced in C++, its tail is the resv field of the first entry
+            struct io_uring_buf *buf_ring_;
+            std::size_t buf_ring_map_size_;
+            std::vector<uint8_t> buffers_;
+            unsigned buffer_count_;
+            std::size_t buffer_size_;
+
+            std::size_t enter_count_;
+
+            /**
+             * @brief Get a free submission entry, submit the prepared ones if the ring is full
+             * 
+             */
+            struct io_uring_sqe *getSqe();
+
+            /**
+             * @brief Give a provided buffer back to the kernel
+             * 
+             */
+            void recycleBuffer(uint16_t buffer_id);
+
+            /**
+             * @brief Check on a socket pair that the kernel supports multishot receives in provided buffers
+             * 
+             */
+            bool probeRecvMultishot();
+
+            /**
+             * @brief Unmap and close everything created
+             * 
+             */
+            void release();
+
+            /**
+             * @brief Call io_uring_enter and count it
+             * 
+             */
+            int enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, std::size_t arg_size);
+
+        public:
+
+            /**
+             * @brief Create the rings, throw std::runtime_error if the kernel lacks io_uring
+             * or one of the features used (provided buffer rings, multishot receive)
+             * 
+             * @param entries size of the submission ring
+             * @param buffer_count number of provided buffers, a power of 2
+             * @param buffer_size size of a provided buffer in bytes
+             */
+            IoUringQueue(unsigned entries, unsigned buffer_count, std::size_t buffer_size);
+
+            ~IoUringQueue();
+
+            IoUringQueue(const IoUringQueue &) = delete;
+            IoUringQueue &operator=(const IoUringQueue &) = delete;
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            /**
+             * @brief Get the number of io_uring_enter calls done
+             * 
+             * @return std::size_t
+             */
+            inline std::size_t getEnterCount() const
+            {
+                return enter_count_;
+            }
+
+            // ~~~~~~~~~~ PREPARE ~~~~~~~~~~
+
+            /**
+             * @brief Receive continuously from sock into provided buffers, until an error or the end of the connection
+             * 
+             */
+            void prepareRecvMultishot(SOCKET sock, uint64_t user_data);
+
+            /**
+             * @brief Send size bytes of data, which must stay valid until the completion
+             * 
+             */
+            void prepareSend(SOCKET sock, const uint8_t *data, std::size_t size, uint64_t user_data);
+
+            /**
+             * @brief Read size bytes of fd in output, which must stay valid until the completion
+             * 
+             */
+            void prepareRead(int fd, void *output, std::size_t size, uint64_t user_data);
+
+            /**
+             * @brief Cancel the operation submitted with target_user_data
+             * 
+             */
+            void prepareCancel(uint64_t target_user_data, uint64_t user_data);
+
+            /**
+             * @brief Submit with one io_uring_enter all prepared operations and wait for a completion
+             * 
+             * @param timeout_milli longest wait in milliseconds
+             */
+            void submitAndWait(int timeout_milli);
+
+            /**
+             * @brief Call handler on each completion available and consume them
+             * 
+             * @param handler void(const IoUringCompletion &)
+             * @return std::size_t number of completions handled
+             */
+            template<typename Handler>
+            std::size_t forEachCompletion(Handler &&handler)
+            {
+                std::size_t count = 0;
+                unsigned head = std::atomic_ref<unsigned>(*cq_head_).load(std::memory_order_relaxed);
+
+                while(head != std::atomic_ref<unsigned>(*cq_tail_).load(std::memory_order_acquire))
+                {
+                    const struct io_uring_cqe &cqe = cqes_[head & cq_mask_];
+
+                    IoUringCompletion completion;
+                    completion.user_data = cqe.user_data;
+                    completion.result = cqe.res;
+                    completion.more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+
+                    bool has_buffer = (cqe.flags & IORING_CQE_F_BUFFER) != 0;
+                    uint16_t buffer_id = uint16_t(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                    if(has_buffer && cqe.res > 0)
+                    {
+                        completion.data = std::span<const uint8_t>(buffers_.data() + std::size_t(buffer_id) * buffer_size_, std::size_t(cqe.res));
+                    }
+
+                    head++;
+                    std::atomic_ref<unsigned>(*cq_head_).store(head, std::memory_order_release);
+
+                    handler(completion);
+
+                    if(has_buffer)
+                    {
+                        recycleBuffer(buffer_id);
+                    }
+                    count++;
+                }
+
+                return count;
+            }
+    };
+
+}
+
+#endif
+
+#endif
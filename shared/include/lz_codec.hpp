@@ -0,0 +1,109 @@
+/**
+ * @file lz_codec.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef LZ_CODEC_HPP
+#define LZ_CODEC_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <array>
+
+// the match finder hashes 4 bytes on this number of bits
+#define LZ_HASH_BITS 12
+
+// biggest dictionary usable, matches are coded with 16 bits offsets
+#define LZ_DICTIONARY_MAX_SIZE 32768
+
+namespace ASE
+{
+
+    /**
+     * @brief Bytes known in advance by both sides, used as if they were preceding each compressed frame,
+     * so that small frames can refer to typical game traffic
+     * 
+     */
+    class CompressionDictionary
+    {
+        private:
+            std::vector<uint8_t> content_;
+            uint32_t id_;
+            std::array<uint32_t, 1 << LZ_HASH_BITS> hash_table_;    // match finder table already filled with the content
+
+        public:
+
+            /**
+             * @brief Create a dictionary from its content (truncated to its last LZ_DICTIONARY_MAX_SIZE bytes)
+             * 
+             * @param content 
+             */
+            CompressionDictionary(std::vector<uint8_t> content);
+
+            /**
+             * @brief Build a dictionary from captured traffic: keeps the segments whose 
+             * substrings are the most frequent in samples, most useful at the end
+             * 
+             * @param samples captured frames or payloads
+             * @param capacity maximum size of the dictionary in bytes
+             * @return CompressionDictionary 
+             */
+            static CompressionDictionary train(const std::vector<std::vector<uint8_t>> &samples, std::size_t capacity = 4096);
+
+            /**
+             * @brief Get the id of the dictionary, a hash of its content, used in negotiation
+             * 
+             * @return uint32_t never 0
+             */
+            inline uint32_t getId() const
+            {
+                return id_;
+            }
+
+            inline const std::vector<uint8_t> &getContent() const
+            {
+                return content_;
+            }
+
+            inline const std::array<uint32_t, 1 << LZ_HASH_BITS> &getHashTable() const
+            {
+                return hash_table_;
+            }
+    };
+
+    /**
+     * @brief Get the worst compressed size of src_size bytes
+     * 
+     */
+    constexpr std::size_t lzCompressBound(std::size_t src_size)
+    {
+        return src_size + src_size / 255 + 16;
+    }
+
+    /**
+     * @brief Compress src with a LZ77 byte oriented format (LZ4 like sequences)
+     * 
+     * @param src bytes to compress
+     * @param src_size 
+     * @param dst where to write compressed bytes
+     * @param dst_capacity 
+     * @param dictionary optional dictionary, must be the same to decompress
+     * @return std::size_t compressed size, 0 if it does not fit in dst_capacity
+     */
+    std::size_t lzCompress(const uint8_t *src, std::size_t src_size, uint8_t *dst, std::size_t dst_capacity, const CompressionDictionary *dictionary = nullptr);
+
+    /**
+     * @brief Decompress exactly dst_size bytes, throw DataSizeException on corrupted input
+     * 
+     * @param src compressed bytes
+     * @param src_size 
+     * @param dst where to write decompressed bytes
+     * @param dst_size size of the original data
+     * @param dictionary dictionary used to compress
+     */
+    void lzDecompress(const uint8_t *src, std::size_t src_size, uint8_t *dst, std::size_t dst_size, const CompressionDictionary *dictionary = nullptr);
+
+}
+
+
+#endif
@@ -11,8 +11,11 @@
 #include <array>
 #include <tuple>
 #include <string>
+#include <span>
 
 #include "cross_sockets.hpp"
+#include "payload_buffer.hpp"
+#include "wire_schema.hpp"
 #include "message_codes.hpp"
 #include "connection_expections.hpp"
 
@@ -23,12 +26,22 @@ namespace ASE
     class Message
     {
         message_code hat_;
-        std::vector<uint8_t> data_;
+        PayloadBuffer data_;
 
         public:
 
             /**
-             * @brief Construct a new Message object form a data vector
+             * @brief Construct an empty STOP message, e.g. a slot of a queue
+             * 
+             */
+            Message(): hat_(STOP)
+            {
+
+            }
+
+            /**
+             * @brief Construct a new Message object form a data vector,
+             * small data is copied inline, big data is moved without copy
              * 
              * @param hat the MessageCode (normaly DATA)
              */
@@ -44,14 +57,9 @@ namespace ASE
              * @param data address of the data of the message 
              * @param size Size of the messsage's data
              */
-            Message(MessageCodes hat, const void *data, std::size_t size): hat_(hat)
+            Message(MessageCodes hat, const void *data, std::size_t size): hat_(hat), data_(data, size)
             {
-                auto converted_data = (const uint8_t*)(data);
-
-                for(const uint8_t *data_byte = converted_data; data_byte < converted_data+size; data_byte++)
-                {
-                    data_.emplace_back(*data_byte);
-                }
+                
             }
 
             /**
@@ -81,15 +89,15 @@ namespace ASE
              */
             inline std::vector<uint8_t> getDataCopy() const
             {
-                return data_;
+                return data_.toVector();
             }
             
             /**
              * @brief Get a const ref of data
              * 
-             * @return const std::vector<uint8_t>& 
+             * @return const PayloadBuffer& 
              */
-            inline const std::vector<uint8_t> &getDataConstRef() const
+            inline const PayloadBuffer &getDataConstRef() const
             {
                 return data_;
             }
@@ -97,13 +105,23 @@ namespace ASE
             /**
              * @brief Get a ref of data
              * 
-             * @return const std::vector<uint8_t>& 
+             * @return PayloadBuffer& 
              */
-            inline std::vector<uint8_t> &getDataRef() 
+            inline PayloadBuffer &getDataRef() 
             {
                 return data_;
             }
 
+            /**
+             * @brief Get a span on data
+             * 
+             * @return std::span<const uint8_t> 
+             */
+            inline std::span<const uint8_t> getData() const
+            {
+                return std::span<const uint8_t>(data_.data(), data_.size());
+            }
+
             /**
              * @brief Get a void pointer on data
              * 
@@ -117,13 +135,49 @@ namespace ASE
             /**
              * @brief Get data's iterators cbegin and cend
              * 
-             * @return std::tuple<std::vector<uint8_t>::const_iterator, std::vector<uint8_t>::const_iterator> 
+             * @return std::tuple<const uint8_t*, const uint8_t*> 
              */
-            inline std::tuple<std::vector<uint8_t>::const_iterator, std::vector<uint8_t>::const_iterator> getDataIt() const
+            inline std::tuple<const uint8_t*, const uint8_t*> getDataIt() const
             {
                 return {data_.cbegin(), data_.cend()};
             }
 
+            /**
+             * @brief Decode the index-th T of the data (see wire_schema.hpp)
+             * 
+             * @tparam T type with a wire layout
+             * @param index position of the value if the message holds several T
+             * @return T 
+             */
+            template<WireEncodable T>
+            T as(std::size_t index = 0) const
+            {
+                return decode<T>(getData(), index);
+            }
+
+            /**
+             * @brief Get how many T the message holds
+             * 
+             */
+            template<WireEncodable T>
+            std::size_t count() const
+            {
+                return decodeCount<T>(getData());
+            }
+
+            /**
+             * @brief Encode value at the end of the data
+             * 
+             * @param value 
+             */
+            template<WireEncodable T>
+            void append(const T &value)
+            {
+                std::size_t old_size = data_.size();
+                data_.resize(old_size + wireSize<T>());
+                encodeTo(value, data_.data() + old_size);
+            }
+
             /**
              * @brief Send the message to the receiver through receiver_socket 
              * DON'T USE IT, use sendFrame instead
@@ -142,6 +196,21 @@ namespace ASE
 
     };
 
+    /**
+     * @brief Create a message holding the encoded value
+     * 
+     * @param hat the MessageCode
+     * @param value value with a wire layout (see wire_schema.hpp)
+     * @return Message 
+     */
+    template<WireEncodable T>
+    Message makeMessage(MessageCodes hat, const T &value)
+    {
+        Message output(hat, nullptr, 0);
+        output.append(value);
+        return output;
+    }
+
     /**
      * @brief Wait and receive message through sender_socket
      * DON'T USE IT, use recvFrame instead
@@ -150,6 +219,17 @@ namespace ASE
      * @return Message 
      */
     Message recvMessage(SOCKET sender_socket);
+
+    /**
+     * @brief Wait and receive exactly size bytes through sender_socket, 
+     * data split over several TCP segments is gathered
+     * 
+     * @param sender_socket 
+     * @param buffer where to write received bytes
+     * @param size number of bytes to receive
+     * @return true if all bytes were received, false if the sender disconnected or timed out
+     */
+    bool recvAll(SOCKET sender_socket, void *buffer, std::size_t size);
 }
 
 
@@ -0,0 +1,329 @@
+/**
+ * @file payload_buffer.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef PAYLOAD_BUFFER_HPP
+#define PAYLOAD_BUFFER_HPP
+
+#include <stdint.h>
+#include <cstring>
+#include <vector>
+#include <array>
+
+// payloads up to this size are stored inside the Message, without heap allocation
+#ifndef MESSAGE_INLINE_CAPACITY
+#define MESSAGE_INLINE_CAPACITY 48
+#endif
+
+// number of spilled payload buffers kept per thread for reuse
+#ifndef PAYLOAD_POOL_SIZE
+#define PAYLOAD_POOL_SIZE 64
+#endif
+
+// buffers bigger than this are freed instead of being kept in the pool
+#ifndef PAYLOAD_POOL_MAX_CAPACITY
+#define PAYLOAD_POOL_MAX_CAPACITY 65536
+#endif
+
+namespace ASE
+{
+
+    /**
+     * @brief Thread local free list of heap buffers used by spilled payloads,
+     * so that steady-state traffic does not hit malloc/free
+     * 
+     */
+    namespace PayloadPool
+    {
+        /**
+         * @brief Get an empty buffer with at least min_capacity bytes of capacity,
+         * from the pool of the calling thread if possible
+         * 
+         * @param min_capacity 
+         * @return std::vector<uint8_t> 
+         */
+        std::vector<uint8_t> acquire(std::size_t min_capacity);
+
+        /**
+         * @brief Give back a buffer to the pool of the calling thread (freed if the pool is full, or if too small
+         * to hold a payload not inline)
+         * 
+         * @param buffer 
+         */
+        void release(std::vector<uint8_t> &&buffer);
+
+        /**
+         * @brief Get the number of buffers available in the pool of the calling thread
+         * 
+         * @return std::size_t 
+         */
+        std::size_t getAvailable();
+    }
+
+    /**
+     * @brief Byte storage of a Message: small payloads live in an inline array,
+     * bigger ones spill in a heap vector taken from the PayloadPool
+     * 
+     */
+    class PayloadBuffer
+    {
+        private:
+            std::size_t size_;
+            bool on_heap_;
+            std::array<uint8_t, MESSAGE_INLINE_CAPACITY> inline_;
+            std::vector<uint8_t> heap_;
+
+            /**
+             * @brief Give the heap buffer back to the pool
+             * 
+             */
+            inline void releaseHeap()
+            {
+                if(heap_.capacity() > 0)
+                {
+                    PayloadPool::release(std::move(heap_));
+                    heap_ = std::vector<uint8_t>();
+                }
+            }
+
+        public:
+
+            /**
+             * @brief Create an empty payload
+             * 
+             */
+            PayloadBuffer(): size_(0), on_heap_(false)
+            {
+
+            }
+
+            /**
+             * @brief Create a payload with a copy of size bytes from data
+             * 
+             */
+            PayloadBuffer(const void *data, std::size_t size): size_(0), on_heap_(false)
+            {
+                assign(data, size);
+            }
+
+            /**
+             * @brief Create a payload from a vector, a big vector is adopted without copy
+             * 
+             */
+            PayloadBuffer(std::vector<uint8_t> data): size_(0), on_heap_(false)
+            {
+                if(data.size() > MESSAGE_INLINE_CAPACITY)
+                {
+                    size_ = data.size();
+                    on_heap_ = true;
+                    heap_ = std::move(data);
+                }
+                else
+                {
+                    assign(data.data(), data.size());
+                    PayloadPool::release(std::move(data));
+                }
+            }
+
+            PayloadBuffer(const PayloadBuffer &other): size_(0), on_heap_(false)
+            {
+                assign(other.data(), other.size());
+            }
+
+            PayloadBuffer &operator=(const PayloadBuffer &other)
+            {
+                if(this != &other)
+                {
+                    assign(other.data(), other.size());
+                }
+                return *this;
+            }
+
+            PayloadBuffer(PayloadBuffer &&other) noexcept: size_(other.size_), on_heap_(other.on_heap_), heap_(std::move(other.heap_))
+            {
+                if(!on_heap_)
+                {
+                    std::memcpy(inline_.data(), other.inline_.data(), size_);
+                }
+                other.size_ = 0;
+                other.on_heap_ = false;
+            }
+
+            PayloadBuffer &operator=(PayloadBuffer &&other) noexcept
+            {
+                if(this != &other)
+                {
+                    releaseHeap();
+                    size_ = other.size_;
+                    on_heap_ = other.on_heap_;
+                    heap_ = std::move(other.heap_);
+                    if(!on_heap_)
+                    {
+                        std::memcpy(inline_.data(), other.inline_.data(), size_);
+                    }
+                    other.size_ = 0;
+                    other.on_heap_ = false;
+                }
+                return *this;
+            }
+
+            ~PayloadBuffer()
+            {
+                releaseHeap();
+            }
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            inline std::size_t size() const
+            {
+                return size_;
+            }
+
+            inline bool empty() const
+            {
+                return size_ == 0;
+            }
+
+            /**
+             * @brief Check if the payload spilled on the heap
+             * 
+             */
+            inline bool isOnHeap() const
+            {
+                return on_heap_;
+            }
+
+            inline uint8_t *data()
+            {
+                return on_heap_ ? heap_.data() : inline_.data();
+            }
+
+            inline const uint8_t *data() const
+            {
+                return on_heap_ ? heap_.data() : inline_.data();
+            }
+
+            inline uint8_t *begin()
+            {
+                return data();
+            }
+
+            inline uint8_t *end()
+            {
+                return data() + size_;
+            }
+
+            inline const uint8_t *begin() const
+            {
+                return data();
+            }
+
+            inline const uint8_t *end() const
+            {
+                return data() + size_;
+            }
+
+            inline const uint8_t *cbegin() const
+            {
+                return data();
+            }
+
+            inline const uint8_t *cend() const
+            {
+                return data() + size_;
+            }
+
+            inline uint8_t &operator[](std::size_t i)
+            {
+                return data()[i];
+            }
+
+            inline const uint8_t &operator[](std::size_t i) const
+            {
+                return data()[i];
+            }
+
+            /**
+             * @brief Copy the payload in a vector
+             * 
+             * @return std::vector<uint8_t> 
+             */
+            inline std::vector<uint8_t> toVector() const
+            {
+                return std::vector<uint8_t>(begin(), end());
+            }
+
+
+            // ~~~~~~~~~~ SET ~~~~~~~~~~
+
+            /**
+             * @brief Change the size of the payload, keeps the existing bytes
+             * 
+             * @param new_size 
+             */
+            void resize(std::size_t new_size)
+            {
+                if(on_heap_)
+                {
+                    heap_.resize(new_size);
+                }
+                else if(new_size > MESSAGE_INLINE_CAPACITY)
+                {
+                    // spill to the heap
+                    heap_ = PayloadPool::acquire(new_size);
+                    heap_.resize(new_size);
+                    std::memcpy(heap_.data(), inline_.data(), size_);
+                    on_heap_ = true;
+                }
+                else if(new_size > size_)
+                {
+                    std::memset(inline_.data() + size_, 0, new_size - size_);
+                }
+
+                size_ = new_size;
+            }
+
+            /**
+             * @brief Replace the payload by a copy of size bytes from data
+             * 
+             */
+            void assign(const void *data, std::size_t size)
+            {
+                size_ = 0;
+                resize(size);
+                if(size > 0)
+                {
+                    std::memcpy(this->data(), data, size);
+                }
+            }
+
+            /**
+             * @brief Add size bytes from data at the end of the payload
+             * 
+             */
+            void append(const void *data, std::size_t size)
+            {
+                std::size_t old_size = size_;
+                resize(size_ + size);
+                if(size > 0)
+                {
+                    std::memcpy(this->data() + old_size, data, size);
+                }
+            }
+
+            inline void push_back(uint8_t byte)
+            {
+                append(&byte, 1);
+            }
+
+            inline void clear()
+            {
+                resize(0);
+            }
+    };
+
+}
+
+
+#endif
@@ -0,0 +1,331 @@
+/**
+ * @file reliable_endpoint.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef RELIABLE_ENDPOINT_HPP
+#define RELIABLE_ENDPOINT_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <chrono>
+#include <random>
+#include <tuple>
+
+#include "message.hpp"
+#include "frame.hpp"
+#include "frame_view.hpp"
+#include "wire_schema.hpp"
+#include "connection_limits.hpp"
+#include "unreliable_datagram.hpp"
+
+// id, channel, order and code of the message carried, before its data
+#define RELIABLE_MESSAGE_HEADER_SIZE 10
+// biggest data of a reliable message, so that it fits in a datagram with an ack
+#define RELIABLE_MAX_PAYLOAD_SIZE 1100
+// messages acknowledged after the first one missing, the window never goes beyond
+#define RELIABLE_ACK_MASK_BITS 64
+#define RELIABLE_INITIAL_WINDOW 10
+// the window never goes below, so that a loss has later messages to be detected with
+#define RELIABLE_MIN_WINDOW 4
+#define RELIABLE_MAX_WINDOW RELIABLE_ACK_MASK_BITS
+// a message is lost when one sent RELIABLE_FAST_RETRANSMIT_THRESHOLD ids after it is acknowledged first,
+// or when one sent after it is acknowledged and it waits since more than RELIABLE_REORDER_RTT_FACTOR RTTs
+#define RELIABLE_FAST_RETRANSMIT_THRESHOLD 3
+#define RELIABLE_REORDER_RTT_FACTOR 1.25
+// nothing acknowledged since two RTTs (at least this): the newest message is sent again, its ack tells what is missing
+#define RELIABLE_MIN_PROBE_MILLI 10
+// retransmission timeout bounds, far below the TCP ones: game messages are late after a few frames
+#define RELIABLE_INITIAL_RTO_MILLI 200
+#define RELIABLE_MIN_RTO_MILLI 30
+#define RELIABLE_MAX_RTO_MILLI 2000
+
+namespace ASE
+{
+
+    /**
+     * @brief Delivery of a reliable message
+     * 
+     */
+    enum ReliableChannel : uint8_t {
+        CHANNEL_RELIABLE_ORDERED = 0,   // delivered in the order sent, a lost message holds back the next ordered ones only
+        CHANNEL_RELIABLE_UNORDERED = 1  // delivered as soon as received
+    };
+
+    /**
+     * @brief Header of a RELIABLE message, the data of the message carried follows
+     * 
+     */
+    struct ReliableMessageHeader
+    {
+        uint32_t id = 0;        // every reliable message of the direction
+        uint8_t channel = CHANNEL_RELIABLE_ORDERED;
+        uint32_t order = 0;     // ordered messages only
+        uint8_t hat = 0;
+    };
+
+    template<>
+    struct WireSchema<ReliableMessageHeader>
+    {
+        static constexpr auto fields = std::make_tuple(&ReliableMessageHeader::id, &ReliableMessageHeader::channel,
+                                                       &ReliableMessageHeader::order, &ReliableMessageHeader::hat);
+    };
+
+    /**
+     * @brief Data of a RACK message: every id before next_id is received, and the ids after it whose bit is set
+     * 
+     */
+    struct ReliableAck
+    {
+        uint32_t next_id = 0;
+        uint64_t received_mask = 0;     // bit i for the id next_id + 1 + i
+    };
+
+    template<>
+    struct WireSchema<ReliableAck>
+    {
+        static constexpr auto fields = std::make_tuple(&ReliableAck::next_id, &ReliableAck::received_mask);
+    };
+
+    /**
+     * @brief Counters of a reliable endpoint
+     * 
+     */
+    struct ReliableStats
+    {
+        double smoothed_rtt_milli = 0;
+        double rto_milli = 0;
+        double congestion_window = 0;
+        std::size_t in_flight = 0;
+        std::size_t waiting = 0;            // not sent yet, the window is full
+        std::size_t retransmit_count = 0;
+        std::size_t probe_count = 0;
+        std::size_t timeout_count = 0;
+    };
+
+    /**
+     * @brief Get the limits to check datagrams with, RELIABLE messages wrapping messages up to limits
+     * 
+     */
+    inline ConnectionLimits datagramLimits(const ConnectionLimits &limits)
+    {
+        ConnectionLimits output = limits;
+        output.max_message_size += RELIABLE_MESSAGE_HEADER_SIZE;
+        return output;
+    }
+
+
+    /**
+     * @brief Reliable delivery over the unreliable channel, for one peer, both directions: messages are kept
+     * until acknowledged by selective acks (RACK), retransmitted as soon as later ones are acknowledged, after a probe
+     * of the newest one or, at last, after a timer computed from the measured RTT, and the messages in flight are bounded by a congestion
+     * window (slow start, then additive increase and multiplicative decrease on loss, never below RELIABLE_MIN_WINDOW).
+     * Transport free: the owner moves the RELIABLE and RACK messages between the endpoint and its datagrams.
+     * Not thread safe
+     * 
+     */
+    class ReliableEndpoint
+    {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+        private:
+            /**
+             * @brief Compare the ids as sequence numbers wrapping around
+             * 
+             */
+            struct SequenceLess
+            {
+                bool operator()(uint32_t a, uint32_t b) const
+                {
+                    return isNewerSequence(b, a);
+                }
+            };
+
+            /**
+             * @brief Message sent and not acknowledged yet
+             * 
+             */
+            struct InFlight
+            {
+                std::vector<uint8_t> data;      // data of the RELIABLE message
+                Clock::time_point sent_at;
+                int transmissions;
+                bool lost;                      // to retransmit at the next fill
+            };
+
+            ConnectionLimits peer_limits_;
+
+            // ~~~~ sending ~~~~
+            std::deque<std::vector<uint8_t>> waiting_;  // data of RELIABLE messages not sent yet
+            std::map<uint32_t, InFlight, SequenceLess> in_flight_;
+            uint32_t next_id_;
+            uint32_t next_order_;
+
+            double congestion_window_;
+            double slow_start_threshold_;
+            uint32_t recovery_id_;      // messages sent before the last window reduction are below it
+
+            bool has_acked_;
+            uint32_t highest_acked_;
+            Clock::time_point latest_sent_acked_;   // last transmission of the last message acknowledged
+            Clock::time_point last_progress_;       // last ack of a message in flight, or last probe
+
+            bool has_rtt_;
+            double smoothed_rtt_;       // milliseconds
+            double rtt_variation_;
+            double rto_;
+
+            std::size_t retransmit_count_;
+            std::size_t probe_count_;
+            std::size_t timeout_count_;
+
+            // ~~~~ receiving ~~~~
+            uint32_t recv_next_id_;
+            std::set<uint32_t, SequenceLess> recv_above_;   // received after a missing one
+            uint32_t recv_next_order_;
+            std::map<uint32_t, Message, SequenceLess> recv_ordered_;    // waiting for a missing ordered one
+            std::deque<Message> delivered_;
+            bool ack_pending_;
+
+            /**
+             * @brief Take a RTT measure, RFC 6298 estimators
+             * 
+             */
+            void sampleRtt(double rtt_milli);
+
+            /**
+             * @brief Reduce the window once per window of messages lost
+             * 
+             */
+            void reduceWindow(uint32_t lost_id);
+
+            void handleAck(const ReliableAck &ack, Clock::time_point now);
+
+            /**
+             * @brief Mark lost the messages sent before an acknowledged one, far enough behind it in ids or in time
+             * 
+             */
+            void detectLosses(Clock::time_point now);
+
+            void handleMessage(const MessageView &message);
+
+        public:
+            /**
+             * @brief Create an endpoint
+             * 
+             * @param peer_limits receiving limits of the peer
+             */
+            ReliableEndpoint(const ConnectionLimits &peer_limits = ConnectionLimits());
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            /**
+             * @brief Get the counters of the endpoint
+             * 
+             * @return ReliableStats
+             */
+            ReliableStats getStats() const;
+
+            /**
+             * @brief Tell if messages are waiting to be sent or acknowledged
+             * 
+             */
+            inline bool hasPending() const
+            {
+                return !waiting_.empty() || !in_flight_.empty() || ack_pending_;
+            }
+
+
+            /**
+             * @brief Queue a message, sent by the next fills. Throw std::length_error if its data is bigger than
+             * RELIABLE_MAX_PAYLOAD_SIZE or the limits of the peer (big messages go on TCP, where they are fragmented)
+             * 
+             * @param message
+             * @param channel
+             */
+            void send(const Message &message, ReliableChannel channel);
+
+            /**
+             * @brief Handle a RELIABLE or RACK message received, other ones are ignored
+             * 
+             * @param message
+             * @param now
+             */
+            void receive(const MessageView &message, Clock::time_point now = Clock::now());
+
+            /**
+             * @brief Take the next message delivered by the ones received
+             * 
+             * @param output
+             * @return true if a message was taken
+             */
+            bool popDelivered(Message &output);
+
+            /**
+             * @brief Add to a frame what must be sent now, as much as fits in a datagram: the ack if one is due,
+             * the messages lost or whose timer expired, then new messages if the window allows it.
+             * Called again with another frame until it returns false when a lot is to send
+             * 
+             * @param frame frame of the datagram, may already hold messages
+             * @param now
+             * @param version wire version of the datagrams
+             * @return true if something was added
+             */
+            bool fillFrame(Frame &frame, Clock::time_point now = Clock::now(), WireVersion version = WIRE_V1);
+    };
+
+
+    /**
+     * @brief Drop a share of the datagrams sent, to test the reliable channels on loopback
+     * 
+     */
+    class LossSimulator
+    {
+        private:
+            double loss_rate_;
+            std::mt19937 generator_;
+            std::size_t dropped_count_;
+
+        public:
+            LossSimulator(): loss_rate_(0), generator_(std::random_device()()), dropped_count_(0)
+            {
+
+            }
+
+            /**
+             * @brief Set the share of datagrams dropped
+             * 
+             * @param loss_rate between 0 (none, the default) and 1
+             */
+            inline void setLossRate(double loss_rate)
+            {
+                loss_rate_ = loss_rate;
+            }
+
+            inline std::size_t getDroppedCount() const
+            {
+                return dropped_count_;
+            }
+
+            /**
+             * @brief Tell if the next datagram must be dropped
+             * 
+             */
+            inline bool drop()
+            {
+                if(loss_rate_ <= 0 || std::uniform_real_distribution<double>(0, 1)(generator_) >= loss_rate_)
+                {
+                    return false;
+                }
+                dropped_count_++;
+                return true;
+            }
+    };
+
+}
+
+#endif
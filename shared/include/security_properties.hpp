@@ -6,7 +6,10 @@
 #ifndef SECURITY_PROPERTIES
 #define SECURITY_PROPERTIES
 
+// defaults of ConnectionLimits, can be changed at runtime per Server and per ServerLink
 #define FRAME_SIZE_LIMIT 10
 #define MESSAGE_SIZE_LIMIT 255
+#define REASSEMBLY_SIZE_LIMIT 4194304       // bytes of fragmented messages being reassembled per connection
+#define REASSEMBLY_TRANSFER_LIMIT 64        // fragmented messages being reassembled at once per connection
 
 #endif
\ No newline at end of file
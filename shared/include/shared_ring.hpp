@@ -0,0 +1,268 @@
+/**
+ * @file shared_ring.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef SHARED_RING_HPP
+#define SHARED_RING_HPP
+
+namespace ASE
+{
+    class SharedMemoryLink;     // Linux only, declared for the signatures common to all platforms
+}
+
+#if defined(__linux__)
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <span>
+
+#include "cross_sockets.hpp"
+#include "frame.hpp"
+#include "frame_view.hpp"
+#include "frame_receiver.hpp"
+#include "compression.hpp"
+
+// bytes of each direction, a power of two
+#define SHARED_RING_CAPACITY (1 << 20)
+// checks of an empty (or full) ring before sleeping on its futex, none on a single core
+#define SHARED_RING_SPIN_COUNT 4096
+// longest sleep on a futex, so that a peer gone without closing the ring is noticed
+#define SHARED_RING_WAIT_MILLI 100
+
+namespace ASE
+{
+
+    /**
+     * @brief Control block of a ring, in the shared memory. Each counter on its own cache line
+     * 
+     */
+    struct SharedRingControl
+    {
+        alignas(64) std::atomic<uint64_t> head;         // bytes read, written by the reader only
+        alignas(64) std::atomic<uint64_t> tail;         // bytes written, written by the writer only
+        alignas(64) std::atomic<uint32_t> data_futex;   // bumped to wake the reader
+        std::atomic<uint32_t> reader_sleeping;
+        alignas(64) std::atomic<uint32_t> space_futex;  // bumped to wake the writer
+        std::atomic<uint32_t> writer_sleeping;
+        alignas(64) std::atomic<uint32_t> closed;
+    };
+
+
+    /**
+     * @brief One direction of a shared memory connection: single producer single consumer byte ring.
+     * Reads and writes are plain copies and atomic counters, a futex system call only happens
+     * when the other side sleeps because the ring was empty (or full) for a while
+     * 
+     */
+    class SharedRing
+    {
+        private:
+            SharedRingControl *control_;
+            uint8_t *data_;
+
+            /**
+             * @brief Spin then sleep on a futex until ready returns true
+             * 
+             * @param futex futex bumped by the other side
+             * @param sleeping flag telling the other side to bump and wake
+             * @param timeout_milli
+             * @return true if ready, false on timeout
+             */
+            template<typename Ready>
+            bool wait(std::atomic<uint32_t> &futex, std::atomic<uint32_t> &sleeping, int timeout_milli, Ready ready);
+
+            /**
+             * @brief Wake the other side if it sleeps on futex
+             * 
+             */
+            static void wake(std::atomic<uint32_t> &futex, std::atomic<uint32_t> &sleeping);
+
+        public:
+            SharedRing(SharedRingControl *control = nullptr, uint8_t *data = nullptr): control_(control), data_(data)
+            {
+
+            }
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            bool isClosed() const
+            {
+                return control_->closed.load(std::memory_order_acquire) != 0;
+            }
+
+            /**
+             * @brief Get the bytes written and not read yet, only their part before the end of the ring
+             * 
+             * @return std::span<const uint8_t>
+             */
+            std::span<const uint8_t> readable() const;
+
+
+            /**
+             * @brief Write all the bytes, waiting for room if the ring is full
+             * 
+             * @param data
+             * @return true if written, false if the ring is closed
+             */
+            bool write(std::span<const uint8_t> data);
+
+            /**
+             * @brief Release bytes read from readable
+             * 
+             * @param size
+             */
+            void consume(std::size_t size);
+
+            /**
+             * @brief Wait until bytes can be read or the ring is closed
+             * 
+             * @param timeout_milli
+             * @return true if bytes can be read or the ring is closed, false on timeout
+             */
+            bool waitReadable(int timeout_milli);
+
+            /**
+             * @brief Close the ring, the sides waiting on it wake up
+             * 
+             */
+            void close();
+    };
+
+
+    /**
+     * @brief Connection between two processes of the same host through a pair of SharedRing in a shared memory
+     * file: created by the client, its descriptor is given to the server through their Unix socket.
+     * Or between two threads of the same process, both ends sharing one private memory (createLocalPair).
+     * Carries the same byte stream as a socket, frames are serialized and parsed the usual way
+     * 
+     */
+    class SharedMemoryLink
+    {
+        private:
+            std::shared_ptr<void> memory_;      // shared by both ends of a local pair, unmapped by the last one
+            std::size_t memory_size_;
+            bool server_side_;
+            SOCKET socket_;     // Unix socket of the handshake, its hang up tells the peer is gone, INVALID_SOCKET for a local pair
+
+            SharedRing to_server_;
+            SharedRing to_client_;
+
+            std::vector<uint8_t> send_buffer_;  // capacity reused by the frames sent
+
+            /**
+             * @brief Map a shared memory file holding the two rings
+             * 
+             * @param fd
+             * @param initialize reset the control blocks
+             */
+            void map(int fd, bool initialize);
+
+            /**
+             * @brief Own a memory holding the two rings
+             * 
+             * @param memory mapping of memory_size_ bytes
+             * @param initialize reset the control blocks
+             */
+            void attach(void *memory, bool initialize);
+
+            void unmap();
+
+            SharedRing &outgoing()
+            {
+                return server_side_ ? to_client_ : to_server_;
+            }
+
+            SharedRing &incoming()
+            {
+                return server_side_ ? to_server_ : to_client_;
+            }
+
+        public:
+            SharedMemoryLink();
+            ~SharedMemoryLink();
+
+            SharedMemoryLink(const SharedMemoryLink&) = delete;
+            SharedMemoryLink &operator=(const SharedMemoryLink&) = delete;
+
+            SharedMemoryLink(SharedMemoryLink &&other) noexcept;
+
+            /**
+             * @brief Close the link held then take the one of other, other is left closed
+             * 
+             */
+            SharedMemoryLink &operator=(SharedMemoryLink &&other) noexcept;
+
+            bool isOpen() const
+            {
+                return memory_ != nullptr;
+            }
+
+            /**
+             * @brief Create the shared memory and give it to the server, client side.
+             * Throw ServerConnectionException on failure
+             * 
+             * @param unix_socket socket connected to the server, its handshake done
+             */
+            void create(SOCKET unix_socket);
+
+            /**
+             * @brief Connect two ends in the same process, no file nor socket: the rings are in a private memory 
+             * shared by both ends, kept until both are closed. Throw ServerConnectionException on failure
+             * 
+             * @param client_end
+             * @param server_end
+             */
+            static void createLocalPair(SharedMemoryLink &client_end, SharedMemoryLink &server_end);
+
+            /**
+             * @brief Take the shared memory given by the client, server side.
+             * Throw RemoteConnectionException on failure
+             * 
+             * @param unix_socket blocking socket of the client, its handshake done
+             */
+            void accept(SOCKET unix_socket);
+
+            /**
+             * @brief Send a frame, as sendFrame would on a socket. Throw RemoteConnectionException if the link is closed (or unmapped)
+             * 
+             * @param frame
+             * @param compression
+             * @param version
+             */
+            void sendFrame(Frame &frame, CompressionContext *compression = nullptr, WireVersion version = WIRE_V1);
+
+            /**
+             * @brief Wait for a frame, the bytes are moved from the ring to the receiver, which parses them.
+             * Throw RemoteConnectionException if the link is closed (or unmapped) or the Unix socket (if any) hung up
+             * 
+             * @param receiver receiver without socket
+             * @param output view on the frame received
+             * @param timeout_milli
+             * @return true if a frame was received, false on timeout
+             */
+            bool recvFrameView(FrameReceiver &receiver, FrameView &output, int timeout_milli = SHARED_RING_WAIT_MILLI);
+
+            /**
+             * @brief Close both directions without unmapping: the threads waiting on the link wake up and throw,
+             * the memory stays valid until close once they are done <Thread Safe>
+             * 
+             */
+            void shutdown();
+
+            /**
+             * @brief Close both directions and unmap the memory, the Unix socket is left to its owner.
+             * No other thread may use the link anymore, see shutdown
+             * 
+             */
+            void close();
+    };
+
+}
+
+#endif
+
+#endif
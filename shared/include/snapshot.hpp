@@ -0,0 +1,131 @@
+/**
+ * @file snapshot.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <array>
+#include <span>
+
+#include "message.hpp"
+#include "frame_view.hpp"
+
+// number of snapshots remembered per connection, on both sides
+#ifndef SNAPSHOT_HISTORY_SIZE
+#define SNAPSHOT_HISTORY_SIZE 32
+#endif
+
+namespace ASE
+{
+
+    /**
+     * @brief Snapshot kept by encoder and decoder to serve as delta baseline
+     * 
+     */
+    struct SnapshotEntry
+    {
+        uint32_t id = 0;    // 0 is an empty slot
+        std::vector<uint8_t> state;
+    };
+
+    /**
+     * @brief Server side of the snapshots of one client: remembers the last snapshots sent
+     * and encodes each new one as a XOR/RLE delta against the newest one acknowledged by the client
+     * 
+     * SNAPSHOT payload: id (u32), baseline id (u32, 0 for a full snapshot), state size (u32), body.
+     * The body is the state for a full snapshot, else a list of (zeros to skip, bytes to copy) varint pairs
+     * each followed by the bytes to copy, applied on baseline XOR new state
+     */
+    class SnapshotEncoder
+    {
+        private:
+            std::array<SnapshotEntry, SNAPSHOT_HISTORY_SIZE> history_;
+            uint32_t next_id_;
+            uint32_t newest_acked_id_;
+            std::vector<uint8_t> xor_scratch_;
+
+        public:
+
+            SnapshotEncoder();
+
+            /**
+             * @brief Encode the new state in a SNAPSHOT message and remember it
+             * 
+             * @param state full state of the world as seen by this client
+             * @return Message 
+             */
+            Message encode(std::span<const uint8_t> state);
+
+            /**
+             * @brief Mark a snapshot as received by the client, it becomes the baseline if it is the newest
+             * 
+             * @param snapshot_id 
+             */
+            void acknowledge(uint32_t snapshot_id);
+
+            /**
+             * @brief Get the id of the newest snapshot acknowledged by the client, 0 if none
+             * 
+             */
+            inline uint32_t getNewestAckedId() const
+            {
+                return newest_acked_id_;
+            }
+
+            /**
+             * @brief Forget all snapshots, next one will be full
+             * 
+             */
+            void reset();
+    };
+
+
+    /**
+     * @brief Client side of the snapshots: rebuilds the states from full and delta SNAPSHOT messages
+     * 
+     */
+    class SnapshotDecoder
+    {
+        private:
+            std::array<SnapshotEntry, SNAPSHOT_HISTORY_SIZE> history_;
+            uint32_t latest_id_;
+
+        public:
+
+            SnapshotDecoder();
+
+            /**
+             * @brief Rebuild the state of a SNAPSHOT message, throw DataSizeException if it is corrupted
+             * 
+             * @param message 
+             * @return uint32_t id of the snapshot to acknowledge, 0 if its baseline is unknown (snapshot dropped)
+             */
+            uint32_t decode(const MessageView &message);
+
+            /**
+             * @brief Get the id of the newest snapshot rebuilt, 0 if none
+             * 
+             */
+            inline uint32_t getLatestId() const
+            {
+                return latest_id_;
+            }
+
+            /**
+             * @brief Get the newest state rebuilt, empty if none
+             * 
+             * @return std::span<const uint8_t> valid until the next decode
+             */
+            std::span<const uint8_t> getLatestState() const;
+
+            void reset();
+    };
+
+}
+
+
+#endif
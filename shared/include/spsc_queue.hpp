@@ -0,0 +1,125 @@
+/**
+ * @file spsc_queue.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <cstddef>
+#include <vector>
+#include <atomic>
+#include <utility>
+
+namespace ASE
+{
+
+    /**
+     * @brief Bounded lock-free queue between exactly one producer thread and one consumer thread.
+     * Each side keeps a copy of the other's counter, so a push or a pop only reads the shared
+     * counter of the other side when the copy says the queue is full (or empty)
+     * 
+     * @tparam T default constructible and movable
+     */
+    template<typename T>
+    class SpscQueue
+    {
+        private:
+            std::vector<T> slots_;
+            std::size_t mask_;
+
+            alignas(64) std::atomic<std::size_t> head_;     // items popped, written by the consumer only
+            std::size_t cached_tail_;                       // consumer's copy of tail_
+            alignas(64) std::atomic<std::size_t> tail_;     // items pushed, written by the producer only
+            std::size_t cached_head_;                       // producer's copy of head_
+
+        public:
+            /**
+             * @brief Construct a new Spsc Queue
+             * 
+             * @param capacity rounded up to a power of two
+             */
+            explicit SpscQueue(std::size_t capacity): head_(0), cached_tail_(0), tail_(0), cached_head_(0)
+            {
+                std::size_t size = 1;
+                while(size < capacity)
+                {
+                    size <<= 1;
+                }
+                slots_.resize(size);
+                mask_ = size - 1;
+            }
+
+            SpscQueue(const SpscQueue&) = delete;
+            SpscQueue &operator=(const SpscQueue&) = delete;
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            std::size_t getCapacity() const
+            {
+                return slots_.size();
+            }
+
+            /**
+             * @brief Get the number of items waiting, only a hint when read by a third thread
+             * 
+             * @return std::size_t
+             */
+            std::size_t getSize() const
+            {
+                std::size_t head = head_.load(std::memory_order_acquire);
+                return tail_.load(std::memory_order_acquire) - head;
+            }
+
+
+            /**
+             * @brief Push an item, producer thread only
+             * 
+             * @param value moved in only if pushed
+             * @return true if pushed, false if the queue is full
+             */
+            bool tryPush(T &&value)
+            {
+                std::size_t tail = tail_.load(std::memory_order_relaxed);
+                if(tail - cached_head_ == slots_.size())
+                {
+                    cached_head_ = head_.load(std::memory_order_acquire);
+                    if(tail - cached_head_ == slots_.size())
+                    {
+                        return false;
+                    }
+                }
+
+                slots_[tail & mask_] = std::move(value);
+                tail_.store(tail + 1, std::memory_order_release);
+                return true;
+            }
+
+            /**
+             * @brief Pop the oldest item, consumer thread only
+             * 
+             * @param output
+             * @return true if an item was popped, false if the queue is empty
+             */
+            bool tryPop(T &output)
+            {
+                std::size_t head = head_.load(std::memory_order_relaxed);
+                if(head == cached_tail_)
+                {
+                    cached_tail_ = tail_.load(std::memory_order_acquire);
+                    if(head == cached_tail_)
+                    {
+                        return false;
+                    }
+                }
+
+                // the slot is left empty, its resources are not kept by the queue
+                output = std::exchange(slots_[head & mask_], T());
+                head_.store(head + 1, std::memory_order_release);
+                return true;
+            }
+    };
+
+}
+
+#endif
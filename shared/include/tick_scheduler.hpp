@@ -0,0 +1,194 @@
+/**
+ * @file tick_scheduler.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef TICK_SCHEDULER_HPP
+#define TICK_SCHEDULER_HPP
+
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+#include <atomic>
+
+#include "virtual_clock.hpp"
+
+namespace ASE
+{
+
+    /**
+     * @brief Phases of a tick, run in this order
+     * 
+     */
+    enum TickPhase
+    {
+        TICK_PRE_INPUT,         // take the inputs received since the last tick
+        TICK_SIMULATE,          // game logic
+        TICK_BUILD_SNAPSHOT,    // state to send to the clients
+        TICK_FLUSH_SENDS,       // frames sent to the clients
+        TICK_PHASE_COUNT
+    };
+
+    /**
+     * @brief What to do with the ticks whose deadline passed while a tick was running
+     * 
+     */
+    enum TickCatchUpPolicy
+    {
+        TICK_CATCH_UP,          // run them back to back, at most max_catch_up_ticks late, the older ones are skipped
+        TICK_SKIP               // skip them, the next tick runs at once then the deadlines go on from it
+    };
+
+
+    /**
+     * @brief Measures of a TickScheduler since its start (or resetStats).
+     * The jitter is the lateness of the start of a tick on its deadline, in the scheduler clock,
+     * the work times are real times
+     * 
+     */
+    struct TickStats
+    {
+        using Duration = std::chrono::steady_clock::duration;
+
+        uint64_t ticks = 0;             // started
+        uint64_t overruns = 0;          // ticks ended after the deadline of the next one
+        uint64_t skipped = 0;           // deadlines dropped by the catch up policy
+
+        Duration last_jitter = Duration::zero();
+        Duration max_jitter = Duration::zero();
+        Duration total_jitter = Duration::zero();
+
+        Duration last_work = Duration::zero();
+        Duration max_work = Duration::zero();
+
+        Duration phase_work[TICK_PHASE_COUNT] = {};     // of the last tick
+
+        Duration getMeanJitter() const
+        {
+            return ticks == 0 ? Duration::zero() : total_jitter / Duration::rep(ticks);
+        }
+    };
+
+
+    /**
+     * @brief Runs ticks at a fixed rate: the deadline of each tick is the one of the previous tick plus the period,
+     * so the rate does not drift with the work time of the ticks. The thread running the ticks calls
+     * waitNextTick, runPhase for each phase, then endTick. The stats can be read by any thread
+     * 
+     */
+    class TickScheduler
+    {
+        public:
+            using Clock = VirtualClock::Clock;
+
+        private:
+            VirtualClock &clock_;
+            Clock::duration period_;
+            TickCatchUpPolicy policy_;
+            int max_catch_up_ticks_;
+
+            std::atomic<uint64_t> tick_;    // read by the other threads to date what they receive
+            Clock::time_point deadline_;    // of the current tick
+            Clock::time_point work_start_;  // real time
+            bool started_;
+
+            TickStats stats_;
+            mutable std::mutex stats_mutex_;
+
+        public:
+            /**
+             * @brief Construct a new Tick Scheduler
+             * 
+             * @param clock clock of the deadlines, real or virtual
+             * @param period
+             */
+            TickScheduler(VirtualClock &clock, Clock::duration period = std::chrono::milliseconds(10));
+
+            TickScheduler(const TickScheduler&) = delete;
+            TickScheduler &operator=(const TickScheduler&) = delete;
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            Clock::duration getPeriod() const
+            {
+                return period_;
+            }
+
+            /**
+             * @brief Get the number of the current tick (of the last one once ended), the first one is 0 <Thread Safe>
+             * 
+             * @return uint64_t
+             */
+            uint64_t getTick() const
+            {
+                return tick_.load(std::memory_order_relaxed);
+            }
+
+            /**
+             * @brief Get a copy of the measures <Thread Safe>
+             * 
+             * @return TickStats
+             */
+            TickStats getStats() const;
+
+
+            // ~~~~~~~~~~ SET ~~~~~~~~~~
+
+            /**
+             * @brief Set the period, the next deadline is still the one planned
+             * 
+             * @param period
+             */
+            void setPeriod(Clock::duration period);
+
+            /**
+             * @brief Set what is done with the ticks late
+             * 
+             * @param policy
+             * @param max_catch_up_ticks ticks late run back to back at most with TICK_CATCH_UP
+             */
+            void setCatchUpPolicy(TickCatchUpPolicy policy, int max_catch_up_ticks = 5);
+
+            /**
+             * @brief Clear the measures <Thread Safe>
+             * 
+             */
+            void resetStats();
+
+
+            /**
+             * @brief Sleep until the deadline of the next tick, the first tick is due at once.
+             * Ticks late are skipped or not depending on the catch up policy
+             * 
+             * @return uint64_t number of the tick to run
+             */
+            uint64_t waitNextTick();
+
+            /**
+             * @brief Run a phase of the current tick, its real time is measured
+             * 
+             * @param phase
+             * @param run
+             */
+            template<typename Run>
+            void runPhase(TickPhase phase, Run &&run)
+            {
+                auto start = std::chrono::steady_clock::now();
+                run();
+                auto spent = std::chrono::steady_clock::now() - start;
+
+                std::lock_guard<std::mutex> lock(stats_mutex_);
+                stats_.phase_work[phase] = spent;
+            }
+
+            /**
+             * @brief End the current tick: its work time is measured, and it is an overrun if the deadline
+             * of the next tick already passed
+             * 
+             */
+            void endTick();
+    };
+
+}
+
+#endif
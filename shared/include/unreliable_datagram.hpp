@@ -0,0 +1,134 @@
+/**
+ * @file unreliable_datagram.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef UNRELIABLE_DATAGRAM_HPP
+#define UNRELIABLE_DATAGRAM_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <span>
+#include <tuple>
+
+#include "frame.hpp"
+#include "frame_view.hpp"
+#include "frame_receiver.hpp"
+#include "wire_schema.hpp"
+#include "connection_limits.hpp"
+
+// token then sequence number, before the frame
+#define UNRELIABLE_HEADER_SIZE 12
+// biggest datagram sent, below the usual path MTU so that datagrams are never fragmented by IP
+#define UNRELIABLE_MAX_DATAGRAM_SIZE 1200
+
+namespace ASE
+{
+
+    /**
+     * @brief Header of the datagrams of the unreliable channel: the token pairs the datagram with a TCP connection,
+     * the sequence number lets the receiver drop the datagrams older than the newest one received
+     * 
+     */
+    struct UnreliableHeader
+    {
+        uint64_t token = 0;
+        uint32_t sequence = 0;
+    };
+
+    template<>
+    struct WireSchema<UnreliableHeader>
+    {
+        static constexpr auto fields = std::make_tuple(&UnreliableHeader::token, &UnreliableHeader::sequence);
+    };
+
+    /**
+     * @brief Tell if sequence was sent after last, the counters wrapping around
+     * 
+     */
+    inline bool isNewerSequence(uint32_t sequence, uint32_t last)
+    {
+        return int32_t(sequence - last) > 0;
+    }
+
+    /**
+     * @brief Read the header of a datagram
+     * 
+     * @param datagram
+     * @param output
+     * @return true if the datagram is big enough to hold a header
+     */
+    bool decodeUnreliableHeader(std::span<const uint8_t> datagram, UnreliableHeader &output);
+
+    /**
+     * @brief Write a datagram: header then the frame, never compressed. Throw std::length_error if the datagram
+     * would be bigger than UNRELIABLE_MAX_DATAGRAM_SIZE, the channel does not fragment
+     * 
+     * @param header
+     * @param frame
+     * @param version wire version negotiated on the TCP connection
+     * @param output cleared then filled with the datagram
+     */
+    void encodeUnreliableDatagram(const UnreliableHeader &header, Frame &frame, WireVersion version, std::vector<uint8_t> &output);
+
+
+    /**
+     * @brief Receiving side of one direction of an unreliable channel: checks the frame of each datagram
+     * against the limits and tells which ones arrive after a newer one, their unreliable messages must be dropped
+     * 
+     */
+    class UnreliableReceiver
+    {
+        private:
+            FrameReceiver receiver_;
+            uint32_t last_sequence_;
+            bool received_;             // a datagram was accepted, last_sequence_ is meaningful
+
+            std::size_t dropped_count_; // datagrams older than the newest one or malformed
+
+        public:
+            UnreliableReceiver(WireVersion version = WIRE_V1, const ConnectionLimits &limits = ConnectionLimits());
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            /**
+             * @brief Get the sequence number of the newest datagram accepted
+             * 
+             * @return uint32_t
+             */
+            inline uint32_t getLastSequence() const
+            {
+                return last_sequence_;
+            }
+
+            /**
+             * @brief Get the number of datagrams malformed, or older than the newest one (only their reliable messages are used)
+             * 
+             * @return std::size_t
+             */
+            inline std::size_t getDroppedCount() const
+            {
+                return dropped_count_;
+            }
+
+            /**
+             * @brief Forget the datagrams received, the next one is accepted whatever its sequence number
+             * 
+             */
+            void reset();
+
+            /**
+             * @brief Read a datagram whose header was already read
+             * 
+             * @param header
+             * @param datagram whole datagram, header included
+             * @param output view on the frame carried, keeps the bytes alive
+             * @param newest set to true if the datagram is newer than all the ones read before
+             * @return true if the datagram holds exactly one valid frame
+             */
+            bool receive(const UnreliableHeader &header, std::span<const uint8_t> datagram, FrameView &output, bool &newest);
+    };
+
+}
+
+#endif
@@ -0,0 +1,88 @@
+/**
+ * @file varint.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef VARINT_HPP
+#define VARINT_HPP
+
+#include <stdint.h>
+#include <cstddef>
+
+#include "connection_expections.hpp"
+
+// biggest encoded size of a 64 bits varint
+#define VARINT_MAX_SIZE 10
+
+namespace ASE
+{
+
+    /**
+     * @brief Write value as a LEB128 varint: 7 bits per byte, high bit set when more bytes follow
+     * 
+     * @param value 
+     * @param out must have room for VARINT_MAX_SIZE bytes
+     * @return std::size_t number of bytes written
+     */
+    inline std::size_t encodeVarint(uint64_t value, uint8_t *out)
+    {
+        std::size_t size = 0;
+        while(value >= 0x80)
+        {
+            out[size++] = uint8_t(value) | 0x80;
+            value >>= 7;
+        }
+        out[size++] = uint8_t(value);
+        return size;
+    }
+
+    /**
+     * @brief Get the number of bytes of value as a varint
+     * 
+     */
+    inline std::size_t varintSize(uint64_t value)
+    {
+        std::size_t size = 1;
+        while(value >= 0x80)
+        {
+            value >>= 7;
+            size++;
+        }
+        return size;
+    }
+
+    /**
+     * @brief Read a LEB128 varint, throw DataSizeException if it is longer than VARINT_MAX_SIZE
+     * 
+     * @param in 
+     * @param available number of bytes readable at in
+     * @param value read value
+     * @return std::size_t number of bytes read, 0 if the varint is incomplete
+     */
+    inline std::size_t decodeVarint(const uint8_t *in, std::size_t available, uint64_t &value)
+    {
+        value = 0;
+        for(std::size_t i = 0; i < available; i++)
+        {
+            if(i >= VARINT_MAX_SIZE)
+            {
+                throw DataSizeException("Varint too long");
+            }
+
+            value |= uint64_t(in[i] & 0x7F) << (7 * i);
+            if((in[i] & 0x80) == 0)
+            {
+                return i + 1;
+            }
+        }
+
+        if(available >= VARINT_MAX_SIZE)
+        {
+            throw DataSizeException("Varint too long");
+        }
+        return 0;
+    }
+
+}
+
+#endif
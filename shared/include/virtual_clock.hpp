@@ -0,0 +1,118 @@
+/**
+ * @file virtual_clock.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef VIRTUAL_CLOCK_HPP
+#define VIRTUAL_CLOCK_HPP
+
+#include <chrono>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+
+namespace ASE
+{
+
+    /**
+     * @brief Time of a server: the steady clock by default, or a virtual time only moved by advance,
+     * so that a headless simulation runs its ticks as fast as they are computed.
+     * In virtual time, sleepFor waits until the clock is advanced past its deadline <Thread Safe>
+     * 
+     */
+    class VirtualClock
+    {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+        private:
+            bool virtual_;
+            Clock::time_point now_;                 // virtual time only
+            std::multiset<Clock::time_point> wakeups_;  // deadlines of the threads sleeping in virtual time
+
+            mutable std::mutex mutex_;
+            std::condition_variable advanced_;      // the clock moved, or switched to real time
+            std::condition_variable sleeping_;      // a thread started sleeping
+
+            /**
+             * @brief Count the threads sleeping until after the virtual time, mutex_ held
+             * 
+             */
+            std::size_t countSleeping() const;
+
+        public:
+            VirtualClock();
+
+            // ~~~~~~~~~~ GET ~~~~~~~~~~
+
+            bool isVirtual() const;
+
+            /**
+             * @brief Get the current time, virtual or not
+             * 
+             * @return Clock::time_point
+             */
+            Clock::time_point now() const;
+
+            /**
+             * @brief Get the number of threads sleeping in virtual time
+             * 
+             * @return std::size_t
+             */
+            std::size_t getSleepingCount() const;
+
+
+            // ~~~~~~~~~~ SET ~~~~~~~~~~
+
+            /**
+             * @brief Switch to virtual time, starting from the current real time, or back to real time
+             * (the threads sleeping in virtual time wake up)
+             * 
+             * @param is_virtual
+             */
+            void setVirtual(bool is_virtual);
+
+
+            /**
+             * @brief Sleep for a duration of the clock
+             * 
+             * @param duration
+             */
+            void sleepFor(Clock::duration duration);
+
+            /**
+             * @brief Sleep until a time of the clock, nothing if it passed. In real time, an absolute
+             * deadline does not drift with the time spent before calling it (clock_nanosleep on Linux)
+             * 
+             * @param deadline
+             */
+            void sleepUntil(Clock::time_point deadline);
+
+            /**
+             * @brief Move the virtual time forward, waking the threads whose deadline passed. Nothing in real time
+             * 
+             * @param duration
+             */
+            void advance(Clock::duration duration);
+
+            /**
+             * @brief Move the virtual time to the earliest deadline of the sleeping threads
+             * 
+             * @return true if a thread was sleeping
+             */
+            bool advanceToNextWakeup();
+
+            /**
+             * @brief Wait (in real time) until a number of threads sleep in virtual time,
+             * e.g. the main thread once its tick is done
+             * 
+             * @param count
+             * @param timeout real time
+             * @return true if they sleep, false on timeout
+             */
+            bool waitSleeping(std::size_t count, Clock::duration timeout);
+    };
+
+}
+
+#endif
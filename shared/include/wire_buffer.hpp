@@ -0,0 +1,94 @@
+/**
+ * @file wire_buffer.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef WIRE_BUFFER_HPP
+#define WIRE_BUFFER_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <memory>
+
+#include "message.hpp"
+#include "wire_codec.hpp"
+
+namespace ASE
+{
+
+    /**
+     * @brief Immutable list of messages already serialized (headers and payloads),
+     * built once and sent as-is by every connection of a broadcast.
+     * Holds one encoding per wire version, connections pick the one they negotiated
+     * 
+     */
+    class WireBuffer
+    {
+        private:
+            std::vector<uint8_t> bytes_v1_;
+            std::vector<uint8_t> bytes_v2_;
+            int length_;
+            std::size_t max_message_size_;
+
+        public:
+
+            /**
+             * @brief Serialize the messages
+             * 
+             * @param messages 
+             */
+            WireBuffer(const std::vector<Message> &messages);
+
+            /**
+             * @brief Get the number of messages serialized
+             * 
+             * @return int 
+             */
+            inline int getLength() const
+            {
+                return length_;
+            }
+
+            /**
+             * @brief Get the data size of the biggest message serialized
+             * 
+             * @return std::size_t 
+             */
+            inline std::size_t getMaxMessageSize() const
+            {
+                return max_message_size_;
+            }
+
+            /**
+             * @brief Copy back the serialized messages, for receivers who cannot take them as-is
+             * 
+             * @return std::vector<Message> 
+             */
+            std::vector<Message> toMessages() const;
+
+            /**
+             * @brief Get the messages serialized for a wire version
+             * 
+             * @param version wire version of the receiving connection
+             * @return const std::vector<uint8_t>& 
+             */
+            inline const std::vector<uint8_t> &getBytes(WireVersion version = WIRE_V1) const
+            {
+                return version == WIRE_V2 ? bytes_v2_ : bytes_v1_;
+            }
+    };
+
+    using SharedWireBuffer = std::shared_ptr<const WireBuffer>;
+
+    /**
+     * @brief Serialize messages once in a shared buffer
+     * 
+     * @param messages 
+     * @return SharedWireBuffer 
+     */
+    SharedWireBuffer makeWireBuffer(const std::vector<Message> &messages);
+
+}
+
+
+#endif
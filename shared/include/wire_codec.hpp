@@ -0,0 +1,306 @@
+/**
+ * @file wire_codec.hpp
+ * @author Yann Le Masson
+ * 
+ */
+#ifndef WIRE_CODEC_HPP
+#define WIRE_CODEC_HPP
+
+#include <stdint.h>
+#include <cstddef>
+#include <stdexcept>
+
+#include "message_codes.hpp"
+#include "varint.hpp"
+#include "connection_expections.hpp"
+
+// biggest frame header of all versions (v2 compressed: two varints of 24 bits values)
+#define WIRE_MAX_FRAME_HEADER_SIZE 8
+// biggest message header of all versions (v2: code and a varint of 24 bits value)
+#define WIRE_MAX_MESSAGE_HEADER_SIZE 5
+// biggest value of a count or a size, v1 stores them on 24 bits
+#define WIRE_MAX_FIELD_VALUE 0xFFFFFF
+
+namespace ASE
+{
+
+/**
+ * @brief Framing of a connection, negotiated during the handshake (handshake frames are always v1)
+ * 
+ * v1: frame   [LENGTH][count 24 bits] messages [END]
+ *     zframe  [ZLENGTH][compressed size 24 bits][raw size 24 bits] compressed v1 frame
+ *     message [code][size 24 bits] data
+ * 
+ * v2: frame   varint(count << 1) messages
+ *     zframe  varint(compressed size << 1 | 1) varint(raw size) compressed v2 frame
+ *     message [code] varint(size) data
+ */
+enum WireVersion : uint8_t {
+  WIRE_V1 = 1,
+  WIRE_V2 = 2
+};
+
+/**
+ * @brief Decoded frame header
+ * 
+ */
+struct WireFrameHeader
+{
+    bool compressed = false;
+    std::size_t nb_messages = 0;        // raw frames only
+    std::size_t compressed_size = 0;    // compressed frames only
+    std::size_t raw_size = 0;           // compressed frames only
+};
+
+
+// ~~~~~~~~~~ ENCODING ~~~~~~~~~~
+
+/**
+ * @brief Write the header of a raw frame of nb_messages messages
+ * 
+ * @param out must have room for WIRE_MAX_FRAME_HEADER_SIZE bytes
+ * @return std::size_t number of bytes written
+ */
+inline std::size_t encodeFrameHeader(WireVersion version, std::size_t nb_messages, uint8_t *out)
+{
+    if(nb_messages > WIRE_MAX_FIELD_VALUE)
+    {
+        throw std::length_error("Frame Length to high");
+    }
+
+    if(version == WIRE_V2)
+    {
+        return encodeVarint(uint64_t(nb_messages) << 1, out);
+    }
+
+    out[0] = LENGTH;
+    out[1] = uint8_t(nb_messages);
+    out[2] = uint8_t(nb_messages >> 8);
+    out[3] = uint8_t(nb_messages >> 16);
+    return 4;
+}
+
+/**
+ * @brief Write the header of a compressed frame
+ * 
+ * @param out must have room for WIRE_MAX_FRAME_HEADER_SIZE bytes
+ * @return std::size_t number of bytes written
+ */
+inline std::size_t encodeCompressedFrameHeader(WireVersion version, std::size_t compressed_size, std::size_t raw_size, uint8_t *out)
+{
+    if(compressed_size > WIRE_MAX_FIELD_VALUE || raw_size > WIRE_MAX_FIELD_VALUE)
+    {
+        throw std::length_error("Frame Data to high");
+    }
+
+    if(version == WIRE_V2)
+    {
+        std::size_t size = encodeVarint((uint64_t(compressed_size) << 1) | 1, out);
+        return size + encodeVarint(raw_size, out + size);
+    }
+
+    out[0] = ZLENGTH;
+    out[1] = uint8_t(compressed_size);
+    out[2] = uint8_t(compressed_size >> 8);
+    out[3] = uint8_t(compressed_size >> 16);
+    out[4] = uint8_t(raw_size);
+    out[5] = uint8_t(raw_size >> 8);
+    out[6] = uint8_t(raw_size >> 16);
+    return 7;
+}
+
+/**
+ * @brief Write the header of a message
+ * 
+ * @param out must have room for WIRE_MAX_MESSAGE_HEADER_SIZE bytes
+ * @return std::size_t number of bytes written
+ */
+inline std::size_t encodeMessageHeader(WireVersion version, uint8_t hat, std::size_t size, uint8_t *out)
+{
+    if(size > WIRE_MAX_FIELD_VALUE)
+    {
+        throw std::length_error("Message Data to high");
+    }
+
+    out[0] = hat;
+
+    if(version == WIRE_V2)
+    {
+        return 1 + encodeVarint(size, out + 1);
+    }
+
+    out[1] = uint8_t(size);
+    out[2] = uint8_t(size >> 8);
+    out[3] = uint8_t(size >> 16);
+    return 4;
+}
+
+/**
+ * @brief Write the end of a frame
+ * 
+ * @param out must have room for 1 byte
+ * @return std::size_t number of bytes written
+ */
+inline std::size_t encodeFrameEnd(WireVersion version, uint8_t *out)
+{
+    if(version == WIRE_V2)
+    {
+        return 0;
+    }
+
+    out[0] = END;
+    return 1;
+}
+
+
+// ~~~~~~~~~~ DECODING ~~~~~~~~~~
+
+/**
+ * @brief Read a frame header, throw RemoteConnectionException on a bad code
+ * and DataSizeException on a value out of the 24 bits range
+ * 
+ * @param in
+ * @param available number of bytes readable at in
+ * @param header decoded header
+ * @return std::size_t size of the header, 0 if incomplete
+ */
+inline std::size_t decodeFrameHeader(WireVersion version, const uint8_t *in, std::size_t available, WireFrameHeader &header)
+{
+    header = WireFrameHeader();
+
+    if(version == WIRE_V2)
+    {
+        uint64_t first;
+        std::size_t size = decodeVarint(in, available, first);
+        if(size == 0)
+        {
+            return 0;
+        }
+
+        if((first >> 1) > WIRE_MAX_FIELD_VALUE)
+        {
+            throw DataSizeException("Client sended too long frame");
+        }
+
+        if((first & 1) == 0)
+        {
+            header.nb_messages = std::size_t(first >> 1);
+            return size;
+        }
+
+        uint64_t raw_size;
+        std::size_t raw_size_size = decodeVarint(in + size, available - size, raw_size);
+        if(raw_size_size == 0)
+        {
+            return 0;
+        }
+
+        if(raw_size > WIRE_MAX_FIELD_VALUE)
+        {
+            throw DataSizeException("Client sended too long frame");
+        }
+
+        header.compressed = true;
+        header.compressed_size = std::size_t(first >> 1);
+        header.raw_size = std::size_t(raw_size);
+        return size + raw_size_size;
+    }
+
+    if(available < 1)
+    {
+        return 0;
+    }
+
+    if(in[0] == LENGTH)
+    {
+        if(available < 4)
+        {
+            return 0;
+        }
+
+        header.nb_messages = in[1] | (in[2] << 8) | (in[3] << 16);
+        return 4;
+    }
+
+    if(in[0] == ZLENGTH)
+    {
+        if(available < 7)
+        {
+            return 0;
+        }
+
+        header.compressed = true;
+        header.compressed_size = in[1] | (in[2] << 8) | (in[3] << 16);
+        header.raw_size = in[4] | (in[5] << 8) | (in[6] << 16);
+        return 7;
+    }
+
+    throw RemoteConnectionException("Client sended bad code in header");
+}
+
+/**
+ * @brief Read a message header, throw DataSizeException on a size out of the 24 bits range
+ * 
+ * @param in
+ * @param available number of bytes readable at in
+ * @param hat decoded message code
+ * @param size decoded data size
+ * @return std::size_t size of the header, 0 if incomplete
+ */
+inline std::size_t decodeMessageHeader(WireVersion version, const uint8_t *in, std::size_t available, uint8_t &hat, std::size_t &size)
+{
+    if(available < 1)
+    {
+        return 0;
+    }
+
+    hat = in[0];
+
+    if(version == WIRE_V2)
+    {
+        uint64_t value;
+        std::size_t value_size = decodeVarint(in + 1, available - 1, value);
+        if(value_size == 0)
+        {
+            return 0;
+        }
+
+        if(value > WIRE_MAX_FIELD_VALUE)
+        {
+            throw DataSizeException("Client sended too long message");
+        }
+
+        size = std::size_t(value);
+        return 1 + value_size;
+    }
+
+    if(available < 4)
+    {
+        return 0;
+    }
+
+    size = in[1] | (in[2] << 8) | (in[3] << 16);
+    return 4;
+}
+
+/**
+ * @brief Get the size of the end of a frame
+ * 
+ */
+inline std::size_t frameEndSize(WireVersion version)
+{
+    return version == WIRE_V2 ? 0 : 1;
+}
+
+/**
+ * @brief Check the end of a frame, in must have frameEndSize(version) readable bytes
+ * 
+ */
+inline bool checkFrameEnd(WireVersion version, const uint8_t *in)
+{
+    return version == WIRE_V2 || in[0] == END;
+}
+
+}
+
+#endif
@@ -0,0 +1,278 @@
+/**
+ * @file wire_schema.hpp
+ * @author Yann Le Masson
+ * 
+ * Typed payloads: the wire layout of a struct is declared once by specializing WireSchema
+ * 
+ *      struct Position { int32_t x; int32_t y; float angle; };
+ * 
+ *      template<> struct ASE::WireSchema<Position>
+ *      {
+ *          static constexpr auto fields = std::make_tuple(&Position::x, &Position::y, &Position::angle);
+ *      };
+ * 
+ * then encode/decode are generated at compile time, in little endian, with a size known at compile time
+ * (ASE::wireSize<Position>() == 12). Scalars, enums, std::array and nested schemas can be used as fields.
+ */
+#ifndef WIRE_SCHEMA_HPP
+#define WIRE_SCHEMA_HPP
+
+#include <stdint.h>
+#include <array>
+#include <tuple>
+#include <span>
+#include <bit>
+#include <utility>
+#include <type_traits>
+
+#include "connection_expections.hpp"
+
+namespace ASE
+{
+
+    /**
+     * @brief Wire layout of T, to specialize with a static constexpr tuple of member pointers named fields
+     * 
+     */
+    template<typename T>
+    struct WireSchema;
+
+    template<typename T>
+    struct IsStdArray : std::false_type {};
+
+    template<typename T, std::size_t N>
+    struct IsStdArray<std::array<T, N>> : std::true_type {};
+
+    template<typename T>
+    concept WireScalar = std::is_arithmetic_v<T> || std::is_enum_v<T>;
+
+    template<typename T>
+    concept WireStruct = requires { WireSchema<T>::fields; };
+
+    template<typename T>
+    concept WireArray = IsStdArray<T>::value;
+
+    template<typename T>
+    concept WireEncodable = WireScalar<T> || WireStruct<T> || WireArray<T>;
+
+
+    template<WireEncodable T>
+    constexpr std::size_t wireSize();
+
+    template<WireEncodable T>
+    void encodeTo(const T &value, uint8_t *out);
+
+    template<WireEncodable T>
+    T decodeFrom(const uint8_t *in);
+
+
+    namespace detail
+    {
+        template<typename MemberPointer>
+        struct MemberType;
+
+        template<typename Class, typename Member>
+        struct MemberType<Member Class::*>
+        {
+            using type = Member;
+        };
+
+        template<typename T, std::size_t I>
+        using FieldType = typename MemberType<std::remove_cv_t<std::tuple_element_t<I, std::remove_cv_t<decltype(WireSchema<T>::fields)>>>>::type;
+
+        template<typename T>
+        constexpr std::size_t fieldCount()
+        {
+            return std::tuple_size_v<std::remove_cv_t<decltype(WireSchema<T>::fields)>>;
+        }
+
+        template<typename T, std::size_t... I>
+        constexpr std::size_t fieldsSize(std::index_sequence<I...>)
+        {
+            return (wireSize<FieldType<T, I>>() + ... + 0);
+        }
+
+        template<typename T, std::size_t Index, std::size_t... I>
+        constexpr std::size_t fieldOffset(std::index_sequence<I...>)
+        {
+            return ((I < Index ? wireSize<FieldType<T, I>>() : 0) + ... + 0);
+        }
+
+        template<typename T, std::size_t Index>
+        constexpr std::size_t fieldOffset()
+        {
+            return fieldOffset<T, Index>(std::make_index_sequence<fieldCount<T>()>());
+        }
+
+        // unsigned integer with the same size as a scalar, used to store it byte per byte
+        template<std::size_t Size>
+        struct UnsignedOfSize;
+
+        template<> struct UnsignedOfSize<1> { using type = uint8_t; };
+        template<> struct UnsignedOfSize<2> { using type = uint16_t; };
+        template<> struct UnsignedOfSize<4> { using type = uint32_t; };
+        template<> struct UnsignedOfSize<8> { using type = uint64_t; };
+
+        template<typename U, std::size_t... I>
+        inline void storeLittleEndian(U value, uint8_t *out, std::index_sequence<I...>)
+        {
+            ((out[I] = uint8_t(value >> (8 * I))), ...);
+        }
+
+        template<typename U, std::size_t... I>
+        inline U loadLittleEndian(const uint8_t *in, std::index_sequence<I...>)
+        {
+            return U(((U(in[I]) << (8 * I)) | ... | U(0)));
+        }
+
+        template<typename T, std::size_t... I>
+        inline void encodeFields(const T &value, uint8_t *out, std::index_sequence<I...>)
+        {
+            (encodeTo(value.*std::get<I>(WireSchema<T>::fields), out + fieldOffset<T, I>()), ...);
+        }
+
+        template<typename T, std::size_t... I>
+        inline void decodeFields(T &value, const uint8_t *in, std::index_sequence<I...>)
+        {
+            ((value.*std::get<I>(WireSchema<T>::fields) = decodeFrom<FieldType<T, I>>(in + fieldOffset<T, I>())), ...);
+        }
+    }
+
+
+    /**
+     * @brief Size in bytes of T on the wire
+     * 
+     */
+    template<WireEncodable T>
+    constexpr std::size_t wireSize()
+    {
+        if constexpr (WireScalar<T>)
+        {
+            return std::is_same_v<T, bool> ? 1 : sizeof(T);
+        }
+        else if constexpr (WireArray<T>)
+        {
+            return std::tuple_size_v<T> * wireSize<typename T::value_type>();
+        }
+        else
+        {
+            return detail::fieldsSize<T>(std::make_index_sequence<detail::fieldCount<T>()>());
+        }
+    }
+
+    /**
+     * @brief Write value in little endian at out, which must have room for wireSize<T>() bytes
+     * 
+     */
+    template<WireEncodable T>
+    void encodeTo(const T &value, uint8_t *out)
+    {
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            out[0] = value ? 1 : 0;
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            encodeTo(std::underlying_type_t<T>(value), out);
+        }
+        else if constexpr (WireScalar<T>)
+        {
+            using U = typename detail::UnsignedOfSize<sizeof(T)>::type;
+            detail::storeLittleEndian(std::bit_cast<U>(value), out, std::make_index_sequence<sizeof(T)>());
+        }
+        else if constexpr (WireArray<T>)
+        {
+            constexpr std::size_t element_size = wireSize<typename T::value_type>();
+            for(std::size_t i = 0; i < value.size(); i++)
+            {
+                encodeTo(value[i], out + i * element_size);
+            }
+        }
+        else
+        {
+            detail::encodeFields(value, out, std::make_index_sequence<detail::fieldCount<T>()>());
+        }
+    }
+
+    /**
+     * @brief Read a T written in little endian at in, which must hold wireSize<T>() bytes
+     * 
+     */
+    template<WireEncodable T>
+    T decodeFrom(const uint8_t *in)
+    {
+        if constexpr (std::is_same_v<T, bool>)
+        {
+            return in[0] != 0;
+        }
+        else if constexpr (std::is_enum_v<T>)
+        {
+            return T(decodeFrom<std::underlying_type_t<T>>(in));
+        }
+        else if constexpr (WireScalar<T>)
+        {
+            using U = typename detail::UnsignedOfSize<sizeof(T)>::type;
+            return std::bit_cast<T>(detail::loadLittleEndian<U>(in, std::make_index_sequence<sizeof(T)>()));
+        }
+        else if constexpr (WireArray<T>)
+        {
+            constexpr std::size_t element_size = wireSize<typename T::value_type>();
+            T output;
+            for(std::size_t i = 0; i < output.size(); i++)
+            {
+                output[i] = decodeFrom<typename T::value_type>(in + i * element_size);
+            }
+            return output;
+        }
+        else
+        {
+            T output{};
+            detail::decodeFields(output, in, std::make_index_sequence<detail::fieldCount<T>()>());
+            return output;
+        }
+    }
+
+    /**
+     * @brief Encode value in a fixed size array
+     * 
+     * @return std::array<uint8_t, wireSize<T>()> 
+     */
+    template<WireEncodable T>
+    std::array<uint8_t, wireSize<T>()> encode(const T &value)
+    {
+        std::array<uint8_t, wireSize<T>()> output;
+        encodeTo(value, output.data());
+        return output;
+    }
+
+    /**
+     * @brief Decode the index-th T of data (as received by the server hooks)
+     * 
+     * @param data 
+     * @param index position of the value if data holds several T one after the other
+     * @return T 
+     */
+    template<WireEncodable T>
+    T decode(std::span<const uint8_t> data, std::size_t index = 0)
+    {
+        if(data.size() < (index + 1) * wireSize<T>())
+        {
+            throw DataSizeException("Data too short for the requested type");
+        }
+        return decodeFrom<T>(data.data() + index * wireSize<T>());
+    }
+
+    /**
+     * @brief Get how many T one after the other data holds
+     * 
+     */
+    template<WireEncodable T>
+    std::size_t decodeCount(std::span<const uint8_t> data)
+    {
+        return data.size() / wireSize<T>();
+    }
+
+}
+
+
+#endif
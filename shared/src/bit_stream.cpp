@@ -0,0 +1,210 @@
+/**
+ * @file bit_stream.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <cmath>
+#include <stdexcept>
+#include <algorithm>
+
+#include "bit_stream.hpp"
+
+namespace ASE
+{
+    // components other than the largest one are in [-1/sqrt(2), 1/sqrt(2)]
+    static const float QUATERNION_COMPONENT_LIMIT = 0.707107f;
+
+
+    // ~~~~~~~~~~ BitWriter ~~~~~~~~~~
+
+    BitWriter::BitWriter(Message &message) : BitWriter(message.getDataRef())
+    {
+
+    }
+
+    BitWriter::BitWriter(PayloadBuffer &output) : output_(output), start_bit_(output.size() * 8), bit_pos_(output.size() * 8)
+    {
+
+    }
+
+    std::size_t BitWriter::getBitsWritten() const
+    {
+        return bit_pos_ - start_bit_;
+    }
+
+    void BitWriter::writeBits(uint64_t value, int bits)
+    {
+        if(bits <= 0)
+        {
+            return;
+        }
+
+        if(bits < 64)
+        {
+            value &= (uint64_t(1) << bits) - 1;
+        }
+
+        output_.resize((bit_pos_ + bits + 7) / 8);
+        uint8_t *data = output_.data();
+
+        // fill the current byte, then whole bytes
+        while(bits > 0)
+        {
+            int bit_in_byte = int(bit_pos_ % 8);
+            int chunk = std::min(8 - bit_in_byte, bits);
+
+            data[bit_pos_ / 8] |= uint8_t((value & ((1u << chunk) - 1)) << bit_in_byte);
+
+            value >>= chunk;
+            bits -= chunk;
+            bit_pos_ += chunk;
+        }
+    }
+
+    void BitWriter::writeBool(bool value)
+    {
+        writeBits(value ? 1 : 0, 1);
+    }
+
+    void BitWriter::writeRangedInt(int64_t value, int64_t min, int64_t max)
+    {
+        if(value < min || value > max)
+        {
+            throw std::out_of_range("Value out of its range");
+        }
+
+        writeBits(uint64_t(value - min), bitsRequired(uint64_t(max - min)));
+    }
+
+    void BitWriter::writeQuantizedFloat(float value, float min, float max, float precision)
+    {
+        uint64_t steps = uint64_t(std::ceil((max - min) / precision));
+        float clamped = std::clamp(value, min, max);
+        uint64_t quantized = uint64_t(std::lround((clamped - min) / (max - min) * float(steps)));
+
+        writeBits(quantized, bitsRequired(steps));
+    }
+
+    void BitWriter::writeQuaternion(const Quaternion &rotation, int bits_per_component)
+    {
+        float components[4] = {rotation.x, rotation.y, rotation.z, rotation.w};
+
+        int largest = 0;
+        for(int i = 1; i < 4; i++)
+        {
+            if(std::fabs(components[i]) > std::fabs(components[largest]))
+            {
+                largest = i;
+            }
+        }
+
+        // q and -q are the same rotation, the largest one is sent implicitly positive
+        float sign = components[largest] < 0 ? -1.f : 1.f;
+
+        writeBits(uint64_t(largest), 2);
+
+        uint64_t steps = (uint64_t(1) << bits_per_component) - 1;
+        for(int i = 0; i < 4; i++)
+        {
+            if(i == largest)
+            {
+                continue;
+            }
+
+            float normalized = (std::clamp(components[i] * sign, -QUATERNION_COMPONENT_LIMIT, QUATERNION_COMPONENT_LIMIT) + QUATERNION_COMPONENT_LIMIT) / (2 * QUATERNION_COMPONENT_LIMIT);
+            writeBits(uint64_t(std::lround(normalized * float(steps))), bits_per_component);
+        }
+    }
+
+
+    // ~~~~~~~~~~ BitReader ~~~~~~~~~~
+
+    BitReader::BitReader(std::span<const uint8_t> input) : input_(input), bit_pos_(0)
+    {
+
+    }
+
+    BitReader::BitReader(const Message &message) : BitReader(message.getData())
+    {
+
+    }
+
+    std::size_t BitReader::getBitsLeft() const
+    {
+        return input_.size() * 8 - bit_pos_;
+    }
+
+    uint64_t BitReader::readBits(int bits)
+    {
+        if(bits <= 0)
+        {
+            return 0;
+        }
+
+        if(std::size_t(bits) > getBitsLeft())
+        {
+            throw DataSizeException("Bit stream read after its end");
+        }
+
+        uint64_t output = 0;
+        int shift = 0;
+
+        while(bits > 0)
+        {
+            int bit_in_byte = int(bit_pos_ % 8);
+            int chunk = std::min(8 - bit_in_byte, bits);
+
+            uint64_t part = (input_[bit_pos_ / 8] >> bit_in_byte) & ((1u << chunk) - 1);
+            output |= part << shift;
+
+            shift += chunk;
+            bits -= chunk;
+            bit_pos_ += chunk;
+        }
+
+        return output;
+    }
+
+    bool BitReader::readBool()
+    {
+        return readBits(1) != 0;
+    }
+
+    int64_t BitReader::readRangedInt(int64_t min, int64_t max)
+    {
+        return min + int64_t(readBits(bitsRequired(uint64_t(max - min))));
+    }
+
+    float BitReader::readQuantizedFloat(float min, float max, float precision)
+    {
+        uint64_t steps = uint64_t(std::ceil((max - min) / precision));
+        uint64_t quantized = readBits(bitsRequired(steps));
+
+        return min + float(quantized) / float(steps) * (max - min);
+    }
+
+    Quaternion BitReader::readQuaternion(int bits_per_component)
+    {
+        float components[4];
+        int largest = int(readBits(2));
+
+        uint64_t steps = (uint64_t(1) << bits_per_component) - 1;
+        float sum_of_squares = 0;
+
+        for(int i = 0; i < 4; i++)
+        {
+            if(i == largest)
+            {
+                continue;
+            }
+
+            float normalized = float(readBits(bits_per_component)) / float(steps);
+            components[i] = normalized * (2 * QUATERNION_COMPONENT_LIMIT) - QUATERNION_COMPONENT_LIMIT;
+            sum_of_squares += components[i] * components[i];
+        }
+
+        components[largest] = std::sqrt(std::max(0.f, 1.f - sum_of_squares));
+
+        return {components[0], components[1], components[2], components[3]};
+    }
+}
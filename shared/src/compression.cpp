@@ -0,0 +1,101 @@
+/**
+ * @file compression.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <cstring>
+#include <chrono>
+
+#include "compression.hpp"
+#include "wire_codec.hpp"
+
+namespace ASE
+{
+    CompressionContext::CompressionContext() : enabled_(false), threshold_(0)
+    {
+
+    }
+
+    void CompressionContext::enable(std::shared_ptr<const CompressionDictionary> dictionary, std::size_t threshold)
+    {
+        enabled_ = true;
+        dictionary_ = std::move(dictionary);
+        threshold_ = threshold;
+    }
+
+    void CompressionContext::disable()
+    {
+        enabled_ = false;
+        dictionary_.reset();
+    }
+
+    ConnectionCapabilities CompressionContext::getCapabilities() const
+    {
+        ConnectionCapabilities output;
+        if(enabled_)
+        {
+            output.flags |= CAPABILITY_COMPRESSION;
+            output.dictionary_id = dictionary_ != nullptr ? dictionary_->getId() : 0;
+        }
+        return output;
+    }
+
+    std::span<const uint8_t> CompressionContext::compressFrame(const struct iovec *iov, std::size_t iov_count, std::size_t raw_size, WireVersion version)
+    {
+        if(!enabled_ || raw_size < threshold_ || raw_size > WIRE_MAX_FIELD_VALUE)
+        {
+            if(enabled_)
+            {
+                stats_.frames_sent_raw++;
+            }
+            return {};
+        }
+
+        auto start = std::chrono::steady_clock::now();
+
+        raw_scratch_.resize(raw_size);
+        std::size_t pos = 0;
+        for(std::size_t i = 0; i < iov_count; i++)
+        {
+            std::memcpy(raw_scratch_.data() + pos, iov[i].iov_base, iov[i].iov_len);
+            pos += iov[i].iov_len;
+        }
+
+        // only worth it if smaller than the raw frame, header included.
+        // The compressed bytes are written after room for the biggest header, 
+        // the real header is put just before them once their size is known
+        uint8_t header[WIRE_MAX_FRAME_HEADER_SIZE];
+        std::size_t max_header_size = encodeCompressedFrameHeader(version, raw_size, raw_size, header);
+
+        compressed_scratch_.resize(WIRE_MAX_FRAME_HEADER_SIZE + raw_size);
+        uint8_t *compressed = compressed_scratch_.data() + WIRE_MAX_FRAME_HEADER_SIZE;
+        std::size_t compressed_size = lzCompress(raw_scratch_.data(), raw_size, compressed, raw_size > max_header_size ? raw_size - max_header_size : 0, dictionary_.get());
+
+        stats_.compression_nanoseconds += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+        if(compressed_size == 0)
+        {
+            stats_.frames_sent_raw++;
+            return {};
+        }
+
+        std::size_t header_size = encodeCompressedFrameHeader(version, compressed_size, raw_size, header);
+        std::memcpy(compressed - header_size, header, header_size);
+
+        stats_.frames_compressed++;
+        stats_.bytes_before_compression += raw_size;
+        stats_.bytes_after_compression += header_size + compressed_size;
+
+        return std::span<const uint8_t>(compressed - header_size, header_size + compressed_size);
+    }
+
+    void CompressionContext::decompressFrame(const uint8_t *compressed, std::size_t compressed_size, uint8_t *dst, std::size_t raw_size)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        lzDecompress(compressed, compressed_size, dst, raw_size, dictionary_.get());
+
+        stats_.decompression_nanoseconds += uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        stats_.frames_decompressed++;
+    }
+}
@@ -0,0 +1,209 @@
+/**
+ * @file fragmentation.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <cstring>
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
+#include "fragmentation.hpp"
+#include "varint.hpp"
+
+namespace ASE
+{
+    FragmentSender::FragmentSender() : next_id_(0), pending_size_(0)
+    {
+
+    }
+
+    void FragmentSender::push(Message message)
+    {
+        pending_size_ += message.getSizeOfData();
+        transfers_.push_back(Transfer{next_id_++, std::move(message), 0});
+    }
+
+    void FragmentSender::fragmentFrame(Frame &frame, const ConnectionLimits &peer_limits)
+    {
+        std::size_t max_size = peer_limits.max_message_size;
+        std::size_t max_messages = peer_limits.max_frame_messages;
+
+        std::size_t shared_length = 0;
+        for(const auto &shared_part : frame.getSharedParts())
+        {
+            shared_length += std::size_t(shared_part->getLength());
+            if(shared_part->getMaxMessageSize() > max_size || shared_length > max_messages)
+            {
+                frame.unshareParts();
+                break;
+            }
+        }
+
+        // move the too big messages in the queue, keeping the order of the others
+        std::vector<Message> &messages = frame.getMessages();
+        std::size_t kept = 0;
+        for(std::size_t i = 0; i < messages.size(); i++)
+        {
+            if(messages[i].getSizeOfData() > max_size)
+            {
+                push(std::move(messages[i]));
+            }
+            else
+            {
+                if(kept != i)
+                {
+                    messages[kept] = std::move(messages[i]);
+                }
+                kept++;
+            }
+        }
+        messages.erase(messages.begin() + kept, messages.end());
+
+        // the deferred messages are older, the messages over the limit wait for the next frame
+        if(!deferred_.empty())
+        {
+            messages.insert(messages.begin(), std::make_move_iterator(deferred_.begin()), std::make_move_iterator(deferred_.end()));
+            deferred_.clear();
+        }
+
+        if(std::size_t(frame.getLength()) > max_messages)
+        {
+            std::size_t over = std::min(messages.size(), std::size_t(frame.getLength()) - max_messages);
+            deferred_.assign(std::make_move_iterator(messages.end() - over), std::make_move_iterator(messages.end()));
+            messages.erase(messages.end() - over, messages.end());
+        }
+
+        if(transfers_.empty())
+        {
+            return;
+        }
+
+        if(max_size < FRAGMENT_MIN_MESSAGE_SIZE)
+        {
+            throw std::length_error("Message size limit too low for fragmentation");
+        }
+
+        // fragments only take the slots left by the real-time messages
+        while(!transfers_.empty() && std::size_t(frame.getLength()) < peer_limits.max_frame_messages)
+        {
+            Transfer transfer = std::move(transfers_.front());
+            transfers_.pop_front();
+
+            std::size_t total_size = transfer.message.getSizeOfData();
+
+            uint8_t header[3 * VARINT_MAX_SIZE + 1];
+            std::size_t header_size = encodeVarint(transfer.id, header);
+            header_size += encodeVarint(transfer.offset, header + header_size);
+            if(transfer.offset == 0)
+            {
+                header[header_size++] = transfer.message.getHat();
+                header_size += encodeVarint(total_size, header + header_size);
+            }
+
+            std::size_t chunk_size = std::min(total_size - transfer.offset, max_size - header_size);
+
+            Message &fragment = frame.getMessages().emplace_back(FRAGMENT, nullptr, 0);
+            fragment.getDataRef().resize(header_size + chunk_size);
+            std::memcpy(fragment.getDataRef().data(), header, header_size);
+            std::memcpy(fragment.getDataRef().data() + header_size, transfer.message.getDataConstRef().data() + transfer.offset, chunk_size);
+
+            transfer.offset += chunk_size;
+            pending_size_ -= chunk_size;
+
+            if(transfer.offset < total_size)
+            {
+                transfers_.push_back(std::move(transfer));
+            }
+        }
+    }
+
+    void FragmentSender::clear()
+    {
+        transfers_.clear();
+        deferred_.clear();
+        pending_size_ = 0;
+    }
+
+
+
+    FragmentReassembler::FragmentReassembler(std::size_t max_size) : reserved_size_(0), max_size_(max_size), completed_hat_(STOP)
+    {
+
+    }
+
+    bool FragmentReassembler::push(const MessageView &fragment)
+    {
+        const uint8_t *in = fragment.getData().data();
+        std::size_t available = fragment.getSizeOfData();
+
+        uint64_t id;
+        uint64_t offset;
+        std::size_t pos = decodeVarint(in, available, id);
+        std::size_t size = pos == 0 ? 0 : decodeVarint(in + pos, available - pos, offset);
+        if(size == 0)
+        {
+            throw RemoteConnectionException("Client sended bad fragment");
+        }
+        pos += size;
+
+        if(offset == 0)
+        {
+            uint64_t total_size;
+            size = pos < available ? decodeVarint(in + pos + 1, available - pos - 1, total_size) : 0;
+            if(size == 0)
+            {
+                throw RemoteConnectionException("Client sended bad fragment");
+            }
+
+            if(transfers_.count(id) != 0)
+            {
+                throw RemoteConnectionException("Client sended a fragmented message twice");
+            }
+
+            if(total_size == 0 || total_size > max_size_ - std::min(max_size_, reserved_size_) || transfers_.size() >= REASSEMBLY_TRANSFER_LIMIT)
+            {
+                throw DataSizeException("Client sended too much fragmented data");
+            }
+
+            Transfer &transfer = transfers_[id];
+            transfer.hat = in[pos];
+            transfer.total_size = std::size_t(total_size);
+            reserved_size_ += transfer.total_size;
+
+            pos += 1 + size;
+        }
+
+        auto transfer_it = transfers_.find(id);
+        if(transfer_it == transfers_.end())
+        {
+            throw RemoteConnectionException("Client sended fragment of unknown message");
+        }
+
+        Transfer &transfer = transfer_it->second;
+        if(offset != transfer.data.size() || available - pos > transfer.total_size - transfer.data.size())
+        {
+            throw RemoteConnectionException("Client sended fragment out of order");
+        }
+
+        transfer.data.insert(transfer.data.end(), in + pos, in + available);
+
+        if(transfer.data.size() < transfer.total_size)
+        {
+            return false;
+        }
+
+        completed_hat_ = transfer.hat;
+        completed_data_ = std::move(transfer.data);
+        reserved_size_ -= transfer.total_size;
+        transfers_.erase(transfer_it);
+
+        return true;
+    }
+
+    void FragmentReassembler::clear()
+    {
+        transfers_.clear();
+        reserved_size_ = 0;
+    }
+}
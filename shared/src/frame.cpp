@@ -7,6 +7,8 @@
 #include <iostream>
 #include <sstream>
 #include <chrono>
+#include <climits>
+#include <cerrno>
 
 #include "frame.hpp"
 #include "security_properties.hpp"
@@ -14,7 +16,7 @@
 
 namespace ASE
 {
-    Frame::Frame(/* args */)
+    Frame::Frame(/* args */) : shared_length_(0), compressed_iov_{nullptr, 0}
     {
         
     }
@@ -29,42 +31,185 @@ namespace ASE
 
     }
 
-    void Frame::sendFrame(SOCKET receiver_socket)
+    void Frame::addShared(SharedWireBuffer shared_part)
     {
-        int frame_length = int(messages_.size());    // number of messages to send
-
-        uint8_t header[4] = {LENGTH,0,0,0};
+        shared_length_ += shared_part->getLength();
+        shared_parts_.emplace_back(std::move(shared_part));
+    }
 
-        if(frame_length > 0xFFFFFF)
+    void Frame::unshareParts()
+    {
+        if(shared_parts_.empty())
         {
-            throw std::length_error("Frame Length to high");
+            return;
         }
 
-        header[1] = uint8_t(frame_length);
-        header[2] = uint8_t(frame_length >> 8);
-        header[3] = uint8_t(frame_length >> 16); 
+        std::vector<Message> output;
+        output.reserve(std::size_t(getLength()));
 
-        if(send(receiver_socket, (char*)(header), size_t(4), MSG_NOSIGNAL) != 4)
+        for(const auto &shared_part : shared_parts_)
         {
-            throw RemoteConnectionException("Client disconnected during header sending");
+            for(Message &message : shared_part->toMessages())
+            {
+                output.emplace_back(std::move(message));
+            }
         }
 
-        for(const auto &m : messages_)
+        for(Message &message : messages_)
         {
+            output.emplace_back(std::move(message));
+        }
+
+        messages_ = std::move(output);
+        shared_parts_.clear();
+        shared_length_ = 0;
+    }
+
+    void Frame::addBitStream(std::function<void(BitWriter &writer)> writer_lambda, MessageCodes hat)
+    {
+        Message &message = messages_.emplace_back(hat, nullptr, 0);
+        BitWriter writer(message);
+        writer_lambda(writer);
+    }
 
-            m.sendMessage(receiver_socket);
+    std::span<struct iovec> Frame::gatherFrame(CompressionContext *compression, WireVersion version)
+    {
+        // frame header + one header per message + end code
+        send_headers_.resize(WIRE_MAX_FRAME_HEADER_SIZE + WIRE_MAX_MESSAGE_HEADER_SIZE * messages_.size() + 1);
+        send_iov_.clear();
+
+        uint8_t *header = send_headers_.data();
+        std::size_t header_size = encodeFrameHeader(version, std::size_t(getLength()), header);
+
+        send_iov_.push_back({header, header_size});
+        std::size_t raw_size = header_size;
+        uint8_t *next_header = header + header_size;
+
+        for(const auto &shared_part : shared_parts_)
+        {
+            const std::vector<uint8_t> &bytes = shared_part->getBytes(version);
+            if(!bytes.empty())
+            {
+                send_iov_.push_back({(void*)(bytes.data()), bytes.size()});
+                raw_size += bytes.size();
+            }
+        }
+
+        for(const Message &m : messages_)
+        {
+            std::size_t size = m.getSizeOfData();
+            std::size_t message_header_size = encodeMessageHeader(version, m.getHat(), size, next_header);
 
-            
-            
+            send_iov_.push_back({next_header, message_header_size});
+            next_header += message_header_size;
+            raw_size += message_header_size + size;
 
+            if(size > 0)
+            {
+                send_iov_.push_back({(void*)(m.getDataConstRef().data()), size});
+            }
         }
         
-        char end = END;
-        if(send(receiver_socket, &end, size_t(1), MSG_NOSIGNAL) != 1)
+        std::size_t end_size = encodeFrameEnd(version, next_header);
+        if(end_size > 0)
         {
-            throw RemoteConnectionException("Client disconnected during end sending");
+            send_iov_.push_back({next_header, end_size});
+            raw_size += end_size;
         }
 
+        if(compression != nullptr && compression->isEnabled())
+        {
+            std::span<const uint8_t> compressed = compression->compressFrame(send_iov_.data(), send_iov_.size(), raw_size, version);
+
+            if(!compressed.empty())
+            {
+                compressed_iov_ = {(void*)(compressed.data()), compressed.size()};
+                return std::span<struct iovec>(&compressed_iov_, 1);
+            }
+        }
+
+        return std::span<struct iovec>(send_iov_);
+    }
+
+    void Frame::sendFrame(SOCKET receiver_socket, CompressionContext *compression, WireVersion version)
+    {
+        std::span<struct iovec> iov = gatherFrame(compression, version);
+        sendAllBuffers(receiver_socket, iov.data(), iov.size());
+    }
+
+    void Frame::serializeFrame(std::vector<uint8_t> &output, CompressionContext *compression, WireVersion version)
+    {
+        for(const struct iovec &buffer : gatherFrame(compression, version))
+        {
+            output.insert(output.end(), (const uint8_t*)(buffer.iov_base), (const uint8_t*)(buffer.iov_base) + buffer.iov_len);
+        }
+    }
+
+    std::size_t Frame::getWireSize(WireVersion version) const
+    {
+        uint8_t scratch[WIRE_MAX_FRAME_HEADER_SIZE];
+        std::size_t size = encodeFrameHeader(version, std::size_t(getLength()), scratch) + frameEndSize(version);
+
+        for(const auto &shared_part : shared_parts_)
+        {
+            size += shared_part->getBytes(version).size();
+        }
+
+        for(const Message &m : messages_)
+        {
+            size += encodeMessageHeader(version, m.getHat(), m.getSizeOfData(), scratch) + m.getSizeOfData();
+        }
+
+        return size;
+    }
+
+
+    void sendAllBuffers(SOCKET receiver_socket, struct iovec *iov, std::size_t iov_count)
+    {
+        #ifdef WIN32
+        for(std::size_t i = 0; i < iov_count; i++)
+        {
+            if(send(receiver_socket, (const char*)(iov[i].iov_base), int(iov[i].iov_len), MSG_NOSIGNAL) != ssize_t(iov[i].iov_len))
+            {
+                throw RemoteConnectionException("Client disconnected during frame sending");
+            }
+        }
+
+        #elif defined(__linux__)
+        while(iov_count > 0)
+        {
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = iov_count < IOV_MAX ? iov_count : IOV_MAX;
+
+            ssize_t sent = sendmsg(receiver_socket, &msg, MSG_NOSIGNAL);
+
+            if(sent < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if(sent <= 0)
+            {
+                throw RemoteConnectionException("Client disconnected during frame sending");
+            }
+
+            // skip what was fully sent and cut the buffer sent partially
+            std::size_t remaining = std::size_t(sent);
+            while(iov_count > 0 && remaining >= iov->iov_len)
+            {
+                remaining -= iov->iov_len;
+                iov++;
+                iov_count--;
+            }
+
+            if(iov_count > 0)
+            {
+                iov->iov_base = (uint8_t*)(iov->iov_base) + remaining;
+                iov->iov_len -= remaining;
+            }
+        }
+        #endif
     }
 
 
@@ -83,42 +228,83 @@ namespace ASE
     void Frame::clear()
     {
         messages_.clear();
+        shared_parts_.clear();
+        shared_length_ = 0;
     }
 
 
-    Frame recvFrame(SOCKET sender_socket)
+    /**
+     * @brief Receive byte by byte a header of at most max_size bytes, until decode_lambda can read it
+     * 
+     */
+    template<typename DecodeLambda>
+    static void recvHeader(SOCKET sender_socket, uint8_t *header, std::size_t max_size, DecodeLambda decode_lambda)
+    {
+        for(std::size_t received = 0; received < max_size; received++)
+        {
+            if(!recvAll(sender_socket, header + received, size_t(1)))
+            {
+                throw RemoteConnectionException("Client disconnected during header receiving");
+            }
+
+            if(decode_lambda(received + 1) != 0)
+            {
+                return;
+            }
+        }
+
+        throw RemoteConnectionException("Client sended bad header");
+    }
+
+    Frame recvFrame(SOCKET sender_socket, WireVersion version, const ConnectionLimits &limits)
     {
         Frame output;
 
-        uint8_t header[4] = {0};
-        
+        uint8_t header[WIRE_MAX_FRAME_HEADER_SIZE] = {0};
+        WireFrameHeader frame_header;
 
+        recvHeader(sender_socket, header, WIRE_MAX_FRAME_HEADER_SIZE, [&](std::size_t available){
+            return decodeFrameHeader(version, header, available, frame_header);
+        });
 
-        if(recv(sender_socket, header, size_t(4), 0) != 4)
-        {
-            throw RemoteConnectionException("Client disconnected during header receiving");
-        }
-        
-        if(header[0] != LENGTH)
+        if(frame_header.compressed)
         {
-            std::cout << "header= " << header[0] << "\n";
-            throw RemoteConnectionException("Client sended bad code in header");
+            throw RemoteConnectionException("Client sended compressed frame without negotiation");
         }
 
-        int size = header[1] | (header[2] >> 8) | (header[3] >> 16);
-
-        if(size > FRAME_SIZE_LIMIT)
+        if(frame_header.nb_messages > limits.max_frame_messages)
         {
             throw DataSizeException("Client sended too long frame");
         }
 
-        for(int i = 0; i < size; i++)
+        for(std::size_t i = 0; i < frame_header.nb_messages; i++)
         {
-            output.addMessage(recvMessage(sender_socket));
+            uint8_t message_header[WIRE_MAX_MESSAGE_HEADER_SIZE] = {0};
+            uint8_t hat = STOP;
+            std::size_t size = 0;
+
+            recvHeader(sender_socket, message_header, WIRE_MAX_MESSAGE_HEADER_SIZE, [&](std::size_t available){
+                return decodeMessageHeader(version, message_header, available, hat, size);
+            });
+
+            if(size > limits.max_message_size)
+            {
+                throw RemoteConnectionException("Client sended too long frame");
+            }
+
+            Message message(MessageCodes(hat), nullptr, 0);
+            message.getDataRef().resize(size);
+
+            if(!recvAll(sender_socket, message.getRawData(), size))
+            {
+                throw RemoteConnectionException("Error during client data receiving");
+            }
+
+            output.addMessage(std::move(message));
         }
 
-        uint8_t end;
-        if(recv(sender_socket, &end, size_t(1), 0) != 1 || end != END)
+        uint8_t end = 0;
+        if(frameEndSize(version) > 0 && (!recvAll(sender_socket, &end, frameEndSize(version)) || !checkFrameEnd(version, &end)))
         {   
             throw RemoteConnectionException("Client sended bad end code");
         }
@@ -129,4 +315,3 @@ namespace ASE
 
     
 }
-
@@ -0,0 +1,300 @@
+/**
+ * @file frame_receiver.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <cstring>
+#include <cerrno>
+#include <algorithm>
+#include <atomic>
+
+#include "frame_receiver.hpp"
+#include "security_properties.hpp"
+
+
+namespace ASE
+{
+    FrameReceiver::FrameReceiver(SOCKET sender_socket, std::size_t initial_capacity) : socket_(sender_socket), buffer_(std::make_shared<std::vector<uint8_t>>(initial_capacity)), read_pos_(0), write_pos_(0), compression_(nullptr), version_(WIRE_V1)
+    {
+        
+    }
+
+    void FrameReceiver::setSocket(SOCKET sender_socket)
+    {
+        socket_ = sender_socket;
+
+        if(buffer_.use_count() > 1)
+        {
+            buffer_ = std::make_shared<std::vector<uint8_t>>(buffer_->size());
+        }
+        read_pos_ = 0;
+        write_pos_ = 0;
+    }
+
+    void FrameReceiver::reserveFreeSpace(std::size_t min_free_space)
+    {
+        bool shared = buffer_.use_count() > 1;
+        // views may be released by another thread, their reads must end before the buffer is reused
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if(read_pos_ == write_pos_ && !shared)
+        {
+            read_pos_ = 0;
+            write_pos_ = 0;
+        }
+
+        if(buffer_->size() - write_pos_ >= min_free_space)
+        {
+            return;
+        }
+
+        std::size_t pending = write_pos_ - read_pos_;
+
+        if(shared)
+        {
+            // views still point into the buffer, continue in a new one
+            auto new_buffer = std::make_shared<std::vector<uint8_t>>(std::max(buffer_->size(), pending + min_free_space));
+            std::memcpy(new_buffer->data(), buffer_->data() + read_pos_, pending);
+            buffer_ = std::move(new_buffer);
+            read_pos_ = 0;
+            write_pos_ = pending;
+            return;
+        }
+
+        // move the pending bytes at the beginning of the buffer
+        if(read_pos_ > 0)
+        {
+            std::memmove(buffer_->data(), buffer_->data() + read_pos_, pending);
+            read_pos_ = 0;
+            write_pos_ = pending;
+        }
+
+        if(buffer_->size() - write_pos_ < min_free_space)
+        {
+            buffer_->resize(write_pos_ + min_free_space);
+        }
+    }
+
+    std::size_t FrameReceiver::fill()
+    {
+        reserveFreeSpace(buffer_->size() / 2 > 0 ? buffer_->size() / 2 : 4096);
+
+        for(;;)
+        {
+            ssize_t rcv_size = recv(socket_, (char*)(buffer_->data() + write_pos_), buffer_->size() - write_pos_, 0);
+
+            if(rcv_size > 0)
+            {
+                write_pos_ += std::size_t(rcv_size);
+                return std::size_t(rcv_size);
+            }
+
+            if(rcv_size == 0)
+            {
+                throw RemoteConnectionException("Client disconnected during frame receiving");
+            }
+
+            if(errno == EINTR)
+            {
+                continue;
+            }
+
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                return 0;
+            }
+
+            throw RemoteConnectionException("Error during frame receiving");
+        }
+    }
+
+    void FrameReceiver::feed(std::span<const uint8_t> data)
+    {
+        reserveFreeSpace(data.size());
+        std::memcpy(buffer_->data() + write_pos_, data.data(), data.size());
+        write_pos_ += data.size();
+    }
+
+    /**
+     * @brief Get the biggest raw frame allowed by the limits, in the biggest encoding
+     * 
+     */
+    static std::size_t maxRawFrameSize(const ConnectionLimits &limits)
+    {
+        return WIRE_MAX_FRAME_HEADER_SIZE + std::size_t(limits.max_frame_messages) * (WIRE_MAX_MESSAGE_HEADER_SIZE + limits.max_message_size) + 1;
+    }
+
+    std::size_t FrameReceiver::rawFrameSize(WireVersion version, const ConnectionLimits &limits, const uint8_t *begin, std::size_t available)
+    {
+        WireFrameHeader header;
+        std::size_t pos = decodeFrameHeader(version, begin, available, header);
+        if(pos == 0)
+        {
+            return 0;
+        }
+
+        if(header.compressed)
+        {
+            throw RemoteConnectionException("Client sended bad compressed frame");
+        }
+
+        if(header.nb_messages > limits.max_frame_messages)
+        {
+            throw DataSizeException("Client sended too long frame");
+        }
+
+        for(std::size_t i = 0; i < header.nb_messages; i++)
+        {
+            uint8_t hat;
+            std::size_t size;
+            std::size_t header_size = decodeMessageHeader(version, begin + pos, available - pos, hat, size);
+            if(header_size == 0)
+            {
+                return 0;
+            }
+
+            if(size > limits.max_message_size)
+            {
+                throw RemoteConnectionException("Client sended too long frame");
+            }
+
+            pos += header_size + size;
+            if(available < pos)
+            {
+                return 0;
+            }
+        }
+
+        std::size_t end_size = frameEndSize(version);
+        if(available < pos + end_size)
+        {
+            return 0;
+        }
+
+        if(!checkFrameEnd(version, begin + pos))
+        {
+            throw RemoteConnectionException("Client sended bad end code");
+        }
+
+        return pos + end_size;
+    }
+
+    std::size_t FrameReceiver::completeFrameSize(WireFrameHeader &header, std::size_t &header_size) const
+    {
+        const uint8_t *begin = buffer_->data() + read_pos_;
+        std::size_t available = write_pos_ - read_pos_;
+
+        header_size = decodeFrameHeader(version_, begin, available, header);
+        if(header_size == 0)
+        {
+            return 0;
+        }
+
+        if(!header.compressed)
+        {
+            return rawFrameSize(version_, limits_, begin, available);
+        }
+
+        if(compression_ == nullptr || !compression_->isEnabled())
+        {
+            throw RemoteConnectionException("Client sended compressed frame without negotiation");
+        }
+
+        std::size_t max_raw_size = maxRawFrameSize(limits_);
+        if(header.raw_size > max_raw_size || header.compressed_size > lzCompressBound(max_raw_size))
+        {
+            throw DataSizeException("Client sended too long frame");
+        }
+
+        if(available < header_size + header.compressed_size)
+        {
+            return 0;
+        }
+
+        return header_size + header.compressed_size;
+    }
+
+    bool FrameReceiver::tryParseFrameView(FrameView &output)
+    {
+        WireFrameHeader header;
+        std::size_t header_size;
+        std::size_t frame_size = completeFrameSize(header, header_size);
+        if(frame_size == 0)
+        {
+            return false;
+        }
+
+        const uint8_t *begin = buffer_->data() + read_pos_;
+
+        if(header.compressed)
+        {
+            // views on the previous inflated frame may still be alive
+            if(inflated_ == nullptr || inflated_.use_count() > 1)
+            {
+                inflated_ = std::make_shared<std::vector<uint8_t>>();
+            }
+            inflated_->resize(header.raw_size);
+
+            compression_->decompressFrame(begin + header_size, header.compressed_size, inflated_->data(), header.raw_size);
+            read_pos_ += frame_size;
+
+            if(rawFrameSize(version_, limits_, inflated_->data(), header.raw_size) != header.raw_size)
+            {
+                throw RemoteConnectionException("Client sended bad compressed frame");
+            }
+
+            WireFrameHeader raw_header;
+            std::size_t raw_header_size = decodeFrameHeader(version_, inflated_->data(), header.raw_size, raw_header);
+            output = FrameView(inflated_, raw_header_size, int(raw_header.nb_messages), version_);
+            return true;
+        }
+
+        output = FrameView(buffer_, read_pos_ + header_size, int(header.nb_messages), version_);
+
+        read_pos_ += frame_size;
+
+        return true;
+    }
+
+    bool FrameReceiver::tryParseFrame(Frame &output)
+    {
+        FrameView view;
+        if(!tryParseFrameView(view))
+        {
+            return false;
+        }
+
+        output = view.toFrame();
+        return true;
+    }
+
+    Frame FrameReceiver::recvFrame()
+    {
+        Frame output;
+
+        while(!tryParseFrame(output))
+        {
+            if(fill() == 0)
+            {
+                throw RemoteConnectionException("Timeout during frame receiving");
+            }
+        }
+
+        return output;
+    }
+
+    FrameView FrameReceiver::recvFrameView()
+    {
+        FrameView output;
+
+        while(!tryParseFrameView(output))
+        {
+            if(fill() == 0)
+            {
+                throw RemoteConnectionException("Timeout during frame receiving");
+            }
+        }
+
+        return output;
+    }
+}
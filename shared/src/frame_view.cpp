@@ -0,0 +1,33 @@
+/**
+ * @file frame_view.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include "frame_view.hpp"
+
+namespace ASE
+{
+    Message MessageView::toMessage() const
+    {
+        return Message(MessageCodes(hat_), data_.data(), data_.size());
+    }
+
+    Frame FrameView::toFrame() const
+    {
+        Frame output;
+
+        for(const MessageView &message : *this)
+        {
+            output.addMessage(message.toMessage());
+        }
+
+        return output;
+    }
+
+    void FrameView::clear()
+    {
+        buffer_.reset();
+        offset_ = 0;
+        length_ = 0;
+    }
+}
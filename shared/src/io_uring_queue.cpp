@@ -0,0 +1,290 @@
+/**
+ * @file io_uring_queue.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#if defined(__linux__)
+
+#include <cstring>
+#include <algorithm>
+#include <cerrno>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "io_uring_queue.hpp"
+
+// user data of the operations of the support probe
+#define PROBE_RECV_TOKEN 1
+
+namespace ASE
+{
+    IoUringQueue::IoUringQueue(unsigned entries, unsigned buffer_count, std::size_t buffer_size) : ring_fd_(-1), rings_map_(MAP_FAILED), rings_map_size_(0),
+                                                                                                   sqes_(nullptr), sqes_map_size_(0), sq_local_tail_(0), buf_ring_(nullptr), buf_ring_map_size_(0),
+                                                                                                   buffer_count_(buffer_count), buffer_size_(buffer_size), enter_count_(0)
+    {
+        if(buffer_count == 0 || (buffer_count & (buffer_count - 1)) != 0 || buffer_count > 32768)
+        {
+            throw std::invalid_argument("io_uring buffer count must be a power of 2 up to 32768");
+        }
+
+        struct io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_COOP_TASKRUN;
+
+        ring_fd_ = int(syscall(__NR_io_uring_setup, entries, &params));
+        if(ring_fd_ < 0 && errno == EINVAL)
+        {
+            // kernel older than the flag
+            std::memset(&params, 0, sizeof(params));
+            ring_fd_ = int(syscall(__NR_io_uring_setup, entries, &params));
+        }
+
+        if(ring_fd_ < 0)
+        {
+            throw std::runtime_error("io_uring not available");
+        }
+
+        if(!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_NODROP) || !(params.features & IORING_FEAT_EXT_ARG))
+        {
+            release();
+            throw std::runtime_error("io_uring too old");
+        }
+
+        // submission and completion rings share one mapping
+        rings_map_size_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned), params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe));
+        rings_map_ = mmap(nullptr, rings_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQ_RING);
+
+        sqes_map_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+        void *sqes_map = mmap(nullptr, sqes_map_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES);
+
+        if(rings_map_ == MAP_FAILED || sqes_map == MAP_FAILED)
+        {
+            if(sqes_map != MAP_FAILED)
+            {
+                munmap(sqes_map, sqes_map_size_);
+            }
+            release();
+            throw std::runtime_error("Error during io_uring mapping");
+        }
+        sqes_ = (struct io_uring_sqe*)(sqes_map);
+
+        uint8_t *rings = (uint8_t*)(rings_map_);
+        sq_head_ = (unsigned*)(rings + params.sq_off.head);
+        sq_tail_ = (unsigned*)(rings + params.sq_off.tail);
+        sq_array_ = (unsigned*)(rings + params.sq_off.array);
+        sq_mask_ = *(unsigned*)(rings + params.sq_off.ring_mask);
+        sq_entries_ = params.sq_entries;
+        sq_local_tail_ = *sq_tail_;
+
+        cq_head_ = (unsigned*)(rings + params.cq_off.head);
+        cq_tail_ = (unsigned*)(rings + params.cq_off.tail);
+        cq_mask_ = *(unsigned*)(rings + params.cq_off.ring_mask);
+        cqes_ = (struct io_uring_cqe*)(rings + params.cq_off.cqes);
+
+        // provided buffers, all given to the kernel at once
+        buf_ring_map_size_ = buffer_count * sizeof(struct io_uring_buf);
+        void *buf_ring_map = mmap(nullptr, buf_ring_map_size_, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+        if(buf_ring_map == MAP_FAILED)
+        {
+            release();
+            throw std::runtime_error("Error during io_uring buffers allocation");
+        }
+        buf_ring_ = (struct io_uring_buf*)(buf_ring_map);
+
+        buffers_.resize(buffer_count * buffer_size);
+        for(unsigned i = 0; i < buffer_count; i++)
+        {
+            struct io_uring_buf &buffer = buf_ring_[i];
+            buffer.addr = uint64_t(uintptr_t(buffers_.data() + std::size_t(i) * buffer_size));
+            buffer.len = uint32_t(buffer_size);
+            buffer.bid = uint16_t(i);
+        }
+        std::atomic_ref<uint16_t>(buf_ring_[0].resv).store(uint16_t(buffer_count), std::memory_order_release);
+
+        struct io_uring_buf_reg reg;
+        std::memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = uint64_t(uintptr_t(buf_ring_));
+        reg.ring_entries = buffer_count;
+        reg.bgid = 0;
+        if(syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_PBUF_RING, &reg, 1) != 0)
+        {
+            release();
+            throw std::runtime_error("io_uring provided buffer rings not available");
+        }
+
+
+        if(!probeRecvMultishot())
+        {
+            release();
+            throw std::runtime_error("io_uring multishot receive not available");
+        }
+
+        enter_count_ = 0;
+    }
+
+    IoUringQueue::~IoUringQueue()
+    {
+        release();
+    }
+
+    void IoUringQueue::release()
+    {
+        if(buf_ring_ != nullptr)
+        {
+            munmap(buf_ring_, buf_ring_map_size_);
+            buf_ring_ = nullptr;
+        }
+
+        if(sqes_ != nullptr)
+        {
+            munmap(sqes_, sqes_map_size_);
+            sqes_ = nullptr;
+        }
+
+        if(rings_map_ != MAP_FAILED)
+        {
+            munmap(rings_map_, rings_map_size_);
+            rings_map_ = MAP_FAILED;
+        }
+
+        if(ring_fd_ >= 0)
+        {
+            close(ring_fd_);
+            ring_fd_ = -1;
+        }
+    }
+
+    bool IoUringQueue::probeRecvMultishot()
+    {
+        int pair[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) != 0)
+        {
+            return false;
+        }
+
+        prepareRecvMultishot(pair[0], PROBE_RECV_TOKEN);
+
+        uint8_t byte = 0;
+        bool supported = send(pair[1], &byte, 1, MSG_NOSIGNAL) == 1;
+        close(pair[1]);
+
+        // one byte received then the end of the connection, or an error if unsupported
+        bool finished = false;
+        for(int tries = 0; supported && !finished && tries < 8; tries++)
+        {
+            submitAndWait(100);
+            forEachCompletion([&](const IoUringCompletion &completion){
+                if(completion.result < 0)
+                {
+                    supported = false;
+                }
+                if(!completion.more)
+                {
+                    finished = true;
+                }
+            });
+        }
+
+        close(pair[0]);
+        return supported && finished;
+    }
+
+    int IoUringQueue::enter(unsigned to_submit, unsigned min_complete, unsigned flags, const void *arg, std::size_t arg_size)
+    {
+        enter_count_++;
+        return int(syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg, arg_size));
+    }
+
+    struct io_uring_sqe *IoUringQueue::getSqe()
+    {
+        unsigned head = std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+        if(sq_local_tail_ - head >= sq_entries_)
+        {
+            std::atomic_ref<unsigned>(*sq_tail_).store(sq_local_tail_, std::memory_order_release);
+            enter(sq_local_tail_ - head, 0, 0, nullptr, 0);
+        }
+
+        unsigned index = sq_local_tail_ & sq_mask_;
+        sq_array_[index] = index;
+        sq_local_tail_++;
+
+        struct io_uring_sqe *sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    void IoUringQueue::recycleBuffer(uint16_t buffer_id)
+    {
+        uint16_t tail = std::atomic_ref<uint16_t>(buf_ring_[0].resv).load(std::memory_order_relaxed);
+
+        struct io_uring_buf &buffer = buf_ring_[tail & (buffer_count_ - 1)];
+        buffer.addr = uint64_t(uintptr_t(buffers_.data() + std::size_t(buffer_id) * buffer_size_));
+        buffer.len = uint32_t(buffer_size_);
+        buffer.bid = buffer_id;
+
+        std::atomic_ref<uint16_t>(buf_ring_[0].resv).store(uint16_t(tail + 1), std::memory_order_release);
+    }
+
+    void IoUringQueue::prepareRecvMultishot(SOCKET sock, uint64_t user_data)
+    {
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = sock;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        sqe->user_data = user_data;
+    }
+
+    void IoUringQueue::prepareSend(SOCKET sock, const uint8_t *data, std::size_t size, uint64_t user_data)
+    {
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = sock;
+        sqe->addr = uint64_t(uintptr_t(data));
+        sqe->len = uint32_t(size);
+        sqe->msg_flags = MSG_NOSIGNAL;
+        sqe->user_data = user_data;
+    }
+
+    void IoUringQueue::prepareRead(int fd, void *output, std::size_t size, uint64_t user_data)
+    {
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = fd;
+        sqe->addr = uint64_t(uintptr_t(output));
+        sqe->len = uint32_t(size);
+        sqe->user_data = user_data;
+    }
+
+    void IoUringQueue::prepareCancel(uint64_t target_user_data, uint64_t user_data)
+    {
+        struct io_uring_sqe *sqe = getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = target_user_data;
+        sqe->user_data = user_data;
+    }
+
+    void IoUringQueue::submitAndWait(int timeout_milli)
+    {
+        // entries the kernel did not take at a previous call are submitted again
+        unsigned to_submit = sq_local_tail_ - std::atomic_ref<unsigned>(*sq_head_).load(std::memory_order_acquire);
+        std::atomic_ref<unsigned>(*sq_tail_).store(sq_local_tail_, std::memory_order_release);
+
+        struct __kernel_timespec timeout;
+        timeout.tv_sec = timeout_milli / 1000;
+        timeout.tv_nsec = (timeout_milli % 1000) * 1000000LL;
+
+        struct io_uring_getevents_arg arg;
+        std::memset(&arg, 0, sizeof(arg));
+        arg.ts = uint64_t(uintptr_t(&timeout));
+
+        // EINTR, ETIME and EBUSY (completions to reap first) are not errors for the caller
+        enter(to_submit, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+}
+
+#endif
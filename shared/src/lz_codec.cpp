@@ -0,0 +1,358 @@
+/**
+ * @file lz_codec.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <cstring>
+#include <algorithm>
+#include <unordered_map>
+
+#include "lz_codec.hpp"
+#include "connection_expections.hpp"
+
+namespace ASE
+{
+    static const std::size_t MIN_MATCH = 4;
+    static const std::size_t LAST_LITERALS = 5;     // the end of the data is always coded as literals
+    static const std::size_t MAX_OFFSET = 65535;
+
+    static inline uint32_t read32(const uint8_t *p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, 4);
+        return value;
+    }
+
+    static inline uint32_t hash32(uint32_t value)
+    {
+        return (value * 2654435761u) >> (32 - LZ_HASH_BITS);
+    }
+
+
+    // ~~~~~~~~~~ Dictionary ~~~~~~~~~~
+
+    CompressionDictionary::CompressionDictionary(std::vector<uint8_t> content) : content_(std::move(content))
+    {
+        if(content_.size() > LZ_DICTIONARY_MAX_SIZE)
+        {
+            content_.erase(content_.begin(), content_.end() - LZ_DICTIONARY_MAX_SIZE);
+        }
+
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        for(uint8_t byte : content_)
+        {
+            hash = (hash ^ byte) * 16777619u;
+        }
+        id_ = hash != 0 ? hash : 1;
+
+        // positions are stored +1, 0 is an empty slot
+        hash_table_.fill(0);
+        for(std::size_t i = 0; i + MIN_MATCH <= content_.size(); i++)
+        {
+            hash_table_[hash32(read32(content_.data() + i))] = uint32_t(i + 1);
+        }
+    }
+
+    CompressionDictionary CompressionDictionary::train(const std::vector<std::vector<uint8_t>> &samples, std::size_t capacity)
+    {
+        const std::size_t segment_size = 64;
+
+        // frequency of every 4 bytes substring in the samples
+        std::unordered_map<uint32_t, uint32_t> frequencies;
+        for(const auto &sample : samples)
+        {
+            for(std::size_t i = 0; i + MIN_MATCH <= sample.size(); i++)
+            {
+                frequencies[read32(sample.data() + i)]++;
+            }
+        }
+
+        // score of each segment: how many repeated substrings it would let a frame refer to
+        struct Segment
+        {
+            uint64_t score;
+            const uint8_t *begin;
+            std::size_t size;
+        };
+        std::vector<Segment> segments;
+
+        for(const auto &sample : samples)
+        {
+            for(std::size_t start = 0; start < sample.size(); start += segment_size)
+            {
+                std::size_t size = std::min(segment_size, sample.size() - start);
+                uint64_t score = 0;
+                for(std::size_t i = start; i + MIN_MATCH <= start + size; i++)
+                {
+                    uint32_t frequency = frequencies[read32(sample.data() + i)];
+                    score += frequency > 1 ? frequency - 1 : 0;
+                }
+
+                if(score > 0)
+                {
+                    segments.push_back({score, sample.data() + start, size});
+                }
+            }
+        }
+
+        std::stable_sort(segments.begin(), segments.end(), [](const Segment &a, const Segment &b){
+            return a.score > b.score;
+        });
+
+        // best segments last, they get the shortest offsets
+        std::vector<const Segment*> chosen;
+        std::size_t total_size = 0;
+        for(const auto &segment : segments)
+        {
+            if(total_size + segment.size > std::min(capacity, std::size_t(LZ_DICTIONARY_MAX_SIZE)))
+            {
+                continue;
+            }
+            chosen.push_back(&segment);
+            total_size += segment.size;
+        }
+
+        std::vector<uint8_t> content;
+        content.reserve(total_size);
+        for(auto it = chosen.rbegin(); it != chosen.rend(); ++it)
+        {
+            content.insert(content.end(), (*it)->begin, (*it)->begin + (*it)->size);
+        }
+
+        return CompressionDictionary(std::move(content));
+    }
+
+
+    // ~~~~~~~~~~ Codec ~~~~~~~~~~
+
+    /**
+     * @brief Write a length continuing a 4 bits field of a token
+     * 
+     */
+    static inline bool writeExtraLength(std::size_t length, uint8_t *&op, const uint8_t *op_end)
+    {
+        while(length >= 255)
+        {
+            if(op >= op_end)
+            {
+                return false;
+            }
+            *op++ = 255;
+            length -= 255;
+        }
+
+        if(op >= op_end)
+        {
+            return false;
+        }
+        *op++ = uint8_t(length);
+        return true;
+    }
+
+    /**
+     * @brief Write one sequence: literals then a match (no match for the last sequence)
+     * 
+     */
+    static inline bool writeSequence(const uint8_t *literals, std::size_t literal_length, std::size_t offset, std::size_t match_length, uint8_t *&op, const uint8_t *op_end)
+    {
+        if(op >= op_end)
+        {
+            return false;
+        }
+
+        uint8_t *token = op++;
+        *token = uint8_t(std::min<std::size_t>(literal_length, 15) << 4);
+
+        if(literal_length >= 15 && !writeExtraLength(literal_length - 15, op, op_end))
+        {
+            return false;
+        }
+
+        if(std::size_t(op_end - op) < literal_length)
+        {
+            return false;
+        }
+        std::memcpy(op, literals, literal_length);
+        op += literal_length;
+
+        if(match_length == 0)
+        {
+            return true;
+        }
+
+        if(op_end - op < 2)
+        {
+            return false;
+        }
+        *op++ = uint8_t(offset);
+        *op++ = uint8_t(offset >> 8);
+
+        std::size_t extra_match = match_length - MIN_MATCH;
+        *token |= uint8_t(std::min<std::size_t>(extra_match, 15));
+
+        if(extra_match >= 15 && !writeExtraLength(extra_match - 15, op, op_end))
+        {
+            return false;
+        }
+
+        return true;
+    }
+
+    std::size_t lzCompress(const uint8_t *src, std::size_t src_size, uint8_t *dst, std::size_t dst_capacity, const CompressionDictionary *dictionary)
+    {
+        const uint8_t *dict = dictionary != nullptr ? dictionary->getContent().data() : nullptr;
+        const std::size_t dict_size = dictionary != nullptr ? dictionary->getContent().size() : 0;
+
+        // positions are virtual: [0, dict_size) in the dictionary, then the source
+        auto byteAt = [&](std::size_t position) -> uint8_t {
+            return position < dict_size ? dict[position] : src[position - dict_size];
+        };
+
+        std::array<uint32_t, 1 << LZ_HASH_BITS> table;
+        if(dictionary != nullptr)
+        {
+            table = dictionary->getHashTable();
+        }
+        else
+        {
+            table.fill(0);
+        }
+
+        uint8_t *op = dst;
+        const uint8_t *op_end = dst + dst_capacity;
+
+        std::size_t ip = 0;
+        std::size_t anchor = 0;
+
+        while(src_size >= LAST_LITERALS + MIN_MATCH && ip <= src_size - LAST_LITERALS - MIN_MATCH)
+        {
+            uint32_t sequence = read32(src + ip);
+            uint32_t hash = hash32(sequence);
+            std::size_t candidate = table[hash];
+            std::size_t position = dict_size + ip;
+            table[hash] = uint32_t(position + 1);
+
+            if(candidate == 0 || position - (candidate - 1) > MAX_OFFSET)
+            {
+                ip++;
+                continue;
+            }
+            candidate--;
+
+            // check and extend the match, the candidate may start in the dictionary
+            std::size_t match_length = 0;
+            const std::size_t max_length = src_size - LAST_LITERALS - ip;
+            while(match_length < max_length && byteAt(candidate + match_length) == src[ip + match_length])
+            {
+                match_length++;
+            }
+
+            if(match_length < MIN_MATCH)
+            {
+                ip++;
+                continue;
+            }
+
+            if(!writeSequence(src + anchor, ip - anchor, position - candidate, match_length, op, op_end))
+            {
+                return 0;
+            }
+
+            ip += match_length;
+            anchor = ip;
+        }
+
+        if(!writeSequence(src + anchor, src_size - anchor, 0, 0, op, op_end))
+        {
+            return 0;
+        }
+
+        return std::size_t(op - dst);
+    }
+
+    /**
+     * @brief Read a length continuing a 4 bits field of a token
+     * 
+     */
+    static inline std::size_t readExtraLength(const uint8_t *&ip, const uint8_t *ip_end)
+    {
+        std::size_t length = 0;
+        uint8_t byte;
+        do
+        {
+            if(ip >= ip_end)
+            {
+                throw DataSizeException("Corrupted compressed frame");
+            }
+            byte = *ip++;
+            length += byte;
+        } while(byte == 255);
+
+        return length;
+    }
+
+    void lzDecompress(const uint8_t *src, std::size_t src_size, uint8_t *dst, std::size_t dst_size, const CompressionDictionary *dictionary)
+    {
+        const uint8_t *dict = dictionary != nullptr ? dictionary->getContent().data() : nullptr;
+        const std::size_t dict_size = dictionary != nullptr ? dictionary->getContent().size() : 0;
+
+        const uint8_t *ip = src;
+        const uint8_t *ip_end = src + src_size;
+        std::size_t op = 0;
+
+        while(ip < ip_end)
+        {
+            uint8_t token = *ip++;
+
+            std::size_t literal_length = token >> 4;
+            if(literal_length == 15)
+            {
+                literal_length += readExtraLength(ip, ip_end);
+            }
+
+            if(std::size_t(ip_end - ip) < literal_length || dst_size - op < literal_length)
+            {
+                throw DataSizeException("Corrupted compressed frame");
+            }
+            std::memcpy(dst + op, ip, literal_length);
+            ip += literal_length;
+            op += literal_length;
+
+            if(ip == ip_end)
+            {
+                break;      // last sequence has no match
+            }
+
+            if(ip_end - ip < 2)
+            {
+                throw DataSizeException("Corrupted compressed frame");
+            }
+            std::size_t offset = ip[0] | (ip[1] << 8);
+            ip += 2;
+
+            std::size_t match_length = token & 0xF;
+            if(match_length == 15)
+            {
+                match_length += readExtraLength(ip, ip_end);
+            }
+            match_length += MIN_MATCH;
+
+            if(offset == 0 || offset > op + dict_size || dst_size - op < match_length)
+            {
+                throw DataSizeException("Corrupted compressed frame");
+            }
+
+            // byte per byte: the match may overlap the output or start in the dictionary
+            for(std::size_t i = 0; i < match_length; i++, op++)
+            {
+                dst[op] = offset > op ? dict[dict_size - (offset - op)] : dst[op - offset];
+            }
+        }
+
+        if(op != dst_size)
+        {
+            throw DataSizeException("Corrupted compressed frame");
+        }
+    }
+}
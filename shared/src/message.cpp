@@ -8,6 +8,7 @@
 
 #include <stdexcept>
 #include <iostream>
+#include <cerrno>
 
 namespace ASE
 {
@@ -33,8 +34,6 @@ namespace ASE
             return;
         }
 
-        auto test = data_.data();
-
         if(send(receiver_socket,data_.data(), size_t(size), MSG_NOSIGNAL) != ssize_t(size))
         {
             throw RemoteConnectionException("Client disconnected during message data sending");
@@ -47,31 +46,54 @@ namespace ASE
     {
         uint8_t header[4] = {0};
 
-        if(recv(sender_socket, header, size_t(4), 0) != 4)
+        if(!recvAll(sender_socket, header, size_t(4)))
         {
             throw RemoteConnectionException("Client disconnected during header receiving");
         }
         
         
 
-        int size = header[1] | (header[2] >> 8) | (header[3] >> 16);
+        int size = header[1] | (header[2] << 8) | (header[3] << 16);
 
         if(size > MESSAGE_SIZE_LIMIT)
         {
             throw RemoteConnectionException("Client sended too long frame");
         }
 
-        std::vector<uint8_t> data_received;
-        data_received.resize(size);
-        ssize_t rcv_size = recv(sender_socket, data_received.data(), size_t(size), 0);
+        Message output(MessageCodes(header[0]), nullptr, 0);
+        output.getDataRef().resize(size);
 
-        if(size_t(rcv_size) != data_received.size())
+        if(!recvAll(sender_socket, output.getRawData(), size_t(size)))
         {
             throw RemoteConnectionException("Error during client data receiving");
         }
 
-        return Message(MessageCodes(header[0]),std::move(data_received));
+        return output;
+
+    }
+
+    bool recvAll(SOCKET sender_socket, void *buffer, std::size_t size)
+    {
+        std::size_t received = 0;
+
+        while(received < size)
+        {
+            ssize_t rcv_size = recv(sender_socket, (char*)(buffer) + received, size - received, 0);
+
+            if(rcv_size < 0 && errno == EINTR)
+            {
+                continue;
+            }
+
+            if(rcv_size <= 0)
+            {
+                return false;
+            }
+
+            received += std::size_t(rcv_size);
+        }
 
+        return true;
     }
 
     /**
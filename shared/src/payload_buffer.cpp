@@ -0,0 +1,99 @@
+/**
+ * @file payload_buffer.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include "payload_buffer.hpp"
+
+namespace ASE
+{
+    namespace PayloadPool
+    {
+        namespace
+        {
+            struct ThreadPool
+            {
+                std::vector<std::vector<uint8_t>> free_buffers;
+
+                ThreadPool();
+                ~ThreadPool();
+            };
+
+            enum PoolState {NOT_CREATED, ALIVE, DESTROYED};
+
+            // trivially destructible, stays readable after the pool destruction at thread exit
+            thread_local PoolState pool_state = NOT_CREATED;
+
+            ThreadPool::ThreadPool()
+            {
+                free_buffers.reserve(PAYLOAD_POOL_SIZE);
+                pool_state = ALIVE;
+            }
+
+            ThreadPool::~ThreadPool()
+            {
+                pool_state = DESTROYED;
+            }
+
+            thread_local ThreadPool pool;
+
+            /**
+             * @brief Get the free buffer list of the calling thread, nullptr during thread exit
+             * 
+             */
+            std::vector<std::vector<uint8_t>> *getFreeBuffers()
+            {
+                if(pool_state == DESTROYED)
+                {
+                    return nullptr;
+                }
+                return &pool.free_buffers;
+            }
+        }
+
+        std::vector<uint8_t> acquire(std::size_t min_capacity)
+        {
+            std::vector<uint8_t> output;
+
+            auto *free_buffers = getFreeBuffers();
+            if(free_buffers != nullptr)
+            {
+                // take the last buffer big enough, newest buffers are the warmest
+                for(auto it = free_buffers->rbegin(); it != free_buffers->rend(); ++it)
+                {
+                    if(it->capacity() >= min_capacity)
+                    {
+                        output = std::move(*it);
+                        free_buffers->erase(std::next(it).base());
+                        output.clear();
+                        return output;
+                    }
+                }
+            }
+
+            output.reserve(min_capacity);
+            return output;
+        }
+
+        void release(std::vector<uint8_t> &&buffer)
+        {
+            auto *free_buffers = getFreeBuffers();
+            // too big to keep, or too small to ever serve an acquire (the payload would be inline)
+            if(free_buffers == nullptr || buffer.capacity() > PAYLOAD_POOL_MAX_CAPACITY || buffer.capacity() <= MESSAGE_INLINE_CAPACITY)
+            {
+                return;     // buffer freed by its owner
+            }
+
+            if(free_buffers->size() < PAYLOAD_POOL_SIZE)
+            {
+                free_buffers->emplace_back(std::move(buffer));
+            }
+        }
+
+        std::size_t getAvailable()
+        {
+            auto *free_buffers = getFreeBuffers();
+            return free_buffers != nullptr ? free_buffers->size() : 0;
+        }
+    }
+}
@@ -0,0 +1,368 @@
+/**
+ * @file reliable_endpoint.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+
+#include "reliable_endpoint.hpp"
+
+namespace ASE
+{
+    ReliableEndpoint::ReliableEndpoint(const ConnectionLimits &peer_limits): peer_limits_(peer_limits), next_id_(0), next_order_(0),
+                                                                             congestion_window_(RELIABLE_INITIAL_WINDOW), slow_start_threshold_(RELIABLE_MAX_WINDOW), recovery_id_(0),
+                                                                             has_acked_(false), highest_acked_(0),
+                                                                             has_rtt_(false), smoothed_rtt_(0), rtt_variation_(0), rto_(RELIABLE_INITIAL_RTO_MILLI),
+                                                                             retransmit_count_(0), probe_count_(0), timeout_count_(0),
+                                                                             recv_next_id_(0), recv_next_order_(0), ack_pending_(false)
+    {
+
+    }
+
+    ReliableStats ReliableEndpoint::getStats() const
+    {
+        ReliableStats output;
+        output.smoothed_rtt_milli = smoothed_rtt_;
+        output.rto_milli = rto_;
+        output.congestion_window = congestion_window_;
+        output.in_flight = in_flight_.size();
+        output.waiting = waiting_.size();
+        output.retransmit_count = retransmit_count_;
+        output.probe_count = probe_count_;
+        output.timeout_count = timeout_count_;
+        return output;
+    }
+
+    void ReliableEndpoint::send(const Message &message, ReliableChannel channel)
+    {
+        if(message.getSizeOfData() > RELIABLE_MAX_PAYLOAD_SIZE || message.getSizeOfData() > peer_limits_.max_message_size)
+        {
+            throw std::length_error("Message too big for the reliable channels");
+        }
+
+        ReliableMessageHeader header;
+        header.id = next_id_++;
+        header.channel = channel;
+        header.order = channel == CHANNEL_RELIABLE_ORDERED ? next_order_++ : 0;
+        header.hat = message.getHat();
+
+        std::vector<uint8_t> data(RELIABLE_MESSAGE_HEADER_SIZE + message.getSizeOfData());
+        encodeTo(header, data.data());
+        std::copy(message.getData().begin(), message.getData().end(), data.begin() + RELIABLE_MESSAGE_HEADER_SIZE);
+
+        waiting_.push_back(std::move(data));
+    }
+
+    void ReliableEndpoint::sampleRtt(double rtt_milli)
+    {
+        if(!has_rtt_)
+        {
+            smoothed_rtt_ = rtt_milli;
+            rtt_variation_ = rtt_milli / 2;
+            has_rtt_ = true;
+        }
+        else
+        {
+            rtt_variation_ = 0.75 * rtt_variation_ + 0.25 * std::abs(smoothed_rtt_ - rtt_milli);
+            smoothed_rtt_ = 0.875 * smoothed_rtt_ + 0.125 * rtt_milli;
+        }
+    }
+
+    void ReliableEndpoint::reduceWindow(uint32_t lost_id)
+    {
+        // sent before the last reduction, the loss was already answered
+        if(isNewerSequence(recovery_id_, lost_id))
+        {
+            return;
+        }
+
+        slow_start_threshold_ = std::max(congestion_window_ / 2, double(RELIABLE_MIN_WINDOW));
+        congestion_window_ = slow_start_threshold_;
+        recovery_id_ = next_id_;
+    }
+
+    void ReliableEndpoint::handleAck(const ReliableAck &ack, Clock::time_point now)
+    {
+        bool acked_any = false;
+
+        for(auto it = in_flight_.begin(); it != in_flight_.end();)
+        {
+            uint32_t id = it->first;
+            uint32_t distance = id - ack.next_id;
+
+            bool acked = isNewerSequence(ack.next_id, id) || (distance >= 1 && distance <= RELIABLE_ACK_MASK_BITS && ((ack.received_mask >> (distance - 1)) & 1));
+            if(!acked)
+            {
+                ++it;
+                continue;
+            }
+
+            // only messages sent once measure the RTT (Karn's algorithm)
+            if(it->second.transmissions == 1)
+            {
+                sampleRtt(std::chrono::duration<double, std::milli>(now - it->second.sent_at).count());
+            }
+
+            if(congestion_window_ < slow_start_threshold_)
+            {
+                congestion_window_ += 1;
+            }
+            else
+            {
+                congestion_window_ += 1 / congestion_window_;
+            }
+            congestion_window_ = std::min(congestion_window_, double(RELIABLE_MAX_WINDOW));
+
+            if(!has_acked_ || isNewerSequence(id, highest_acked_))
+            {
+                highest_acked_ = id;
+            }
+            has_acked_ = true;
+            latest_sent_acked_ = std::max(latest_sent_acked_, it->second.sent_at);
+
+            acked_any = true;
+            it = in_flight_.erase(it);
+        }
+
+        if(acked_any)
+        {
+            last_progress_ = now;
+
+            // the peer answers again: the timer backoff ends, even without a new measure
+            if(has_rtt_)
+            {
+                rto_ = std::clamp(smoothed_rtt_ + std::max(1.0, 4 * rtt_variation_), double(RELIABLE_MIN_RTO_MILLI), double(RELIABLE_MAX_RTO_MILLI));
+            }
+            detectLosses(now);
+        }
+    }
+
+    void ReliableEndpoint::detectLosses(Clock::time_point now)
+    {
+        if(!has_acked_)
+        {
+            return;
+        }
+
+        // a small window has not enough messages after a lost one to reach the ids threshold, the time one finds it
+        double reorder_milli = has_rtt_ ? smoothed_rtt_ * RELIABLE_REORDER_RTT_FACTOR + 1 : rto_;
+
+        for(auto &[id, message] : in_flight_)
+        {
+            if(message.lost || message.sent_at > latest_sent_acked_)
+            {
+                continue;
+            }
+
+            bool behind_in_ids = message.sent_at < latest_sent_acked_ && isNewerSequence(highest_acked_, id) && highest_acked_ - id >= RELIABLE_FAST_RETRANSMIT_THRESHOLD;
+            bool behind_in_time = std::chrono::duration<double, std::milli>(now - message.sent_at).count() >= reorder_milli;
+
+            if(behind_in_ids || behind_in_time)
+            {
+                message.lost = true;
+                reduceWindow(id);
+            }
+        }
+    }
+
+    void ReliableEndpoint::handleMessage(const MessageView &message)
+    {
+        if(message.getSizeOfData() < RELIABLE_MESSAGE_HEADER_SIZE)
+        {
+            return;
+        }
+
+        ReliableMessageHeader header = decodeFrom<ReliableMessageHeader>(message.getData().data());
+
+        // even a duplicate is acknowledged, the previous ack may be lost
+        ack_pending_ = true;
+
+        if(isNewerSequence(recv_next_id_, header.id) || recv_above_.count(header.id) != 0)
+        {
+            return;
+        }
+
+        // the sender never goes beyond the ack mask
+        if(header.id - recv_next_id_ > RELIABLE_ACK_MASK_BITS)
+        {
+            return;
+        }
+
+        if(header.id == recv_next_id_)
+        {
+            recv_next_id_++;
+            while(!recv_above_.empty() && *recv_above_.begin() == recv_next_id_)
+            {
+                recv_above_.erase(recv_above_.begin());
+                recv_next_id_++;
+            }
+        }
+        else
+        {
+            recv_above_.insert(header.id);
+        }
+
+        Message carried(MessageCodes(header.hat), message.getData().data() + RELIABLE_MESSAGE_HEADER_SIZE, message.getSizeOfData() - RELIABLE_MESSAGE_HEADER_SIZE);
+
+        if(header.channel != CHANNEL_RELIABLE_ORDERED)
+        {
+            delivered_.push_back(std::move(carried));
+            return;
+        }
+
+        if(header.order != recv_next_order_)
+        {
+            recv_ordered_.emplace(header.order, std::move(carried));
+            return;
+        }
+
+        delivered_.push_back(std::move(carried));
+        recv_next_order_++;
+
+        while(!recv_ordered_.empty() && recv_ordered_.begin()->first == recv_next_order_)
+        {
+            delivered_.push_back(std::move(recv_ordered_.begin()->second));
+            recv_ordered_.erase(recv_ordered_.begin());
+            recv_next_order_++;
+        }
+    }
+
+    void ReliableEndpoint::receive(const MessageView &message, Clock::time_point now)
+    {
+        switch (message.getHat())
+        {
+        case RELIABLE:
+            handleMessage(message);
+            break;
+
+        case RACK:
+            try
+            {
+                handleAck(message.as<ReliableAck>(), now);
+            }
+            catch(DataSizeException& e)
+            {
+                // bad ack ignored, the timers retransmit
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    bool ReliableEndpoint::popDelivered(Message &output)
+    {
+        if(delivered_.empty())
+        {
+            return false;
+        }
+
+        output = std::move(delivered_.front());
+        delivered_.pop_front();
+        return true;
+    }
+
+    bool ReliableEndpoint::fillFrame(Frame &frame, Clock::time_point now, WireVersion version)
+    {
+        std::size_t budget = UNRELIABLE_MAX_DATAGRAM_SIZE - UNRELIABLE_HEADER_SIZE;
+        auto fits = [&](std::size_t data_size){
+            return frame.getLength() < int(peer_limits_.max_frame_messages) && frame.getWireSize(version) + WIRE_MAX_MESSAGE_HEADER_SIZE + data_size <= budget;
+        };
+
+        bool added = false;
+
+        detectLosses(now);
+
+        if(has_rtt_ && !in_flight_.empty() && !in_flight_.rbegin()->second.lost
+           && std::chrono::duration<double, std::milli>(now - last_progress_).count() >= std::max(2 * smoothed_rtt_, double(RELIABLE_MIN_PROBE_MILLI)))
+        {
+            // a probe is not a loss, the window is kept
+            in_flight_.rbegin()->second.lost = true;
+            last_progress_ = now;
+            probe_count_++;
+        }
+
+        // expired timers, the window restarts from its minimum
+        bool timed_out = false;
+        for(auto &[id, message] : in_flight_)
+        {
+            if(!message.lost && std::chrono::duration<double, std::milli>(now - message.sent_at).count() >= rto_)
+            {
+                message.lost = true;
+                timed_out = true;
+            }
+        }
+
+        if(timed_out)
+        {
+            timeout_count_++;
+            rto_ = std::min(rto_ * 2, double(RELIABLE_MAX_RTO_MILLI));
+            slow_start_threshold_ = std::max(congestion_window_ / 2, double(RELIABLE_MIN_WINDOW));
+            congestion_window_ = RELIABLE_MIN_WINDOW;
+            recovery_id_ = next_id_;
+        }
+
+        if(ack_pending_ && fits(wireSize<ReliableAck>()))
+        {
+            ReliableAck ack;
+            ack.next_id = recv_next_id_;
+            for(uint32_t id : recv_above_)
+            {
+                uint32_t bit = id - recv_next_id_ - 1;
+                if(bit < RELIABLE_ACK_MASK_BITS)
+                {
+                    ack.received_mask |= uint64_t(1) << bit;
+                }
+            }
+
+            frame.add(RACK, ack);
+            ack_pending_ = false;
+            added = true;
+        }
+
+        for(auto &[id, message] : in_flight_)
+        {
+            if(!message.lost)
+            {
+                continue;
+            }
+            if(!fits(message.data.size()))
+            {
+                return added;
+            }
+
+            frame.addMessage(Message(RELIABLE, message.data));
+            message.sent_at = now;
+            message.transmissions++;
+            message.lost = false;
+            retransmit_count_++;
+            added = true;
+        }
+
+        while(!waiting_.empty() && in_flight_.size() < std::size_t(congestion_window_) && fits(waiting_.front().size()))
+        {
+            uint32_t id = decodeFrom<uint32_t>(waiting_.front().data());
+
+            // the receiver acknowledges up to RELIABLE_ACK_MASK_BITS after the oldest message missing
+            if(!in_flight_.empty() && id - in_flight_.begin()->first >= RELIABLE_MAX_WINDOW)
+            {
+                break;
+            }
+
+            if(in_flight_.empty())
+            {
+                last_progress_ = now;
+            }
+
+            frame.addMessage(Message(RELIABLE, waiting_.front()));
+            in_flight_.emplace(id, InFlight{std::move(waiting_.front()), now, 1, false});
+            waiting_.pop_front();
+            added = true;
+        }
+
+        return added;
+    }
+}
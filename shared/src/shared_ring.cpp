@@ -0,0 +1,455 @@
+/**
+ * @file shared_ring.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include "shared_ring.hpp"
+
+#if defined(__linux__)
+
+#include <new>
+#include <chrono>
+#include <thread>
+#include <cstring>
+#include <cerrno>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "connection_expections.hpp"
+
+// control block of a ring, padded to a page so that the data starts aligned
+#define SHARED_RING_CONTROL_SIZE 4096
+
+namespace ASE
+{
+    static_assert((SHARED_RING_CAPACITY & (SHARED_RING_CAPACITY - 1)) == 0, "SHARED_RING_CAPACITY must be a power of two");
+    static_assert(sizeof(SharedRingControl) <= SHARED_RING_CONTROL_SIZE, "SharedRingControl bigger than its page");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free, "shared atomics must be lock free");
+
+    static inline void cpuRelax()
+    {
+        #if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+        #endif
+    }
+
+    static inline void futexWait(std::atomic<uint32_t> &futex, uint32_t expected, int timeout_milli)
+    {
+        struct timespec timeout;
+        timeout.tv_sec = timeout_milli / 1000;
+        timeout.tv_nsec = long(timeout_milli % 1000) * 1000000;
+
+        // shared between processes: not FUTEX_PRIVATE_FLAG
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&futex), FUTEX_WAIT, expected, &timeout, nullptr, 0);
+    }
+
+    static inline void futexWake(std::atomic<uint32_t> &futex)
+    {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&futex), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+
+
+    template<typename Ready>
+    bool SharedRing::wait(std::atomic<uint32_t> &futex, std::atomic<uint32_t> &sleeping, int timeout_milli, Ready ready)
+    {
+        // on a single core the other side cannot run while we spin
+        static const int spin_count = std::thread::hardware_concurrency() > 1 ? SHARED_RING_SPIN_COUNT : 0;
+
+        for(int i = 0; i < spin_count; i++)
+        {
+            if(ready())
+            {
+                return true;
+            }
+            cpuRelax();
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_milli);
+        for(;;)
+        {
+            // read before announcing the sleep: a wake after it changes the value and the wait returns at once
+            uint32_t expected = futex.load(std::memory_order_seq_cst);
+            sleeping.store(1, std::memory_order_seq_cst);
+
+            if(ready())
+            {
+                sleeping.store(0, std::memory_order_relaxed);
+                return true;
+            }
+
+            int remaining = int(std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count());
+            if(remaining <= 0)
+            {
+                sleeping.store(0, std::memory_order_relaxed);
+                return false;
+            }
+
+            futexWait(futex, expected, remaining);
+            sleeping.store(0, std::memory_order_relaxed);
+
+            if(ready())
+            {
+                return true;
+            }
+        }
+    }
+
+    void SharedRing::wake(std::atomic<uint32_t> &futex, std::atomic<uint32_t> &sleeping)
+    {
+        // the counter was published before, the other side sees it or is seen sleeping
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if(sleeping.load(std::memory_order_seq_cst) != 0)
+        {
+            futex.fetch_add(1, std::memory_order_seq_cst);
+            futexWake(futex);
+        }
+    }
+
+    std::span<const uint8_t> SharedRing::readable() const
+    {
+        uint64_t head = control_->head.load(std::memory_order_relaxed);
+        uint64_t tail = control_->tail.load(std::memory_order_acquire);
+
+        std::size_t position = std::size_t(head & (SHARED_RING_CAPACITY - 1));
+        std::size_t size = std::min(std::size_t(tail - head), std::size_t(SHARED_RING_CAPACITY) - position);
+        return std::span<const uint8_t>(data_ + position, size);
+    }
+
+    bool SharedRing::write(std::span<const uint8_t> data)
+    {
+        uint64_t tail = control_->tail.load(std::memory_order_relaxed);
+        auto has_room = [&](){
+            return isClosed() || tail - control_->head.load(std::memory_order_acquire) < SHARED_RING_CAPACITY;
+        };
+
+        while(!data.empty())
+        {
+            if(isClosed())
+            {
+                return false;
+            }
+
+            uint64_t head = control_->head.load(std::memory_order_acquire);
+            std::size_t free_size = SHARED_RING_CAPACITY - std::size_t(tail - head);
+            if(free_size == 0)
+            {
+                // full: the reader wakes us when it consumes
+                wait(control_->space_futex, control_->writer_sleeping, SHARED_RING_WAIT_MILLI, has_room);
+                continue;
+            }
+
+            std::size_t position = std::size_t(tail & (SHARED_RING_CAPACITY - 1));
+            std::size_t size = std::min({free_size, data.size(), std::size_t(SHARED_RING_CAPACITY) - position});
+            std::memcpy(data_ + position, data.data(), size);
+
+            tail += size;
+            control_->tail.store(tail, std::memory_order_release);
+            data = data.subspan(size);
+
+            wake(control_->data_futex, control_->reader_sleeping);
+        }
+
+        return true;
+    }
+
+    void SharedRing::consume(std::size_t size)
+    {
+        control_->head.store(control_->head.load(std::memory_order_relaxed) + size, std::memory_order_release);
+        wake(control_->space_futex, control_->writer_sleeping);
+    }
+
+    bool SharedRing::waitReadable(int timeout_milli)
+    {
+        return wait(control_->data_futex, control_->reader_sleeping, timeout_milli, [&](){
+            return isClosed() || control_->tail.load(std::memory_order_acquire) != control_->head.load(std::memory_order_relaxed);
+        });
+    }
+
+    void SharedRing::close()
+    {
+        control_->closed.store(1, std::memory_order_seq_cst);
+
+        control_->data_futex.fetch_add(1, std::memory_order_seq_cst);
+        futexWake(control_->data_futex);
+        control_->space_futex.fetch_add(1, std::memory_order_seq_cst);
+        futexWake(control_->space_futex);
+    }
+
+
+
+    SharedMemoryLink::SharedMemoryLink(): memory_(nullptr), memory_size_(2 * (SHARED_RING_CONTROL_SIZE + SHARED_RING_CAPACITY)), server_side_(false), socket_(INVALID_SOCKET)
+    {
+
+    }
+
+    SharedMemoryLink::~SharedMemoryLink()
+    {
+        close();
+    }
+
+    SharedMemoryLink::SharedMemoryLink(SharedMemoryLink &&other) noexcept: memory_(std::move(other.memory_)), memory_size_(other.memory_size_), 
+        server_side_(other.server_side_), socket_(other.socket_), to_server_(other.to_server_), to_client_(other.to_client_), send_buffer_(std::move(other.send_buffer_))
+    {
+
+    }
+
+    SharedMemoryLink &SharedMemoryLink::operator=(SharedMemoryLink &&other) noexcept
+    {
+        if(this != &other)
+        {
+            close();
+            memory_ = std::move(other.memory_);
+            memory_size_ = other.memory_size_;
+            server_side_ = other.server_side_;
+            socket_ = other.socket_;
+            to_server_ = other.to_server_;
+            to_client_ = other.to_client_;
+            send_buffer_ = std::move(other.send_buffer_);
+        }
+        return *this;
+    }
+
+    void SharedMemoryLink::map(int fd, bool initialize)
+    {
+        void *memory = mmap(nullptr, memory_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(memory == MAP_FAILED)
+        {
+            throw RemoteConnectionException(strerror(errno));
+        }
+
+        attach(memory, initialize);
+    }
+
+    void SharedMemoryLink::attach(void *memory, bool initialize)
+    {
+        // [control to server | data to server | control to client | data to client]
+        uint8_t *bytes = static_cast<uint8_t*>(memory);
+        uint8_t *second = bytes + SHARED_RING_CONTROL_SIZE + SHARED_RING_CAPACITY;
+
+        SharedRingControl *to_server = initialize ? new (bytes) SharedRingControl() : reinterpret_cast<SharedRingControl*>(bytes);
+        SharedRingControl *to_client = initialize ? new (second) SharedRingControl() : reinterpret_cast<SharedRingControl*>(second);
+
+        to_server_ = SharedRing(to_server, bytes + SHARED_RING_CONTROL_SIZE);
+        to_client_ = SharedRing(to_client, second + SHARED_RING_CONTROL_SIZE);
+
+        std::size_t size = memory_size_;
+        memory_ = std::shared_ptr<void>(memory, [size](void *mapping){ munmap(mapping, size); });
+    }
+
+    void SharedMemoryLink::unmap()
+    {
+        memory_.reset();
+    }
+
+    void SharedMemoryLink::createLocalPair(SharedMemoryLink &client_end, SharedMemoryLink &server_end)
+    {
+        client_end.close();
+        server_end.close();
+
+        // both ends are threads of this process: no file to give
+        void *memory = mmap(nullptr, client_end.memory_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(memory == MAP_FAILED)
+        {
+            throw ServerConnectionException(strerror(errno));
+        }
+
+        client_end.attach(memory, true);
+        client_end.server_side_ = false;
+        client_end.socket_ = INVALID_SOCKET;
+
+        server_end.memory_ = client_end.memory_;
+        server_end.to_server_ = client_end.to_server_;
+        server_end.to_client_ = client_end.to_client_;
+        server_end.server_side_ = true;
+        server_end.socket_ = INVALID_SOCKET;
+    }
+
+    void SharedMemoryLink::create(SOCKET unix_socket)
+    {
+        close();
+        server_side_ = false;
+        socket_ = unix_socket;
+
+        int fd = memfd_create("ase_shared_rings", MFD_CLOEXEC);
+        if(fd < 0)
+        {
+            throw ServerConnectionException(strerror(errno));
+        }
+
+        try
+        {
+            if(ftruncate(fd, off_t(memory_size_)) != 0)
+            {
+                throw ServerConnectionException(strerror(errno));
+            }
+            map(fd, true);
+        }
+        catch(ServerConnectionException& e)
+        {
+            ::close(fd);
+            throw;
+        }
+        catch(RemoteConnectionException& e)
+        {
+            ::close(fd);
+            throw ServerConnectionException(e.what());
+        }
+
+        // one byte carrying the descriptor
+        uint8_t byte = 0;
+        struct iovec iov = {&byte, 1};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+
+        struct msghdr message = {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy(CMSG_DATA(header), &fd, sizeof(int));
+
+        ssize_t sent = sendmsg(unix_socket, &message, MSG_NOSIGNAL);
+        ::close(fd);    // the mapping and the descriptor sent keep the memory
+
+        if(sent != 1)
+        {
+            unmap();
+            throw ServerConnectionException("Shared memory not given to the server");
+        }
+    }
+
+    void SharedMemoryLink::accept(SOCKET unix_socket)
+    {
+        close();
+        server_side_ = true;
+        socket_ = unix_socket;
+
+        uint8_t byte = 0;
+        struct iovec iov = {&byte, 1};
+        alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+
+        struct msghdr message = {};
+        message.msg_iov = &iov;
+        message.msg_iovlen = 1;
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+
+        ssize_t received;
+        do
+        {
+            received = recvmsg(unix_socket, &message, MSG_CMSG_CLOEXEC);
+        } while(received < 0 && errno == EINTR);
+
+        struct cmsghdr *header = CMSG_FIRSTHDR(&message);
+        if(received != 1 || header == nullptr || header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS || header->cmsg_len != CMSG_LEN(sizeof(int)))
+        {
+            throw RemoteConnectionException("Shared memory not received from the client");
+        }
+
+        int fd;
+        std::memcpy(&fd, CMSG_DATA(header), sizeof(int));
+
+        // the client sized it, a smaller file would fault on access
+        struct stat file_stat;
+        if(fstat(fd, &file_stat) != 0 || std::size_t(file_stat.st_size) != memory_size_)
+        {
+            ::close(fd);
+            throw RemoteConnectionException("Bad shared memory from the client");
+        }
+
+        try
+        {
+            map(fd, false);
+        }
+        catch(RemoteConnectionException& e)
+        {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+    }
+
+    void SharedMemoryLink::sendFrame(Frame &frame, CompressionContext *compression, WireVersion version)
+    {
+        if(memory_ == nullptr)
+        {
+            throw RemoteConnectionException("Shared memory link closed");
+        }
+
+        send_buffer_.clear();
+        frame.serializeFrame(send_buffer_, compression, version);
+
+        if(!outgoing().write(send_buffer_))
+        {
+            throw RemoteConnectionException("Shared memory link closed");
+        }
+    }
+
+    bool SharedMemoryLink::recvFrameView(FrameReceiver &receiver, FrameView &output, int timeout_milli)
+    {
+        if(memory_ == nullptr)
+        {
+            throw RemoteConnectionException("Shared memory link closed");
+        }
+
+        SharedRing &ring = incoming();
+
+        for(;;)
+        {
+            if(receiver.tryParseFrameView(output))
+            {
+                return true;
+            }
+
+            std::span<const uint8_t> bytes = ring.readable();
+            if(bytes.empty())
+            {
+                // what was written before the close is still read
+                if(ring.isClosed())
+                {
+                    throw RemoteConnectionException("Shared memory link closed");
+                }
+                if(ring.waitReadable(timeout_milli))
+                {
+                    continue;
+                }
+
+                // a process killed does not close its rings, the ends of a local pair close them when destroyed
+                char byte;
+                if(socket_ != INVALID_SOCKET && recv(socket_, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+                {
+                    throw RemoteConnectionException("Shared memory peer gone");
+                }
+                return false;
+            }
+
+            receiver.feed(bytes);
+            ring.consume(bytes.size());
+        }
+    }
+
+    void SharedMemoryLink::shutdown()
+    {
+        if(memory_ == nullptr)
+        {
+            return;
+        }
+
+        to_server_.close();
+        to_client_.close();
+    }
+
+    void SharedMemoryLink::close()
+    {
+        shutdown();
+        unmap();
+    }
+}
+
+#endif
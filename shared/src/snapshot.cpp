@@ -0,0 +1,252 @@
+/**
+ * @file snapshot.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <cstring>
+
+#include "snapshot.hpp"
+#include "varint.hpp"
+
+namespace ASE
+{
+    static const std::size_t SNAPSHOT_HEADER_SIZE = 12;
+
+    // zeros inside a changed area shorter than this are copied instead of skipped
+    static const std::size_t MIN_ZERO_RUN = 3;
+
+    static inline void appendVarint(PayloadBuffer &output, uint64_t value)
+    {
+        uint8_t encoded[VARINT_MAX_SIZE];
+        output.append(encoded, encodeVarint(value, encoded));
+    }
+
+
+    // ~~~~~~~~~~ SnapshotEncoder ~~~~~~~~~~
+
+    SnapshotEncoder::SnapshotEncoder() : next_id_(1), newest_acked_id_(0)
+    {
+
+    }
+
+    void SnapshotEncoder::reset()
+    {
+        for(auto &entry : history_)
+        {
+            entry.id = 0;
+        }
+        newest_acked_id_ = 0;
+    }
+
+    void SnapshotEncoder::acknowledge(uint32_t snapshot_id)
+    {
+        if(snapshot_id != 0 && snapshot_id < next_id_ && snapshot_id > newest_acked_id_)
+        {
+            newest_acked_id_ = snapshot_id;
+        }
+    }
+
+    Message SnapshotEncoder::encode(std::span<const uint8_t> state)
+    {
+        uint32_t id = next_id_++;
+        if(next_id_ == 0)
+        {
+            next_id_ = 1;
+        }
+
+        // baseline must still be remembered, and not share the slot of the new snapshot
+        const SnapshotEntry *baseline = nullptr;
+        if(newest_acked_id_ != 0 && id - newest_acked_id_ < SNAPSHOT_HISTORY_SIZE)
+        {
+            const SnapshotEntry &entry = history_[newest_acked_id_ % SNAPSHOT_HISTORY_SIZE];
+            if(entry.id == newest_acked_id_)
+            {
+                baseline = &entry;
+            }
+        }
+
+        Message output(SNAPSHOT, nullptr, 0);
+        PayloadBuffer &payload = output.getDataRef();
+
+        if(baseline != nullptr)
+        {
+            output.append(id);
+            output.append(baseline->id);
+            output.append(uint32_t(state.size()));
+
+            xor_scratch_.resize(state.size());
+            for(std::size_t i = 0; i < state.size(); i++)
+            {
+                xor_scratch_[i] = state[i] ^ (i < baseline->state.size() ? baseline->state[i] : 0);
+            }
+
+            std::size_t pos = 0;
+            while(pos < xor_scratch_.size())
+            {
+                std::size_t zeros = 0;
+                while(pos + zeros < xor_scratch_.size() && xor_scratch_[pos + zeros] == 0)
+                {
+                    zeros++;
+                }
+
+                std::size_t copy_begin = pos + zeros;
+                std::size_t copy_end = copy_begin;
+                while(copy_end < xor_scratch_.size())
+                {
+                    // stop the copy before a long enough zero run
+                    std::size_t next_zeros = 0;
+                    while(copy_end + next_zeros < xor_scratch_.size() && xor_scratch_[copy_end + next_zeros] == 0 && next_zeros < MIN_ZERO_RUN)
+                    {
+                        next_zeros++;
+                    }
+
+                    if(next_zeros == MIN_ZERO_RUN || copy_end + next_zeros == xor_scratch_.size())
+                    {
+                        break;
+                    }
+                    copy_end += next_zeros + 1;
+                }
+
+                if(copy_end == copy_begin)
+                {
+                    break;      // only zeros left
+                }
+
+                appendVarint(payload, zeros);
+                appendVarint(payload, copy_end - copy_begin);
+                payload.append(xor_scratch_.data() + copy_begin, copy_end - copy_begin);
+
+                pos = copy_end;
+            }
+
+            // a delta bigger than the state is useless
+            if(payload.size() >= SNAPSHOT_HEADER_SIZE + state.size())
+            {
+                baseline = nullptr;
+                payload.clear();
+            }
+        }
+
+        if(baseline == nullptr)
+        {
+            output.append(id);
+            output.append(uint32_t(0));
+            output.append(uint32_t(state.size()));
+            payload.append(state.data(), state.size());
+        }
+
+        SnapshotEntry &slot = history_[id % SNAPSHOT_HISTORY_SIZE];
+        slot.id = id;
+        slot.state.assign(state.begin(), state.end());
+
+        return output;
+    }
+
+
+    // ~~~~~~~~~~ SnapshotDecoder ~~~~~~~~~~
+
+    SnapshotDecoder::SnapshotDecoder() : latest_id_(0)
+    {
+
+    }
+
+    void SnapshotDecoder::reset()
+    {
+        for(auto &entry : history_)
+        {
+            entry.id = 0;
+        }
+        latest_id_ = 0;
+    }
+
+    std::span<const uint8_t> SnapshotDecoder::getLatestState() const
+    {
+        if(latest_id_ == 0)
+        {
+            return {};
+        }
+        const SnapshotEntry &entry = history_[latest_id_ % SNAPSHOT_HISTORY_SIZE];
+        return std::span<const uint8_t>(entry.state.data(), entry.state.size());
+    }
+
+    uint32_t SnapshotDecoder::decode(const MessageView &message)
+    {
+        uint32_t id = message.as<uint32_t>(0);
+        uint32_t baseline_id = message.as<uint32_t>(1);
+        uint32_t size = message.as<uint32_t>(2);
+
+        std::span<const uint8_t> body = message.getData().subspan(SNAPSHOT_HEADER_SIZE);
+
+        if(id == 0)
+        {
+            throw DataSizeException("Bad snapshot id");
+        }
+
+        SnapshotEntry &slot = history_[id % SNAPSHOT_HISTORY_SIZE];
+
+        if(baseline_id == 0)
+        {
+            if(body.size() != size)
+            {
+                throw DataSizeException("Bad full snapshot size");
+            }
+            slot.id = id;
+            slot.state.assign(body.begin(), body.end());
+        }
+        else
+        {
+            const SnapshotEntry &baseline = history_[baseline_id % SNAPSHOT_HISTORY_SIZE];
+            if(baseline.id != baseline_id || &baseline == &slot)
+            {
+                return 0;       // baseline forgotten, wait for a snapshot based on a newer ack
+            }
+
+            // the slot of the new snapshot is not the baseline one, it can be rebuilt in place
+            slot.id = 0;
+            slot.state.resize(size);
+            for(std::size_t i = 0; i < size; i++)
+            {
+                slot.state[i] = i < baseline.state.size() ? baseline.state[i] : 0;
+            }
+
+            std::size_t pos = 0;
+            std::size_t read = 0;
+            while(read < body.size())
+            {
+                uint64_t zeros;
+                uint64_t copy;
+
+                std::size_t varint_size = decodeVarint(body.data() + read, body.size() - read, zeros);
+                if(varint_size == 0)
+                {
+                    throw DataSizeException("Bad snapshot delta");
+                }
+                read += varint_size;
+
+                varint_size = decodeVarint(body.data() + read, body.size() - read, copy);
+                if(varint_size == 0)
+                {
+                    throw DataSizeException("Bad snapshot delta");
+                }
+                read += varint_size;
+
+                pos += zeros;
+                if(copy > body.size() - read || pos + copy > size)
+                {
+                    throw DataSizeException("Bad snapshot delta");
+                }
+
+                for(std::size_t i = 0; i < copy; i++)
+                {
+                    slot.state[pos + i] ^= body[read + i];
+                }
+                pos += copy;
+                read += copy;
+            }
+            slot.id = id;
+        }
+
+        latest_id_ = id;
+        return id;
+    }
+}
@@ -0,0 +1,96 @@
+/**
+ * @file tick_scheduler.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <algorithm>
+
+#include "tick_scheduler.hpp"
+
+namespace ASE
+{
+    TickScheduler::TickScheduler(VirtualClock &clock, Clock::duration period): clock_(clock), period_(period), policy_(TICK_CATCH_UP),
+                                                                             max_catch_up_ticks_(5), tick_(0), started_(false)
+    {
+
+    }
+
+    TickStats TickScheduler::getStats() const
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        return stats_;
+    }
+
+    void TickScheduler::setPeriod(Clock::duration period)
+    {
+        period_ = std::max(period, Clock::duration(1));
+    }
+
+    void TickScheduler::setCatchUpPolicy(TickCatchUpPolicy policy, int max_catch_up_ticks)
+    {
+        policy_ = policy;
+        max_catch_up_ticks_ = std::max(max_catch_up_ticks, 0);
+    }
+
+    void TickScheduler::resetStats()
+    {
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_ = TickStats();
+    }
+
+    uint64_t TickScheduler::waitNextTick()
+    {
+        uint64_t tick = tick_.load(std::memory_order_relaxed) + 1;
+        if(!started_)
+        {
+            started_ = true;
+            tick = 0;
+            deadline_ = clock_.now();
+        }
+        else
+        {
+            deadline_ += period_;
+        }
+
+        Clock::time_point now = clock_.now();
+
+        // deadlines of the next ticks already passed
+        uint64_t late = now > deadline_ ? uint64_t((now - deadline_) / period_) : 0;
+        uint64_t allowed = policy_ == TICK_CATCH_UP ? uint64_t(max_catch_up_ticks_) : 0;
+        uint64_t skipped = 0;
+        if(late > allowed)
+        {
+            skipped = late - allowed;
+            deadline_ += period_ * Clock::duration::rep(skipped);
+            tick += skipped;
+        }
+        tick_.store(tick, std::memory_order_relaxed);
+
+        clock_.sleepUntil(deadline_);
+        Clock::time_point start = clock_.now();
+        work_start_ = std::chrono::steady_clock::now();
+
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.ticks++;
+        stats_.skipped += skipped;
+        stats_.last_jitter = start - deadline_;
+        stats_.max_jitter = std::max(stats_.max_jitter, stats_.last_jitter);
+        stats_.total_jitter += stats_.last_jitter;
+
+        return tick;
+    }
+
+    void TickScheduler::endTick()
+    {
+        auto work = std::chrono::steady_clock::now() - work_start_;
+        bool overrun = clock_.now() > deadline_ + period_;
+
+        std::lock_guard<std::mutex> lock(stats_mutex_);
+        stats_.last_work = work;
+        stats_.max_work = std::max(stats_.max_work, work);
+        if(overrun)
+        {
+            stats_.overruns++;
+        }
+    }
+}
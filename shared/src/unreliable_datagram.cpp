@@ -0,0 +1,86 @@
+/**
+ * @file unreliable_datagram.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <stdexcept>
+
+#include "unreliable_datagram.hpp"
+
+namespace ASE
+{
+    bool decodeUnreliableHeader(std::span<const uint8_t> datagram, UnreliableHeader &output)
+    {
+        if(datagram.size() < UNRELIABLE_HEADER_SIZE)
+        {
+            return false;
+        }
+
+        output = decodeFrom<UnreliableHeader>(datagram.data());
+        return true;
+    }
+
+    void encodeUnreliableDatagram(const UnreliableHeader &header, Frame &frame, WireVersion version, std::vector<uint8_t> &output)
+    {
+        output.resize(UNRELIABLE_HEADER_SIZE);
+        encodeTo(header, output.data());
+        frame.serializeFrame(output, nullptr, version);
+
+        if(output.size() > UNRELIABLE_MAX_DATAGRAM_SIZE)
+        {
+            output.clear();
+            throw std::length_error("Frame too big for a datagram");
+        }
+    }
+
+
+    UnreliableReceiver::UnreliableReceiver(WireVersion version, const ConnectionLimits &limits): receiver_(INVALID_SOCKET, UNRELIABLE_MAX_DATAGRAM_SIZE),
+                                                                                                 last_sequence_(0), received_(false), dropped_count_(0)
+    {
+        receiver_.setWireVersion(version);
+        receiver_.setLimits(limits);
+    }
+
+    void UnreliableReceiver::reset()
+    {
+        received_ = false;
+        last_sequence_ = 0;
+    }
+
+    bool UnreliableReceiver::receive(const UnreliableHeader &header, std::span<const uint8_t> datagram, FrameView &output, bool &newest)
+    {
+        newest = false;
+
+        // each datagram is parsed alone, nothing is kept from the previous one
+        receiver_.setSocket(INVALID_SOCKET);
+        receiver_.feed(datagram.subspan(UNRELIABLE_HEADER_SIZE));
+
+        bool valid = false;
+        try
+        {
+            valid = receiver_.tryParseFrameView(output) && receiver_.getBufferedSize() == 0;
+        }
+        catch(const std::exception& e)
+        {
+            valid = false;
+        }
+
+        if(!valid)
+        {
+            output.clear();
+            dropped_count_++;
+            return false;
+        }
+
+        if(received_ && !isNewerSequence(header.sequence, last_sequence_))
+        {
+            dropped_count_++;
+            return true;
+        }
+
+        last_sequence_ = header.sequence;
+        received_ = true;
+        newest = true;
+        return true;
+    }
+}
@@ -0,0 +1,144 @@
+/**
+ * @file virtual_clock.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <thread>
+#include <iterator>
+
+#if defined(__linux__)
+#include <time.h>
+#include <errno.h>
+#endif
+
+#include "virtual_clock.hpp"
+
+namespace ASE
+{
+    VirtualClock::VirtualClock(): virtual_(false)
+    {
+
+    }
+
+    bool VirtualClock::isVirtual() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return virtual_;
+    }
+
+    VirtualClock::Clock::time_point VirtualClock::now() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return virtual_ ? now_ : Clock::now();
+    }
+
+    std::size_t VirtualClock::countSleeping() const
+    {
+        // woken threads keep their deadline until they run again
+        return std::size_t(std::distance(wakeups_.upper_bound(now_), wakeups_.end()));
+    }
+
+    std::size_t VirtualClock::getSleepingCount() const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return countSleeping();
+    }
+
+    void VirtualClock::setVirtual(bool is_virtual)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(is_virtual && !virtual_)
+            {
+                now_ = Clock::now();
+            }
+            virtual_ = is_virtual;
+        }
+        advanced_.notify_all();
+    }
+
+    void VirtualClock::sleepFor(Clock::duration duration)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(!virtual_)
+        {
+            lock.unlock();
+            std::this_thread::sleep_for(duration);
+            return;
+        }
+
+        Clock::time_point deadline = now_ + duration;
+        lock.unlock();
+        sleepUntil(deadline);
+    }
+
+    void VirtualClock::sleepUntil(Clock::time_point deadline)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if(!virtual_)
+        {
+            lock.unlock();
+
+            #if defined(__linux__)
+            // steady_clock is CLOCK_MONOTONIC, its time points are absolute times of it
+            auto since_epoch = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+            struct timespec target;
+            target.tv_sec = time_t(since_epoch.count() / 1000000000);
+            target.tv_nsec = long(since_epoch.count() % 1000000000);
+            while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &target, nullptr) == EINTR)
+            {
+
+            }
+
+            #else
+            std::this_thread::sleep_until(deadline);
+            #endif
+            return;
+        }
+
+        if(now_ >= deadline)
+        {
+            return;
+        }
+
+        auto wakeup = wakeups_.insert(deadline);
+        sleeping_.notify_all();
+
+        advanced_.wait(lock, [&](){ return !virtual_ || now_ >= deadline; });
+        wakeups_.erase(wakeup);
+    }
+
+    void VirtualClock::advance(Clock::duration duration)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(!virtual_)
+            {
+                return;
+            }
+            now_ += duration;
+        }
+        advanced_.notify_all();
+    }
+
+    bool VirtualClock::advanceToNextWakeup()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto next = wakeups_.upper_bound(now_);
+            if(!virtual_ || next == wakeups_.end())
+            {
+                return false;
+            }
+            now_ = *next;
+        }
+        advanced_.notify_all();
+        return true;
+    }
+
+    bool VirtualClock::waitSleeping(std::size_t count, Clock::duration timeout)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return sleeping_.wait_for(lock, timeout, [&](){ return countSleeping() >= count; });
+    }
+}
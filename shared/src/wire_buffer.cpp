@@ -0,0 +1,68 @@
+/**
+ * @file wire_buffer.cpp
+ * @author Yann Le Masson
+ * 
+ */
+#include <algorithm>
+
+#include "wire_buffer.hpp"
+
+namespace ASE
+{
+    /**
+     * @brief Append the headers and payloads of messages to output, encoded for version
+     * 
+     */
+    static void serializeMessages(const std::vector<Message> &messages, WireVersion version, std::vector<uint8_t> &output)
+    {
+        std::size_t total_size = 0;
+        for(const Message &message : messages)
+        {
+            total_size += WIRE_MAX_MESSAGE_HEADER_SIZE + message.getSizeOfData();
+        }
+        output.reserve(total_size);
+
+        for(const Message &message : messages)
+        {
+            uint8_t header[WIRE_MAX_MESSAGE_HEADER_SIZE];
+            std::size_t header_size = encodeMessageHeader(version, message.getHat(), message.getSizeOfData(), header);
+
+            output.insert(output.end(), header, header + header_size);
+            output.insert(output.end(), message.getDataConstRef().begin(), message.getDataConstRef().end());
+        }
+    }
+
+    WireBuffer::WireBuffer(const std::vector<Message> &messages) : length_(int(messages.size())), max_message_size_(0)
+    {
+        serializeMessages(messages, WIRE_V1, bytes_v1_);
+        serializeMessages(messages, WIRE_V2, bytes_v2_);
+
+        for(const Message &message : messages)
+        {
+            max_message_size_ = std::max(max_message_size_, message.getSizeOfData());
+        }
+    }
+
+    std::vector<Message> WireBuffer::toMessages() const
+    {
+        std::vector<Message> output;
+        output.reserve(std::size_t(length_));
+
+        std::size_t pos = 0;
+        for(int i = 0; i < length_; i++)
+        {
+            uint8_t hat;
+            std::size_t size;
+            pos += decodeMessageHeader(WIRE_V1, bytes_v1_.data() + pos, bytes_v1_.size() - pos, hat, size);
+            output.emplace_back(MessageCodes(hat), bytes_v1_.data() + pos, size);
+            pos += size;
+        }
+
+        return output;
+    }
+
+    SharedWireBuffer makeWireBuffer(const std::vector<Message> &messages)
+    {
+        return std::make_shared<const WireBuffer>(messages);
+    }
+}